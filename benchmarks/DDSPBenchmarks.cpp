@@ -0,0 +1,479 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+Micro-benchmarks of the DSP and inference components, one model hop per
+iteration unless noted. Names are Component/operation/parameters and must not
+change, results are compared by name across commits. Run the DDSPBenchmarksJson
+target, or pass --benchmark_out=<file> --benchmark_out_format=json, to get JSON.
+*/
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "PluginProcessor.h"
+#include "audio/AudioRingBuffer.h"
+#include "audio/HarmonicSynthesizer.h"
+#include "audio/MidiInputProcessor.h"
+#include "audio/NativeFeatureExtractor.h"
+#include "audio/NoiseSynthesizer.h"
+#include "audio/PolyphaseResampler.h"
+#include "audio/tflite/FeatureExtractionModel.h"
+#include "audio/tflite/PredictControlsModel.h"
+#include "util/Constants.h"
+#include "util/MemoryArena.h"
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+constexpr int kHopSizes[] = { 64, 128, 160, 320 };
+constexpr double kHostSampleRates[] = { 44100.0, 48000.0 };
+
+struct EmbeddedModel
+{
+    const char* name;
+    const char* data;
+    int size;
+};
+
+const EmbeddedModel kEmbeddedModels[] = {
+    { "Bassoon", BinaryData::Bassoon_tflite, BinaryData::Bassoon_tfliteSize },
+    { "Clarinet", BinaryData::Clarinet_tflite, BinaryData::Clarinet_tfliteSize },
+    { "Flute", BinaryData::Flute_tflite, BinaryData::Flute_tfliteSize },
+    { "Melodica", BinaryData::Melodica_tflite, BinaryData::Melodica_tfliteSize },
+    { "Saxophone", BinaryData::Saxophone_tflite, BinaryData::Saxophone_tfliteSize },
+    { "Sitar", BinaryData::Sitar_tflite, BinaryData::Sitar_tfliteSize },
+    { "Trombone", BinaryData::Trombone_tflite, BinaryData::Trombone_tfliteSize },
+    { "Trumpet", BinaryData::Trumpet_tflite, BinaryData::Trumpet_tfliteSize },
+    { "Tuba", BinaryData::Tuba_tflite, BinaryData::Tuba_tfliteSize },
+    { "Violin", BinaryData::Violin_tflite, BinaryData::Violin_tfliteSize },
+    { "Vowels", BinaryData::Vowels_tflite, BinaryData::Vowels_tfliteSize },
+};
+
+// Small control models in assets/test_models, written by scripts/make-test-models.py.
+const char* const kTestModelPrecisions[] = { "float32", "float16", "dynamic_int8", "int8" };
+
+juce::File locateAsset (const std::string& name)
+{
+    for (auto dir = juce::File::getSpecialLocation (juce::File::currentExecutableFile); ! dir.isRoot();
+         dir = dir.getParentDirectory())
+    {
+        const auto asset = dir.getChildFile ("assets").getChildFile (name);
+        if (asset.existsAsFile())
+        {
+            return asset;
+        }
+    }
+    return {};
+}
+
+// Empty if the fixture cannot be found. Kept loaded until the benchmarks exit.
+EmbeddedModel loadTestModel (const char* precision)
+{
+    static std::vector<std::unique_ptr<juce::MemoryBlock>> loaded;
+    auto& data = *loaded.emplace_back (std::make_unique<juce::MemoryBlock>());
+    locateAsset (std::string ("test_models/control_") + precision + ".tflite").loadFileAsData (data);
+    return { precision, static_cast<const char*> (data.getData()), static_cast<int> (data.getSize()) };
+}
+
+const char* getQualityName (ddsp::PolyphaseResampler::Quality quality)
+{
+    switch (quality)
+    {
+        case ddsp::PolyphaseResampler::Quality::kLow:
+            return "low";
+        case ddsp::PolyphaseResampler::Quality::kMedium:
+            return "medium";
+        default:
+            return "high";
+    }
+}
+
+std::vector<float> makeNoise (int numSamples)
+{
+    juce::Random random (1);
+    std::vector<float> samples (static_cast<size_t> (numSamples));
+    for (auto& sample : samples)
+    {
+        sample = 0.5f * (random.nextFloat() - 0.5f);
+    }
+    return samples;
+}
+
+// Mono recording from assets at the model sample rate, or noise if it cannot be read. Long
+// enough that streaming through it does not repeat within a benchmark's warm-up.
+std::vector<float> readAtModelRate (const std::string& name, int minNumSamples)
+{
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (locateAsset (name)));
+    if (reader == nullptr || reader->lengthInSamples == 0)
+    {
+        return makeNoise (minNumSamples);
+    }
+
+    juce::AudioBuffer<float> input (1, static_cast<int> (reader->lengthInSamples));
+    reader->read (&input, 0, input.getNumSamples(), 0, true, false);
+
+    const double ratio = reader->sampleRate / ddsp::kModelSampleRate_Hz;
+    std::vector<float> resampled (static_cast<size_t> (input.getNumSamples() / ratio));
+    juce::WindowedSincInterpolator interpolator;
+    interpolator.process (ratio, input.getReadPointer (0), resampled.data(), static_cast<int> (resampled.size()));
+    return resampled;
+}
+
+// Lays out and commits an arena for the buffers prepare places in it.
+template <typename PrepareFn>
+void prepareInArena (ddsp::MemoryArena& arena, PrepareFn&& prepare)
+{
+    arena.beginLayout();
+    prepare (arena);
+    arena.commit ({});
+    prepare (arena);
+}
+
+void benchmarkHarmonicSynthesizer (benchmark::State& state, int hopSize)
+{
+    ddsp::MemoryArena arena;
+    ddsp::HarmonicSynthesizer synthesizer (ddsp::kHarmonicsSize, ddsp::kModelSampleRate_Hz);
+    prepareInArena (arena, [&] (ddsp::MemoryArena& a) { synthesizer.prepare (hopSize, a); });
+
+    std::array<float, ddsp::kHarmonicsSize> distribution;
+    std::array<float, ddsp::kHarmonicsSize> harmonics;
+    for (size_t i = 0; i < distribution.size(); ++i)
+    {
+        distribution[i] = 1.0f / static_cast<float> (i + 1);
+    }
+
+    for (auto _ : state)
+    {
+        // render() normalizes the distribution in place.
+        harmonics = distribution;
+        benchmark::DoNotOptimize (synthesizer.render (harmonics.data(), 0.5f, 220.0f));
+    }
+    state.SetItemsProcessed (state.iterations() * hopSize);
+}
+
+void benchmarkNoiseSynthesizer (benchmark::State& state, int hopSize)
+{
+    ddsp::MemoryArena arena;
+    ddsp::NoiseSynthesizer synthesizer (ddsp::kNoiseAmpsSize);
+    prepareInArena (arena, [&] (ddsp::MemoryArena& a) { synthesizer.prepare (hopSize, a); });
+
+    std::array<float, ddsp::kNoiseAmpsSize> magnitudes;
+    magnitudes.fill (0.01f);
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize (synthesizer.render (magnitudes.data()));
+    }
+    state.SetItemsProcessed (state.iterations() * hopSize);
+}
+
+// One host block in, one out, as the audio and render threads do between them.
+void benchmarkAudioRingBuffer (benchmark::State& state, int blockSize)
+{
+    ddsp::AudioRingBuffer ring;
+    ring.prepare (1, ddsp::AudioRingBuffer::getCapacityFor (48000.0, blockSize, 960));
+    const auto input = makeNoise (blockSize);
+    std::vector<float> output (static_cast<size_t> (blockSize));
+
+    for (auto _ : state)
+    {
+        ring.push (input.data(), blockSize);
+        ring.copy (output.data(), blockSize);
+        ring.pop (blockSize);
+        benchmark::DoNotOptimize (output.data());
+    }
+    state.SetItemsProcessed (state.iterations() * blockSize);
+}
+
+// The input resampler takes a model hop at the host rate to the model rate, the output
+// resampler the other way round.
+void benchmarkResampler (benchmark::State& state,
+                         bool isInput,
+                         double hostRate,
+                         ddsp::PolyphaseResampler::Quality quality)
+{
+    const double inputRate = isInput ? hostRate : ddsp::kModelSampleRate_Hz;
+    const double outputRate = isInput ? ddsp::kModelSampleRate_Hz : hostRate;
+    const auto numInputSamples =
+        static_cast<int> (std::round (ddsp::kModelHopSize * inputRate / ddsp::kModelSampleRate_Hz));
+
+    ddsp::PolyphaseResampler resampler;
+    resampler.prepare (inputRate, outputRate, numInputSamples, quality);
+    const auto input = makeNoise (numInputSamples);
+    std::vector<float> output (static_cast<size_t> (resampler.getMaxOutputSamples (numInputSamples)));
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize (
+            resampler.process (input.data(), numInputSamples, output.data(), static_cast<int> (output.size())));
+    }
+    state.SetItemsProcessed (state.iterations() * numInputSamples);
+}
+
+// One analysis frame, which is run every hop.
+void benchmarkFeatureExtractionModel (benchmark::State& state)
+{
+    ddsp::FeatureExtractionModel model;
+    juce::AudioBuffer<float> frame (1, ddsp::kModelFrameSize);
+    const auto noise = makeNoise (ddsp::kModelFrameSize);
+    frame.copyFrom (0, 0, noise.data(), ddsp::kModelFrameSize);
+    ddsp::AudioFeatures features;
+
+    for (auto _ : state)
+    {
+        model.call (frame, features);
+        benchmark::DoNotOptimize (features);
+    }
+}
+
+// One hop of a recording streamed into the extractor, as the render thread does, so both
+// implementations are compared on the same voiced and silent frames. Every hop analyses a
+// whole frame, so the cost per second of audio grows as the hop shrinks.
+void benchmarkFeatureExtractor (benchmark::State& state, ddsp::FeatureExtractorType type, int hopSize)
+{
+    std::unique_ptr<ddsp::FeatureExtractor> extractor;
+    if (type == ddsp::FeatureExtractorType::kNative)
+    {
+        extractor = std::make_unique<ddsp::NativeFeatureExtractor>();
+    }
+    else
+    {
+        extractor = std::make_unique<ddsp::FeatureExtractionModel>();
+    }
+
+    const auto input = readAtModelRate ("ddsp_input_48k.wav", 16 * ddsp::kModelFrameSize);
+    const int numHops = (static_cast<int> (input.size()) - ddsp::kModelFrameSize) / hopSize;
+    std::copy (input.begin(), input.begin() + ddsp::kModelFrameSize, extractor->getInputBuffer());
+
+    ddsp::AudioFeatures features;
+    int hop = 0;
+    for (auto _ : state)
+    {
+        hop = (hop + 1) % numHops;
+        const float* newSamples = input.data() + ddsp::kModelFrameSize + hop * hopSize;
+        std::copy (newSamples - hopSize, newSamples, extractor->shiftInputBuffer (hopSize));
+        extractor->process (features);
+        benchmark::DoNotOptimize (features);
+    }
+    state.SetItemsProcessed (state.iterations() * hopSize);
+}
+
+// Also reports the size of the model and the memory its instance allocates, to compare
+// the precisions of the fixtures against float32.
+void benchmarkPredictControlsModel (benchmark::State& state,
+                                    const EmbeddedModel& embeddedModel,
+                                    ddsp::PredictControlsModel::Engine engine)
+{
+    if (embeddedModel.size == 0)
+    {
+        state.SkipWithError ("Could not load the model");
+        return;
+    }
+    const ddsp::ModelInfo mi (embeddedModel.name, "", embeddedModel.data, static_cast<size_t> (embeddedModel.size));
+    ddsp::PredictControlsModel model (mi, engine);
+    if (model.getEngine() != engine)
+    {
+        state.SkipWithError ("The native engine does not support this model");
+        return;
+    }
+
+    ddsp::AudioFeatures input;
+    input.loudness_norm = 0.6f;
+    ddsp::SynthesisControls output;
+    int hop = 0;
+    for (auto _ : state)
+    {
+        input.f0_norm = 0.5f + 0.1f * std::sin (0.01f * static_cast<float> (hop++));
+        model.call (input, output);
+        benchmark::DoNotOptimize (output);
+    }
+    state.counters["model_KiB"] = static_cast<double> (mi.data.getSize()) / 1024.0;
+    state.counters["allocated_KiB"] = static_cast<double> (model.getMemoryFootprint()) / 1024.0;
+}
+
+// Queues a host hop of MIDI and renders the controls for it.
+void benchmarkMidiInputProcessor (benchmark::State& state, int numNotesPerHop)
+{
+    constexpr int numHostSamples = 960;
+
+    ddsp::MidiInputProcessor processor;
+    processor.prepareToPlay (ddsp::kModelSampleRate_Hz, ddsp::kModelHopSize);
+    processor.reset (0);
+
+    juce::MidiBuffer midi;
+    for (int i = 0; i < numNotesPerHop; ++i)
+    {
+        const int position = i * numHostSamples / std::max (1, numNotesPerHop);
+        midi.addEvent (juce::MidiMessage::noteOn (1, 60 + i % 12, 0.8f), position);
+        midi.addEvent (juce::MidiMessage::noteOff (1, 60 + i % 12), position + numHostSamples / (2 * numNotesPerHop));
+    }
+
+    for (auto _ : state)
+    {
+        processor.processMidiMessages (midi, numHostSamples);
+        benchmark::DoNotOptimize (processor.getCurrentPredictControlsInput (numHostSamples));
+    }
+}
+
+// One host block through the whole plugin, rendering on the audio thread. Also reports the
+// latency, which shrinks with the hop, and how many times faster than real time it runs.
+void benchmarkInferencePipeline (benchmark::State& state, int hopSize)
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int blockSize = 512;
+
+    const juce::ScopedJuceInitialiser_GUI juceInitialiser;
+    DDSPAudioProcessor processor (/*singleThreaded=*/true);
+    processor.setModelHopSize (hopSize);
+    processor.prepareToPlay (sampleRate, blockSize);
+
+    // About a second of a sine, looped. processBlock replaces the input with the output.
+    constexpr int numInputBlocks = static_cast<int> (sampleRate) / blockSize;
+    std::vector<float> input (static_cast<size_t> (numInputBlocks * blockSize));
+    for (size_t i = 0; i < input.size(); ++i)
+    {
+        input[i] = 0.5f * static_cast<float> (std::sin (juce::MathConstants<double>::twoPi * 220.0 * i / sampleRate));
+    }
+
+    juce::AudioBuffer<float> buffer (1, blockSize);
+    juce::MidiBuffer midiBuffer;
+    int block = 0;
+    for (auto _ : state)
+    {
+        buffer.copyFrom (0, 0, input.data() + block * blockSize, blockSize);
+        block = (block + 1) % numInputBlocks;
+        processor.processBlock (buffer, midiBuffer);
+    }
+    state.SetItemsProcessed (state.iterations() * blockSize);
+    state.counters["latency_samples"] = processor.getLatencySamples();
+    state.counters["realtime_x"] = benchmark::Counter (
+        static_cast<double> (state.iterations()) * blockSize / sampleRate, benchmark::Counter::kIsRate);
+}
+
+void registerBenchmarks()
+{
+    for (const int hopSize : kHopSizes)
+    {
+        const auto hop = std::to_string (hopSize);
+        benchmark::RegisterBenchmark (("HarmonicSynthesizer/render/hop:" + hop).c_str(),
+                                      benchmarkHarmonicSynthesizer,
+                                      hopSize);
+        benchmark::RegisterBenchmark (("NoiseSynthesizer/render/hop:" + hop).c_str(),
+                                      benchmarkNoiseSynthesizer,
+                                      hopSize);
+    }
+
+    for (const int blockSize : { 64, 512, 2048 })
+    {
+        benchmark::RegisterBenchmark (("AudioRingBuffer/pushCopyPop/block:" + std::to_string (blockSize)).c_str(),
+                                      benchmarkAudioRingBuffer,
+                                      blockSize);
+    }
+
+    for (const bool isInput : { true, false })
+    {
+        for (const double hostRate : kHostSampleRates)
+        {
+            for (const auto quality : { ddsp::PolyphaseResampler::Quality::kLow,
+                                        ddsp::PolyphaseResampler::Quality::kMedium,
+                                        ddsp::PolyphaseResampler::Quality::kHigh })
+            {
+                const auto name = std::string ("PolyphaseResampler/") + (isInput ? "input" : "output") + "/rate:"
+                                  + std::to_string (static_cast<int> (hostRate)) + "/" + getQualityName (quality);
+                benchmark::RegisterBenchmark (name.c_str(), benchmarkResampler, isInput, hostRate, quality);
+            }
+        }
+    }
+
+    benchmark::RegisterBenchmark ("FeatureExtractionModel/call", benchmarkFeatureExtractionModel)
+        ->Unit (benchmark::kMicrosecond);
+
+    for (const auto type : { ddsp::FeatureExtractorType::kTFLite, ddsp::FeatureExtractorType::kNative })
+    {
+        const auto name =
+            std::string ("FeatureExtractor/") + (type == ddsp::FeatureExtractorType::kNative ? "native" : "tflite");
+        benchmark::RegisterBenchmark (name.c_str(), benchmarkFeatureExtractor, type, ddsp::kModelHopSize)
+            ->Unit (benchmark::kMicrosecond);
+    }
+
+    for (const int hopSize : kHopSizes)
+    {
+        benchmark::RegisterBenchmark (("NativeFeatureExtractor/process/hop:" + std::to_string (hopSize)).c_str(),
+                                      benchmarkFeatureExtractor,
+                                      ddsp::FeatureExtractorType::kNative,
+                                      hopSize)
+            ->Unit (benchmark::kMicrosecond);
+    }
+
+    for (const auto& embeddedModel : kEmbeddedModels)
+    {
+        for (const auto engine : { ddsp::PredictControlsModel::Engine::kTFLite,
+                                   ddsp::PredictControlsModel::Engine::kNative })
+        {
+            const auto name = std::string ("PredictControlsModel/call/") + embeddedModel.name + "/"
+                              + (engine == ddsp::PredictControlsModel::Engine::kNative ? "native" : "tflite");
+            benchmark::RegisterBenchmark (name.c_str(), benchmarkPredictControlsModel, embeddedModel, engine)
+                ->Unit (benchmark::kMicrosecond);
+        }
+    }
+
+    // The fixtures are not decoders the native engine matches, so they only run on TFLite.
+    for (const char* precision : kTestModelPrecisions)
+    {
+        const auto name = std::string ("PredictControlsModel/call/fixture:") + precision + "/tflite";
+        benchmark::RegisterBenchmark (name.c_str(),
+                                      benchmarkPredictControlsModel,
+                                      loadTestModel (precision),
+                                      ddsp::PredictControlsModel::Engine::kTFLite)
+            ->Unit (benchmark::kMicrosecond);
+    }
+
+    for (const int numNotes : { 0, 1, 8 })
+    {
+        benchmark::RegisterBenchmark (("MidiInputProcessor/hop/notes:" + std::to_string (numNotes)).c_str(),
+                                      benchmarkMidiInputProcessor,
+                                      numNotes);
+    }
+
+    for (const int hopSize : kHopSizes)
+    {
+        benchmark::RegisterBenchmark (("InferencePipeline/render/hop:" + std::to_string (hopSize)).c_str(),
+                                      benchmarkInferencePipeline,
+                                      hopSize)
+            ->Unit (benchmark::kMicrosecond);
+    }
+}
+} // namespace
+
+int main (int argc, char** argv)
+{
+    registerBenchmarks();
+    benchmark::Initialize (&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments (argc, argv))
+    {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
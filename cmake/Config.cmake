@@ -64,7 +64,7 @@ if(APPLE)
     set(DDSP_COPY_PLUGIN TRUE)
 
     # XNNPACK is incompatible with Xcode, use it only during development.
-    # Build with CMake or Ninja for release.
+    # Build with CMake or Ninja for release. Without it DDSP_ENABLE_XNNPACK has no effect.
     if(CMAKE_GENERATOR STREQUAL "Xcode")
         option(TFLITE_ENABLE_XNNPACK "XNNPACK" OFF)
     endif()
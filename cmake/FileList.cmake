@@ -20,16 +20,27 @@ set(DDSP_SOURCES
     src/PluginEditor.cpp
 
     # audio
+    src/audio/ADSREnvelope.h
+    src/audio/ADSREnvelope.cpp
     src/audio/AudioRingBuffer.h
+    src/audio/AudioRingBuffer.cpp
+    src/audio/FeatureExtractor.h
+    src/audio/FractionalHopScheduler.h
+    src/audio/NativeFeatureExtractor.h
+    src/audio/NativeFeatureExtractor.cpp
     src/audio/MidiInputProcessor.h
     src/audio/MidiInputProcessor.cpp
     src/audio/HarmonicSynthesizer.h
     src/audio/HarmonicSynthesizer.cpp
     src/audio/NoiseSynthesizer.h
     src/audio/NoiseSynthesizer.cpp
+    src/audio/PolyphaseResampler.h
+    src/audio/PolyphaseResampler.cpp
 
     # tflite
     src/audio/tflite/ModelBase.h
+    src/audio/tflite/ModelDescription.h
+    src/audio/tflite/ModelDescription.cpp
     src/audio/tflite/ModelTypes.h
     src/audio/tflite/ModelLibrary.h
     src/audio/tflite/ModelLibrary.cpp
@@ -37,6 +48,14 @@ set(DDSP_SOURCES
     src/audio/tflite/FeatureExtractionModel.cpp
     src/audio/tflite/PredictControlsModel.h
     src/audio/tflite/PredictControlsModel.cpp
+    src/audio/tflite/ModelPool.h
+    src/audio/tflite/ModelPool.cpp
+    src/audio/tflite/NativeControlEngine.h
+    src/audio/tflite/NativeControlEngine.cpp
+    src/audio/tflite/TypedTensor.h
+    src/audio/tflite/TypedTensor.cpp
+    src/audio/tflite/XNNPackDelegate.h
+    src/audio/tflite/XNNPackDelegate.cpp
     src/audio/tflite/InferencePipeline.h
     src/audio/tflite/InferencePipeline.cpp
 
@@ -56,10 +75,22 @@ set(DDSP_SOURCES
     src/ui/BottomPanelComponent.cpp
     src/ui/ContentComponent.h
     src/ui/ContentComponent.cpp
+    src/ui/PerformanceOverlayComponent.h
+    src/ui/PerformanceOverlayComponent.cpp
 
     # util
     src/util/Constants.h
+    src/util/EventTracer.h
+    src/util/EventTracer.cpp
     src/util/InputUtils.h
+    src/util/MemoryArena.h
+    src/util/MemoryArena.cpp
+    src/util/RealtimeLogger.h
+    src/util/RealtimeLogger.cpp
+    src/util/RealtimeSanitizer.h
+    src/util/RealtimeSanitizer.cpp
+    src/util/StageProfiler.h
+    src/util/StageProfiler.cpp
 )
 
 set(DDSP_ASSETS
@@ -90,4 +121,9 @@ set(DDSP_ASSETS
 set(DDSP_TEST_SOURCES
 
     tests/InferencePipeline_Test.cpp
-)
\ No newline at end of file
+)
+
+set(DDSP_BENCHMARK_SOURCES
+
+    benchmarks/DDSPBenchmarks.cpp
+)
@@ -0,0 +1,342 @@
+# Copyright 2022 The DDSP-VST Authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Writes the small control model fixtures in assets/test_models.
+
+The fixtures have the I/O tensors of a DDSP control model, but only a few
+thousand weights, so they can be checked in. The same float weights are
+written in every precision the plugin supports:
+
+  control_float32.tflite       float32 weights and I/O
+  control_float16.tflite       float16 weights behind DEQUANTIZE, float32 I/O
+  control_dynamic_int8.tflite  int8 fully connected weights, float32 I/O
+  control_int8.tflite          int8 weights, activations and I/O
+
+The graph is
+
+  x = concat (f0, loudness)
+  state_out = tanh (fc (x) + decay * state)
+  harmonics, noise = sigmoid (fc (x))
+  amplitude = sigmoid (fc (state_out))
+
+so the amplitude also checks that the state is carried from hop to hop. The
+int8 ranges are calibrated on a random control sequence, as the TFLite
+converter does with a representative dataset. The flatbuffers are built
+directly against the TFLite schema, so only the flatbuffers and numpy
+packages are needed:
+
+  python3 scripts/make-test-models.py
+"""
+
+import os
+
+import flatbuffers
+import numpy as np
+
+OUTPUT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "assets", "test_models")
+
+NUM_HARMONICS = 60
+NUM_NOISE_AMPS = 65
+STATE_SIZE = 512
+
+# TFLite schema enums.
+FLOAT32, FLOAT16, INT32, INT8 = 0, 1, 2, 9
+ADD, CONCATENATION, DEQUANTIZE, FULLY_CONNECTED, LOGISTIC, MUL, TANH = 0, 2, 6, 9, 14, 18, 28
+FULLY_CONNECTED_OPTIONS, CONCATENATION_OPTIONS, ADD_OPTIONS, MUL_OPTIONS = 8, 10, 11, 21
+
+# Op versions of the TFLite converter for float, hybrid and int8 kernels.
+OP_VERSIONS = {
+    "float32": {},
+    "float16": {DEQUANTIZE: 3},
+    "dynamic_int8": {FULLY_CONNECTED: 3},
+    "int8": {ADD: 2, CONCATENATION: 2, FULLY_CONNECTED: 4, LOGISTIC: 2, MUL: 2, TANH: 2},
+}
+
+DTYPES = {FLOAT32: np.float32, FLOAT16: np.float16, INT32: np.int32, INT8: np.int8}
+
+
+class Tensor:
+    def __init__(self, name, shape, dtype, data=None, scale=None, zero_point=None):
+        self.name = name
+        self.shape = shape
+        self.dtype = dtype
+        self.data = data
+        self.scale = scale
+        self.zero_point = zero_point
+
+
+class Graph:
+    """Tensors and ops of one subgraph, serialized as a TFLite model."""
+
+    def __init__(self, precision):
+        self.precision = precision
+        self.tensors = []
+        self.ops = []
+        self.inputs = []
+        self.outputs = []
+
+    def add(self, tensor):
+        self.tensors.append(tensor)
+        return len(self.tensors) - 1
+
+    def op(self, code, inputs, outputs, options=None):
+        self.ops.append((code, inputs, outputs, options))
+
+    def serialize(self):
+        builder = flatbuffers.Builder(1024)
+        codes = sorted({op[0] for op in self.ops})
+
+        def vector(values, prepend, width):
+            builder.StartVector(width, len(values), width)
+            for value in reversed(values):
+                prepend(value)
+            return builder.EndVector()
+
+        def int_vector(values):
+            return vector(values, builder.PrependInt32, 4)
+
+        def table_vector(offsets):
+            return vector(offsets, builder.PrependUOffsetTRelative, 4)
+
+        # Buffer 0 is the empty buffer of every tensor without data.
+        buffers = []
+        tensor_buffers = []
+        for tensor in self.tensors:
+            if tensor.data is None:
+                tensor_buffers.append(0)
+                continue
+            raw = np.ascontiguousarray(tensor.data, dtype=DTYPES[tensor.dtype]).tobytes()
+            # 16 byte aligned, as TFLite maps the weights in place.
+            builder.StartVector(1, len(raw), 16)
+            for value in reversed(raw):
+                builder.PrependByte(value)
+            data = builder.EndVector()
+            builder.StartObject(3)
+            builder.PrependUOffsetTRelativeSlot(0, data, 0)
+            buffers.append(builder.EndObject())
+            tensor_buffers.append(len(buffers))
+        builder.StartObject(3)
+        empty_buffer = builder.EndObject()
+        buffers.insert(0, empty_buffer)
+
+        tensors = []
+        for tensor, buffer in zip(self.tensors, tensor_buffers):
+            name = builder.CreateString(tensor.name)
+            shape = int_vector(tensor.shape)
+            quantization = None
+            if tensor.scale is not None:
+                scale = vector([tensor.scale], builder.PrependFloat32, 4)
+                zero_point = vector([tensor.zero_point], builder.PrependInt64, 8)
+                builder.StartObject(7)
+                builder.PrependUOffsetTRelativeSlot(2, scale, 0)
+                builder.PrependUOffsetTRelativeSlot(3, zero_point, 0)
+                quantization = builder.EndObject()
+            builder.StartObject(9)
+            builder.PrependUOffsetTRelativeSlot(0, shape, 0)
+            builder.PrependInt8Slot(1, tensor.dtype, 0)
+            builder.PrependUint32Slot(2, buffer, 0)
+            builder.PrependUOffsetTRelativeSlot(3, name, 0)
+            if quantization is not None:
+                builder.PrependUOffsetTRelativeSlot(4, quantization, 0)
+            tensors.append(builder.EndObject())
+
+        operators = []
+        for code, inputs, outputs, options in self.ops:
+            options_type, options_table = 0, None
+            if options is not None:
+                options_type, fields = options
+                builder.StartObject(4)
+                for slot, value in fields:
+                    builder.PrependInt32Slot(slot, value, 0)
+                options_table = builder.EndObject()
+            op_inputs = int_vector(inputs)
+            op_outputs = int_vector(outputs)
+            builder.StartObject(9)
+            builder.PrependUint32Slot(0, codes.index(code), 0)
+            builder.PrependUOffsetTRelativeSlot(1, op_inputs, 0)
+            builder.PrependUOffsetTRelativeSlot(2, op_outputs, 0)
+            if options_table is not None:
+                builder.PrependUint8Slot(3, options_type, 0)
+                builder.PrependUOffsetTRelativeSlot(4, options_table, 0)
+            operators.append(builder.EndObject())
+
+        subgraph_tensors = table_vector(tensors)
+        subgraph_inputs = int_vector(self.inputs)
+        subgraph_outputs = int_vector(self.outputs)
+        subgraph_operators = table_vector(operators)
+        subgraph_name = builder.CreateString("main")
+        builder.StartObject(5)
+        builder.PrependUOffsetTRelativeSlot(0, subgraph_tensors, 0)
+        builder.PrependUOffsetTRelativeSlot(1, subgraph_inputs, 0)
+        builder.PrependUOffsetTRelativeSlot(2, subgraph_outputs, 0)
+        builder.PrependUOffsetTRelativeSlot(3, subgraph_operators, 0)
+        builder.PrependUOffsetTRelativeSlot(4, subgraph_name, 0)
+        subgraphs = table_vector([builder.EndObject()])
+
+        operator_codes = []
+        for code in codes:
+            builder.StartObject(4)
+            builder.PrependInt8Slot(0, code, 0)
+            builder.PrependInt32Slot(2, OP_VERSIONS[self.precision].get(code, 1), 1)
+            builder.PrependInt32Slot(3, code, 0)
+            operator_codes.append(builder.EndObject())
+        operator_codes = table_vector(operator_codes)
+        buffers = table_vector(buffers)
+        description = builder.CreateString("DDSP control model test fixture, " + self.precision)
+
+        builder.StartObject(8)
+        builder.PrependUint32Slot(0, 3, 0)
+        builder.PrependUOffsetTRelativeSlot(1, operator_codes, 0)
+        builder.PrependUOffsetTRelativeSlot(2, subgraphs, 0)
+        builder.PrependUOffsetTRelativeSlot(3, description, 0)
+        builder.PrependUOffsetTRelativeSlot(4, buffers, 0)
+        builder.Finish(builder.EndObject(), file_identifier=b"TFL3")
+        return bytes(builder.Output())
+
+
+def make_weights():
+    rng = np.random.default_rng(20220101)
+    weights = {}
+    for name, rows in ("harmonics", NUM_HARMONICS), ("noise", NUM_NOISE_AMPS), ("state", STATE_SIZE):
+        weights[name] = (rng.uniform(-2.0, 2.0, (rows, 2)).astype(np.float32),
+                         rng.uniform(-1.0, 1.0, rows).astype(np.float32))
+    weights["amplitude"] = (rng.uniform(-0.1, 0.1, (1, STATE_SIZE)).astype(np.float32),
+                            rng.uniform(-1.0, 1.0, 1).astype(np.float32))
+    weights["decay"] = rng.uniform(0.2, 0.6, STATE_SIZE).astype(np.float32)
+    return weights
+
+
+def calibrate(weights, num_hops=1000):
+    """Range of every activation over a random control sequence, run in float."""
+    rng = np.random.default_rng(7)
+    ranges = {}
+
+    def observe(name, values):
+        low, high = ranges.get(name, (np.inf, -np.inf))
+        ranges[name] = (min(low, float(values.min())), max(high, float(values.max())))
+        return values
+
+    state = np.zeros(STATE_SIZE, np.float32)
+    for _ in range(num_hops):
+        x = rng.uniform(0.0, 1.0, 2).astype(np.float32)
+        for name in ("harmonics", "noise"):
+            observe(name + "/dense", weights[name][0] @ x + weights[name][1])
+        projected = observe("state/dense", weights["state"][0] @ x + weights["state"][1])
+        decayed = observe("state/mul", weights["decay"] * state)
+        state = np.tanh(observe("state/add", projected + decayed))
+        observe("amplitude/dense", weights["amplitude"][0] @ state + weights["amplitude"][1])
+    return ranges
+
+
+def asymmetric(low, high):
+    """int8 scale and zero point covering [low, high] and zero."""
+    low, high = min(low, 0.0), max(high, 0.0)
+    scale = (high - low) / 255.0
+    return float(scale), int(np.clip(np.round(-128.0 - low / scale), -128, 127))
+
+
+def symmetric(values):
+    scale = float(np.max(np.abs(values))) / 127.0
+    return scale, np.clip(np.round(values / scale), -127, 127).astype(np.int8)
+
+
+def build(precision):
+    weights = make_weights()
+    ranges = calibrate(weights)
+    graph = Graph(precision)
+    quantized = precision == "int8"
+
+    def activation(name, shape, fixed=None):
+        if not quantized:
+            return graph.add(Tensor(name, shape, FLOAT32))
+        scale, zero_point = fixed if fixed is not None else asymmetric(*ranges[name])
+        return graph.add(Tensor(name, shape, INT8, scale=scale, zero_point=zero_point))
+
+    def constant(name, values):
+        if precision == "float16":
+            half = graph.add(Tensor(name, list(values.shape), FLOAT16, values.astype(np.float16)))
+            dequantized = graph.add(Tensor(name + "_dequantize", list(values.shape), FLOAT32))
+            graph.op(DEQUANTIZE, [half], [dequantized])
+            return dequantized
+        return graph.add(Tensor(name, list(values.shape), FLOAT32, values))
+
+    def fully_connected(name, x, x_scale):
+        kernel, bias = weights[name]
+        output = activation(name + "/dense", [1, len(bias)])
+        if quantized:
+            w_scale, w = symmetric(kernel)
+            b = np.round(bias / (x_scale * w_scale)).astype(np.int32)
+            w_index = graph.add(Tensor(name + "/weights", list(w.shape), INT8, w, w_scale, 0))
+            b_index = graph.add(Tensor(name + "/bias", [len(b)], INT32, b, x_scale * w_scale, 0))
+        elif precision == "dynamic_int8":
+            w_scale, w = symmetric(kernel)
+            w_index = graph.add(Tensor(name + "/weights", list(w.shape), INT8, w, w_scale, 0))
+            b_index = graph.add(Tensor(name + "/bias", [len(bias)], FLOAT32, bias))
+        else:
+            w_index = constant(name + "/weights", kernel)
+            b_index = constant(name + "/bias", bias)
+        graph.op(FULLY_CONNECTED, [x, w_index, b_index], [output], (FULLY_CONNECTED_OPTIONS, []))
+        return output
+
+    def sigmoid(logits, name, size):
+        output = activation(name, [1, size], fixed=(1.0 / 256.0, -128))
+        graph.op(LOGISTIC, [logits], [output])
+        return output
+
+    unit = (1.0 / 255.0, -128)
+    f0 = activation("call_f0_scaled:0", [1, 1], fixed=unit)
+    loudness = activation("call_pw_scaled:0", [1, 1], fixed=unit)
+    # tanh's int8 output encoding, the state input shares it so the state can be fed back as is.
+    state_encoding = (1.0 / 128.0, 0)
+    state = activation("call_state:0", [1, STATE_SIZE], fixed=state_encoding)
+    graph.inputs = [f0, loudness, state]
+
+    x = activation("concat", [1, 2], fixed=unit)
+    graph.op(CONCATENATION, [f0, loudness], [x], (CONCATENATION_OPTIONS, [(0, 1)]))
+
+    projected = fully_connected("state", x, unit[0])
+    if quantized:
+        d_scale, d = symmetric(weights["decay"])
+        decay = graph.add(Tensor("state/decay", [STATE_SIZE], INT8, d, d_scale, 0))
+    else:
+        decay = constant("state/decay", weights["decay"])
+    decayed = activation("state/mul", [1, STATE_SIZE])
+    graph.op(MUL, [state, decay], [decayed], (MUL_OPTIONS, []))
+    summed = activation("state/add", [1, STATE_SIZE])
+    graph.op(ADD, [projected, decayed], [summed], (ADD_OPTIONS, []))
+    new_state = activation("StatefulPartitionedCall:3", [1, STATE_SIZE], fixed=state_encoding)
+    graph.op(TANH, [summed], [new_state])
+
+    harmonics = fully_connected("harmonics", x, unit[0])
+    harmonics = sigmoid(harmonics, "StatefulPartitionedCall:1", NUM_HARMONICS)
+    noise = fully_connected("noise", x, unit[0])
+    noise = sigmoid(noise, "StatefulPartitionedCall:2", NUM_NOISE_AMPS)
+    amplitude = fully_connected("amplitude", new_state, state_encoding[0])
+    amplitude = sigmoid(amplitude, "StatefulPartitionedCall:0", 1)
+
+    graph.outputs = [amplitude, harmonics, noise, new_state]
+    return graph.serialize()
+
+
+def main():
+    os.makedirs(OUTPUT_DIR, exist_ok=True)
+    for precision in OP_VERSIONS:
+        path = os.path.join(OUTPUT_DIR, "control_%s.tflite" % precision)
+        with open(path, "wb") as f:
+            f.write(build(precision))
+        print("Wrote", os.path.normpath(path))
+
+
+if __name__ == "__main__":
+    main()
@@ -18,6 +18,7 @@ limitations under the License.
 #include "PluginEditor.h"
 #include "ui/ParamInfo.h"
 #include "util/InputUtils.h"
+#include "util/RealtimeSanitizer.h"
 
 using namespace ddsp;
 
@@ -37,10 +38,20 @@ DDSPAudioProcessor::DDSPAudioProcessor (bool st)
       tree (*this, nullptr, "PARAMETERS", createParameterLayout()),
       ddspPipeline (tree)
 {
+    outputGain = tree.getRawParameterValue ("OutputGain");
+    reverbSize = tree.getRawParameterValue ("ReverbSize");
+    reverbDamping = tree.getRawParameterValue ("ReverbDamping");
+    reverbWet = tree.getRawParameterValue ("ReverbWet");
+
     ddspPipeline.reset();
+    tree.addParameterListener ("ModelSlot", this);
 }
 
-DDSPAudioProcessor::~DDSPAudioProcessor() {}
+DDSPAudioProcessor::~DDSPAudioProcessor()
+{
+    tree.removeParameterListener ("ModelSlot", this);
+    cancelPendingUpdate();
+}
 
 //==============================================================================
 const juce::String DDSPAudioProcessor::getName() const { return JucePlugin_Name; }
@@ -91,13 +102,13 @@ void DDSPAudioProcessor::changeProgramName (int index, const juce::String& newNa
 //==============================================================================
 void DDSPAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // The pitch detection model needs a full 64ms frame to get an accurate reading.
-    // Therefore the pulgin latency is set to 64ms.
-    setLatencySamples ((kTotalInferenceLatency_ms / 1000.0f) * sampleRate);
-
     reverb.setSampleRate (sampleRate);
 
-    ddspPipeline.prepareToPlay (sampleRate, samplesPerBlock);
+    ddspPipeline.prepareToPlay (sampleRate, samplesPerBlock, singleThreaded || isNonRealtime());
+
+    // The effect waits for the pitch detection frame, the synth about one hop. Both follow
+    // the hop size and add the group delay of the resampling filters.
+    setLatencySamples (ddspPipeline.getLatencySamples());
 
     if (isNonRealtime())
     {
@@ -112,7 +123,7 @@ void DDSPAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 
     if (! singleThreaded)
     {
-        ddspPipeline.startTimer (kModelInferenceTimerCallbackInterval_ms);
+        ddspPipeline.startTimer (ddspPipeline.getRenderInterval_ms());
     }
 }
 
@@ -154,6 +165,10 @@ bool DDSPAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) con
 
 void DDSPAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    const ddsp::RealtimeScope realtimeScope ("audio");
+    tracer->nameCurrentThread ("audio");
+    const ddsp::EventTracer::ScopedTrace trace (*tracer, "processBlock", ddspPipeline.getTraceInstance());
+
     if (! modelLoaded)
     {
         buffer.clear();
@@ -169,20 +184,21 @@ void DDSPAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::M
         buffer.addFrom (0, 0, buffer, 1, 0, buffer.getNumSamples());
     }
 
-    // Enqueue input.
-    ddspPipeline.processBlock (buffer, midiMessages);
-    buffer.clear();
-
     // Synchronous model inference block.
     if (singleThreaded || isNonRealtime())
     {
         // We have to stop the timer here and not in PrepareToPlay so it will block the
         // Audio thread until it is done with the last timer callback.
         ddspPipeline.stopTimer();
-        ddspPipeline.render();
+        ddspPipeline.processBlockSynchronously (buffer, midiMessages);
+    }
+    else
+    {
+        // Enqueue input.
+        ddspPipeline.processBlock (buffer, midiMessages);
+        buffer.clear();
+        ddspPipeline.getNextBlock (buffer);
     }
-
-    ddspPipeline.getNextBlock (buffer);
 
     // Convert to stereo.
     if (buffer.getNumChannels() > 1)
@@ -192,16 +208,15 @@ void DDSPAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::M
 
     // Post-processing: modify output gain + add reverb.
     {
-        const float outputGain = *tree.getRawParameterValue ("OutputGain");
         // Apply overall gain.
-        buffer.applyGain (juce::Decibels::decibelsToGain (outputGain));
+        buffer.applyGain (juce::Decibels::decibelsToGain (outputGain->load()));
 
         if (kEnableReverb)
         {
             juce::Reverb::Parameters reverbParams;
-            reverbParams.roomSize = *tree.getRawParameterValue ("ReverbSize");
-            reverbParams.damping = *tree.getRawParameterValue ("ReverbDamping");
-            reverbParams.wetLevel = *tree.getRawParameterValue ("ReverbWet");
+            reverbParams.roomSize = *reverbSize;
+            reverbParams.damping = *reverbDamping;
+            reverbParams.wetLevel = *reverbWet;
             reverbParams.dryLevel = 1.0f;
             reverb.setParameters (reverbParams);
 
@@ -280,6 +295,37 @@ void DDSPAudioProcessor::loadModel (int modelIdx)
     ddspPipeline.loadModel (modelLibrary.getModelList()[modelIdx]);
     currentModel = modelIdx;
     modelLoaded = true;
+
+    // Keep the automatable slot in sync with loads coming from the UI or the saved state.
+    auto* slotParam = tree.getParameter ("ModelSlot");
+    if (modelIdx < kNumModelSlots && static_cast<int> (*tree.getRawParameterValue ("ModelSlot")) != modelIdx)
+    {
+        slotParam->setValueNotifyingHost (slotParam->convertTo0to1 (static_cast<float> (modelIdx)));
+    }
+    // Supersedes a slot change still queued for handleAsyncUpdate(). Restoring a state queues
+    // the saved slot before the saved model is loaded, and for a model beyond the slots that
+    // stale slot would otherwise replace it.
+    requestedModelSlot.store (modelIdx);
+}
+
+void DDSPAudioProcessor::setModelHopSize (int hopSize) { ddspPipeline.setModelHopSize (hopSize); }
+
+void DDSPAudioProcessor::parameterChanged (const juce::String& parameterID, float newValue)
+{
+    if (parameterID == "ModelSlot")
+    {
+        requestedModelSlot.store (static_cast<int> (newValue));
+        triggerAsyncUpdate();
+    }
+}
+
+void DDSPAudioProcessor::handleAsyncUpdate()
+{
+    const int slot = requestedModelSlot.load();
+    if (slot != currentModel && slot < static_cast<int> (modelLibrary.getModelList().size()))
+    {
+        loadModel (slot);
+    }
 }
 
 // ----------------------------------------- GETTER METHODS ----------------------------------------
@@ -290,6 +336,35 @@ float DDSPAudioProcessor::getRMS() const { return ddspPipeline.getRMS(); }
 
 float DDSPAudioProcessor::getPitch() const { return ddspPipeline.getPitch(); }
 
+ddsp::InferencePipeline::MemoryReport DDSPAudioProcessor::getMemoryReport() { return ddspPipeline.getMemoryReport(); }
+
+void DDSPAudioProcessor::setProfilingEnabled (bool shouldBeEnabled)
+{
+    ddspPipeline.setProfilingEnabled (shouldBeEnabled);
+}
+
+bool DDSPAudioProcessor::isProfilingEnabled() const { return ddspPipeline.isProfilingEnabled(); }
+
+ddsp::StageProfiler::Report DDSPAudioProcessor::getRenderTimings() const { return ddspPipeline.getRenderTimings(); }
+
+std::vector<ddsp::ModelDescription> DDSPAudioProcessor::describeModels (int numProfiledInvocations)
+{
+    std::vector<ddsp::ModelDescription> descriptions;
+    if (! JucePlugin_IsSynth)
+    {
+        FeatureExtractionModel model;
+        descriptions.push_back (model.describe (numProfiledInvocations));
+        descriptions.back().name = "Pitch detection";
+    }
+    for (const auto& mi : modelLibrary.getModelList())
+    {
+        PredictControlsModel model (mi);
+        descriptions.push_back (model.describe (numProfiledInvocations));
+        descriptions.back().name = mi.name;
+    }
+    return descriptions;
+}
+
 float DDSPAudioProcessor::getPitchOffset() const { return *tree.getRawParameterValue ("InputPitch"); }
 
 float DDSPAudioProcessor::getLoudnessOffset() const { return *tree.getRawParameterValue ("InputGain"); }
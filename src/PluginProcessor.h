@@ -23,7 +23,9 @@ limitations under the License.
 //==============================================================================
 /**
 */
-class DDSPAudioProcessor : public juce::AudioProcessor
+class DDSPAudioProcessor : public juce::AudioProcessor,
+                           private juce::AudioProcessorValueTreeState::Listener,
+                           private juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -64,6 +66,9 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     void loadModel (int modelIdx);
+    // Control rate of the pipeline, see InferencePipeline::setModelHopSize(). The new hop and
+    // latency take effect when the host next calls prepareToPlay().
+    void setModelHopSize (int hopSize);
 
     // Getters.
     int getCurrentModel() const;
@@ -74,17 +79,37 @@ public:
     const ddsp::PredictControlsModel::Metadata getPredictControlsModelMetadata() const;
     juce::AudioProcessorValueTreeState& getValueTree();
     ddsp::ModelLibrary& getModelLibrary();
+    // Memory owned by this instance. Call it off the audio thread.
+    ddsp::InferencePipeline::MemoryReport getMemoryReport();
+    // Per-stage render timings, see ddsp::StageProfiler. Only recorded while profiling is enabled.
+    void setProfilingEnabled (bool shouldBeEnabled);
+    bool isProfilingEnabled() const;
+    ddsp::StageProfiler::Report getRenderTimings() const;
+    // Describes the effect's pitch detection model and every model in the library, each built
+    // apart from the pipeline, see ddsp::ModelBase::describe(). Slow, call it off the audio thread.
+    std::vector<ddsp::ModelDescription> describeModels (int numProfiledInvocations);
 
 private:
+    // Model slot automation arrives on the audio thread, the switch is done on the message thread.
+    void parameterChanged (const juce::String& parameterID, float newValue) override;
+    void handleAsyncUpdate() override;
+
     bool singleThreaded = false;
     bool modelLoaded = false;
     int currentModel = 0;
+    std::atomic<int> requestedModelSlot = { 0 };
 
     // Param state.
     juce::AudioProcessorValueTreeState tree;
+    // Post-processing parameters, resolved once for the audio thread.
+    std::atomic<float>* outputGain = nullptr;
+    std::atomic<float>* reverbSize = nullptr;
+    std::atomic<float>* reverbDamping = nullptr;
+    std::atomic<float>* reverbWet = nullptr;
 
     ddsp::ModelLibrary modelLibrary;
     ddsp::InferencePipeline ddspPipeline;
+    juce::SharedResourcePointer<ddsp::EventTracer> tracer;
     juce::Reverb reverb;
 
     //==============================================================================
@@ -0,0 +1,218 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+juce::ADSR moves the envelope by a fixed rate per sample and switches state
+on the sample where it reaches or passes the segment's target, which it
+outputs clamped. From a value v with rate r that sample is the k-th one with
+k = ceil(distance / r), so a segment is k - 1 ramp samples v + i * r plus
+one sample at the target. Sums over a ramp follow from the arithmetic series.
+*/
+
+#include "audio/ADSREnvelope.h"
+
+namespace ddsp
+{
+
+namespace
+{
+    // Samples until a ramp at rate covers distance, including the sample that reaches it.
+    int64_t getNumSamplesToTarget (float distance, float rate)
+    {
+        if (distance <= 0.0f || rate <= 0.0f)
+        {
+            return 1;
+        }
+        return std::max<int64_t> (1, static_cast<int64_t> (std::ceil (static_cast<double> (distance) / rate)));
+    }
+} // namespace
+
+void ADSREnvelope::setSampleRate (double newSampleRate)
+{
+    jassert (newSampleRate > 0.0);
+    sampleRate = newSampleRate;
+    recalculateRates();
+}
+
+void ADSREnvelope::setParameters (const juce::ADSR::Parameters& newParameters)
+{
+    // Same constraints as juce::ADSR.
+    jassert (newParameters.attack >= 0.0f && newParameters.decay >= 0.0f && newParameters.release >= 0.0f
+             && newParameters.sustain >= 0.0f && newParameters.sustain <= 1.0f);
+    parameters = newParameters;
+    recalculateRates();
+}
+
+void ADSREnvelope::noteOn()
+{
+    if (attackRate > 0.0f)
+    {
+        state = State::attack;
+    }
+    else if (decayRate > 0.0f)
+    {
+        envelopeVal = 1.0f;
+        state = State::decay;
+    }
+    else
+    {
+        envelopeVal = parameters.sustain;
+        state = State::sustain;
+    }
+}
+
+void ADSREnvelope::noteOff()
+{
+    if (state != State::idle)
+    {
+        if (parameters.release > 0.0f)
+        {
+            releaseRate = static_cast<float> (envelopeVal / (parameters.release * sampleRate));
+            state = State::release;
+        }
+        else
+        {
+            reset();
+        }
+    }
+}
+
+void ADSREnvelope::reset()
+{
+    envelopeVal = 0.0f;
+    state = State::idle;
+}
+
+void ADSREnvelope::recalculateRates()
+{
+    auto getRate = [this] (float distance, float timeInSeconds)
+    { return timeInSeconds > 0.0f ? static_cast<float> (distance / (timeInSeconds * sampleRate)) : -1.0f; };
+
+    attackRate = getRate (1.0f, parameters.attack);
+    decayRate = getRate (1.0f - parameters.sustain, parameters.decay);
+    releaseRate = getRate (parameters.sustain, parameters.release);
+
+    if ((state == State::attack && attackRate <= 0.0f)
+        || (state == State::decay && (decayRate <= 0.0f || envelopeVal <= parameters.sustain))
+        || (state == State::release && releaseRate <= 0.0f))
+    {
+        goToNextState();
+    }
+}
+
+void ADSREnvelope::goToNextState()
+{
+    if (state == State::attack)
+    {
+        state = decayRate > 0.0f ? State::decay : State::sustain;
+    }
+    else if (state == State::decay)
+    {
+        state = State::sustain;
+    }
+    else if (state == State::release)
+    {
+        reset();
+    }
+}
+
+template <typename SegmentFn>
+void ADSREnvelope::processSegments (int numSamples, SegmentFn&& segmentFn)
+{
+    while (numSamples > 0)
+    {
+        if (state == State::idle || state == State::sustain)
+        {
+            envelopeVal = state == State::idle ? 0.0f : parameters.sustain;
+            segmentFn (envelopeVal, 0.0f, numSamples);
+            return;
+        }
+
+        // Ramp towards the segment's target, which is then output clamped.
+        float step, target;
+        if (state == State::attack)
+        {
+            step = attackRate;
+            target = 1.0f;
+        }
+        else if (state == State::decay)
+        {
+            step = -decayRate;
+            target = parameters.sustain;
+        }
+        else
+        {
+            step = -releaseRate;
+            target = 0.0f;
+        }
+
+        const int64_t numToTarget = getNumSamplesToTarget (std::abs (target - envelopeVal), std::abs (step));
+        const auto numRamp = static_cast<int> (std::min<int64_t> (numSamples, numToTarget - 1));
+        if (numRamp > 0)
+        {
+            segmentFn (envelopeVal + step, step, numRamp);
+            envelopeVal += numRamp * step;
+            numSamples -= numRamp;
+        }
+
+        if (numSamples > 0)
+        {
+            envelopeVal = target;
+            goToNextState();
+            segmentFn (envelopeVal, 0.0f, 1);
+            --numSamples;
+        }
+    }
+}
+
+float ADSREnvelope::advance (int numSamples)
+{
+    double sum = 0.0;
+    processSegments (numSamples,
+                     [&sum] (float firstValue, float step, int count)
+                     { sum += count * (firstValue + 0.5 * step * (count - 1)); });
+    return static_cast<float> (sum);
+}
+
+void ADSREnvelope::render (float* output, int numSamples)
+{
+    processSegments (numSamples,
+                     [&output] (float firstValue, float step, int count)
+                     {
+                         if (step == 0.0f)
+                         {
+                             juce::FloatVectorOperations::fill (output, firstValue, count);
+                         }
+                         else
+                         {
+                             // Independent per sample, so the compiler can vectorize it.
+                             for (int i = 0; i < count; ++i)
+                             {
+                                 output[i] = firstValue + static_cast<float> (i) * step;
+                             }
+                         }
+                         output += count;
+                     });
+}
+
+float ADSREnvelope::getNextSample()
+{
+    float value;
+    render (&value, 1);
+    return value;
+}
+
+} // namespace ddsp
@@ -0,0 +1,73 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace ddsp
+{
+
+// Linear ADSR with the same segments, rates and state transitions as juce::ADSR, but
+// advanced a whole run of samples at a time. Each segment is a straight line, so skipping
+// over it costs the same whatever its length, and rendering it has no sample-to-sample
+// dependency. Idle and sustain output exactly what juce::ADSR does, and the ramps agree
+// up to float rounding because they are evaluated rather than accumulated.
+class ADSREnvelope
+{
+public:
+    void setSampleRate (double newSampleRate);
+    void setParameters (const juce::ADSR::Parameters& newParameters);
+    const juce::ADSR::Parameters& getParameters() const { return parameters; }
+
+    void noteOn();
+    void noteOff();
+    void reset();
+
+    bool isActive() const { return state != State::idle; }
+    float getValue() const { return envelopeVal; }
+
+    // Skips numSamples ahead and returns the sum of the samples that were skipped.
+    float advance (int numSamples);
+    // Writes the next numSamples envelope values.
+    void render (float* output, int numSamples);
+    float getNextSample();
+
+private:
+    enum class State
+    {
+        idle,
+        attack,
+        decay,
+        sustain,
+        release
+    };
+
+    void recalculateRates();
+    void goToNextState();
+
+    // Splits the next numSamples into linear runs and passes each to segmentFn as
+    // (firstValue, step, numRunSamples), where sample i of the run is firstValue + i * step.
+    template <typename SegmentFn>
+    void processSegments (int numSamples, SegmentFn&& segmentFn);
+
+    State state = State::idle;
+    juce::ADSR::Parameters parameters;
+    double sampleRate = 44100.0;
+    float envelopeVal = 0.0f, attackRate = 0.0f, decayRate = 0.0f, releaseRate = 0.0f;
+};
+
+} // namespace ddsp
@@ -0,0 +1,263 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+Each channel occupies two adjacent virtual regions of the same size. With
+mirroring, both regions are mappings of the same memfd pages, so a write
+to one is visible in the other and the read window [start, start + n) can
+always be addressed linearly for n up to the capacity. The whole reservation
+is made PROT_NONE first so the fixed mappings cannot collide with anything.
+
+Without mirroring each write goes to both regions, which costs a second copy
+per write but keeps the contiguous read views.
+*/
+
+#include "audio/AudioRingBuffer.h"
+#include "util/Constants.h"
+
+#if JUCE_LINUX
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+namespace ddsp
+{
+
+AudioRingBuffer::AudioRingBuffer() : AbstractFifo (1) {}
+
+AudioRingBuffer::~AudioRingBuffer() { release(); }
+
+void AudioRingBuffer::prepare (int numChannels, int minCapacity, bool lockPages)
+{
+    jassert (numChannels > 0 && minCapacity > 0);
+    release();
+
+    // Mirrored regions must start on page boundaries.
+    const auto floatsPerPage = static_cast<int> (juce::SystemStats::getPageSize() / sizeof (float));
+    capacity = (minCapacity + floatsPerPage - 1) / floatsPerPage * floatsPerPage;
+    const size_t regionBytes = sizeof (float) * static_cast<size_t> (capacity);
+
+    channels.resize (static_cast<size_t> (numChannels));
+    if (! mapMirrored (numChannels, regionBytes))
+    {
+        fallbackStorage.allocate (2 * static_cast<size_t> (capacity) * numChannels, true);
+        for (int ch = 0; ch < numChannels; ++ch)
+        {
+            channels[ch] = fallbackStorage.get() + 2 * static_cast<size_t> (capacity) * ch;
+        }
+    }
+
+    setTotalSize (capacity);
+    // Writes every page, so the first pushes do not fault.
+    clear();
+
+#if JUCE_LINUX
+    if (lockPages)
+    {
+        locked = isMirrored() ? mlock (mirroredBase, mirroredBytes) == 0
+                              : mlock (fallbackStorage.get(), getMemoryFootprint()) == 0;
+    }
+#else
+    juce::ignoreUnused (lockPages);
+#endif
+}
+
+int AudioRingBuffer::getCapacityFor (double sampleRate, int samplesPerBlock, int hopSize)
+{
+    // A hop can be waiting for its last samples when a whole host block arrives, and the
+    // render thread may fall behind by its scheduling headroom before it catches up.
+    return samplesPerBlock + 2 * hopSize + static_cast<int> (std::ceil (sampleRate * kRingBufferHeadroom_ms / 1000.0));
+}
+
+bool AudioRingBuffer::mapMirrored (int numChannels, size_t regionBytes)
+{
+#if JUCE_LINUX
+    const size_t totalBytes = regionBytes * numChannels;
+
+    const int fd = memfd_create ("ddsp-ring-buffer", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (ftruncate (fd, static_cast<off_t> (totalBytes)) != 0)
+    {
+        close (fd);
+        return false;
+    }
+
+    void* base = mmap (nullptr, 2 * totalBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+    {
+        close (fd);
+        return false;
+    }
+
+    bool mapped = true;
+    for (int ch = 0; ch < numChannels && mapped; ++ch)
+    {
+        auto* region = static_cast<char*> (base) + 2 * regionBytes * ch;
+        const auto offset = static_cast<off_t> (regionBytes * ch);
+        for (auto* view : { region, region + regionBytes })
+        {
+            mapped = mapped
+                     && mmap (view, regionBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset)
+                            != MAP_FAILED;
+        }
+        channels[ch] = reinterpret_cast<float*> (region);
+    }
+    // The mappings keep the memory alive.
+    close (fd);
+
+    if (! mapped)
+    {
+        munmap (base, 2 * totalBytes);
+        return false;
+    }
+
+    mirroredBase = base;
+    mirroredBytes = 2 * totalBytes;
+    return true;
+#else
+    juce::ignoreUnused (numChannels, regionBytes);
+    return false;
+#endif
+}
+
+void AudioRingBuffer::release()
+{
+#if JUCE_LINUX
+    if (locked && mirroredBase == nullptr)
+    {
+        munlock (fallbackStorage.get(), getMemoryFootprint());
+    }
+    if (mirroredBase != nullptr)
+    {
+        // Unmapping also unlocks.
+        munmap (mirroredBase, mirroredBytes);
+    }
+#endif
+    locked = false;
+    mirroredBase = nullptr;
+    mirroredBytes = 0;
+    fallbackStorage.free();
+    channels.clear();
+    capacity = 0;
+}
+
+void AudioRingBuffer::write (int channel, int start, const float* samples, int numSamples)
+{
+    juce::FloatVectorOperations::copy (channels[channel] + start, samples, numSamples);
+    if (! isMirrored())
+    {
+        juce::FloatVectorOperations::copy (channels[channel] + capacity + start, samples, numSamples);
+    }
+}
+
+void AudioRingBuffer::push (const juce::AudioBuffer<float>& bufferToAdd)
+{
+    int start1, size1, start2, size2;
+    prepareToWrite (bufferToAdd.getNumSamples(), start1, size1, start2, size2);
+    for (int ch = 0; ch < getNumChannels(); ++ch)
+    {
+        const float* samples = bufferToAdd.getReadPointer (std::min (ch, bufferToAdd.getNumChannels() - 1));
+        if (size1 > 0)
+        {
+            write (ch, start1, samples, size1);
+        }
+        if (size2 > 0)
+        {
+            write (ch, start2, samples + size1, size2);
+        }
+    }
+    finishedWrite (size1 + size2);
+}
+
+void AudioRingBuffer::push (const float* samples, int numSamples)
+{
+    jassert (getNumChannels() == 1);
+    int start1, size1, start2, size2;
+    prepareToWrite (numSamples, start1, size1, start2, size2);
+    if (size1 > 0)
+    {
+        write (0, start1, samples, size1);
+    }
+    if (size2 > 0)
+    {
+        write (0, start2, samples + size1, size2);
+    }
+    finishedWrite (size1 + size2);
+}
+
+void AudioRingBuffer::pushSilence (int numSamples)
+{
+    int start1, size1, start2, size2;
+    prepareToWrite (numSamples, start1, size1, start2, size2);
+    for (int ch = 0; ch < getNumChannels(); ++ch)
+    {
+        for (const auto& [start, size] : { std::pair { start1, size1 }, std::pair { start2, size2 } })
+        {
+            juce::FloatVectorOperations::clear (channels[ch] + start, size);
+            if (! isMirrored())
+            {
+                juce::FloatVectorOperations::clear (channels[ch] + capacity + start, size);
+            }
+        }
+    }
+    finishedWrite (size1 + size2);
+}
+
+void AudioRingBuffer::pop (int numSamples)
+{
+    int start1, size1, start2, size2;
+    prepareToRead (numSamples, start1, size1, start2, size2);
+    finishedRead (size1 + size2);
+}
+
+void AudioRingBuffer::copy (juce::AudioBuffer<float>& bufferToFill)
+{
+    const int numSamples = std::min (bufferToFill.getNumSamples(), getNumReady());
+    const int numChannels = std::min (bufferToFill.getNumChannels(), getNumChannels());
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        bufferToFill.copyFrom (ch, 0, getReadPointer (ch, numSamples), numSamples);
+    }
+}
+
+void AudioRingBuffer::copy (float* destination, int numSamples)
+{
+    numSamples = std::min (numSamples, getNumReady());
+    juce::FloatVectorOperations::copy (destination, getReadPointer (0, numSamples), numSamples);
+}
+
+const float* AudioRingBuffer::getReadPointer (int channel, int numSamples) const
+{
+    jassert (numSamples <= getNumReady());
+    juce::ignoreUnused (numSamples);
+    int start1, size1, start2, size2;
+    prepareToRead (0, start1, size1, start2, size2);
+    return channels[channel] + start1;
+}
+
+void AudioRingBuffer::clear()
+{
+    reset();
+    for (auto* channel : channels)
+    {
+        std::fill (channel, channel + 2 * capacity, 0.0f);
+    }
+}
+
+} // namespace ddsp
@@ -21,56 +21,68 @@ limitations under the License.
 namespace ddsp
 {
 
+// Multi-channel FIFO whose storage is followed by a mirror of itself, so any run of readable
+// samples is one contiguous block of memory even when it wraps around the end of the ring.
+// On Linux the mirror maps the same physical pages a second time. Elsewhere, or if mapping
+// fails, every write is stored twice instead.
 class AudioRingBuffer : public juce::AbstractFifo
 {
 public:
-    AudioRingBuffer (int bufferSize) : AbstractFifo (bufferSize) { buffer.setSize (1, bufferSize); }
-    // Copies the incoming buffer into the ring buffer.
-    void push (const juce::AudioBuffer<float>& bufferToAdd)
-    {
-        int start1, size1, start2, size2;
-        prepareToWrite (bufferToAdd.getNumSamples(), start1, size1, start2, size2);
-        if (size1 > 0)
-        {
-            buffer.copyFrom (0, start1, bufferToAdd.getReadPointer (0), size1);
-        }
-        if (size2 > 0)
-        {
-            buffer.copyFrom (0, start2, bufferToAdd.getReadPointer (0, size1), size2);
-        }
-        finishedWrite (size1 + size2);
-    }
+    AudioRingBuffer();
+    ~AudioRingBuffer();
+
+    // Allocates room for at least minCapacity samples per channel, rounded up to whole pages.
+    // Discards the contents. The storage is pre-faulted, and kept resident with mlock() if
+    // lockPages is set and the limit allows. Not real-time safe.
+    void prepare (int numChannels, int minCapacity, bool lockPages = false);
+
+    // Returns a capacity that fits a host block and a hop, plus headroom for the render thread.
+    static int getCapacityFor (double sampleRate, int samplesPerBlock, int hopSize);
+
+    // Copies the incoming buffer into the ring buffer. Channels beyond those of
+    // bufferToAdd repeat its last channel.
+    void push (const juce::AudioBuffer<float>& bufferToAdd);
+    // Mono push into channel 0.
+    void push (const float* samples, int numSamples);
+    // Pushes numSamples zeros into every channel.
+    void pushSilence (int numSamples);
     // Advances the read pointer by numSamples. Does not clear the samples or return them.
-    void pop (int numSamples)
-    {
-        int start1, size1, start2, size2;
-        prepareToRead (numSamples, start1, size1, start2, size2);
-        finishedRead (size1 + size2);
-    }
-    // Copies the front of the buffer into bufferToFill.
-    void copy (juce::AudioBuffer<float>& bufferToFill)
-    {
-        int start1, size1, start2, size2;
-        prepareToRead (bufferToFill.getNumSamples(), start1, size1, start2, size2);
-        if (size1 > 0)
-        {
-            bufferToFill.copyFrom (0, 0, buffer.getReadPointer (0, start1), size1);
-        }
-        if (size2 > 0)
-        {
-            bufferToFill.copyFrom (0, size1, buffer.getReadPointer (0, start2), size2);
-        }
-    }
+    void pop (int numSamples);
+    // Copies the front of the buffer into the matching channels of bufferToFill.
+    void copy (juce::AudioBuffer<float>& bufferToFill);
+    void copy (float* destination, int numSamples);
+
+    // Contiguous view of the front numSamples of channel, valid until they are popped.
+    const float* getReadPointer (int channel, int numSamples) const;
 
     // Zero-pads the buffer.
-    void clear()
+    void clear();
+
+    int getNumChannels() const { return static_cast<int> (channels.size()); }
+    bool isMirrored() const { return mirroredBase != nullptr; }
+    bool isLocked() const { return locked; }
+    // Physical memory of the storage, a mirrored ring maps each page twice.
+    size_t getMemoryFootprint() const
     {
-        reset();
-        buffer.clear();
+        return sizeof (float) * static_cast<size_t> (capacity) * channels.size() * (isMirrored() ? 1 : 2);
     }
 
 private:
-    juce::AudioBuffer<float> buffer;
+    void release();
+    bool mapMirrored (int numChannels, size_t regionBytes);
+    void write (int channel, int start, const float* samples, int numSamples);
+
+    // Start of each channel's region, which is followed by its mirror.
+    std::vector<float*> channels;
+    int capacity = 0;
+
+    // Mirrored mapping of all channels, or the fallback storage.
+    void* mirroredBase = nullptr;
+    size_t mirroredBytes = 0;
+    juce::HeapBlock<float> fallbackStorage;
+    bool locked = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AudioRingBuffer)
 };
 
 } // namespace ddsp
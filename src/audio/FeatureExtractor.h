@@ -0,0 +1,57 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include <cstring>
+
+#include "audio/tflite/ModelTypes.h"
+#include "util/Constants.h"
+
+namespace ddsp
+{
+
+// Estimates pitch and loudness from a frame of kModelFrameSize samples at the model sample rate.
+class FeatureExtractor
+{
+public:
+    virtual ~FeatureExtractor() = default;
+
+    // Frame to be analysed by the next call to process(). Callers write into it directly.
+    // Its contents persist between calls.
+    virtual float* getInputBuffer() = 0;
+    virtual void process (AudioFeatures& output) = 0;
+
+    // Streaming input: drops the oldest numNewSamples of the frame and returns where the
+    // numNewSamples new ones go, so overlapping frames only need the hop written each time.
+    virtual float* shiftInputBuffer (int numNewSamples)
+    {
+        jassert (numNewSamples >= 0 && numNewSamples <= kModelFrameSize);
+        float* frame = getInputBuffer();
+        const int numKept = kModelFrameSize - numNewSamples;
+        std::memmove (frame, frame + numNewSamples, sizeof (float) * numKept);
+        return frame + numKept;
+    }
+};
+
+// Available FeatureExtractor implementations, in the order of the "FeatureExtractor" parameter choices.
+enum class FeatureExtractorType
+{
+    kTFLite = 0,
+    kNative
+};
+
+} // namespace ddsp
@@ -0,0 +1,56 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace ddsp
+{
+
+// Splits a stream at the host rate into hops of a fixed length at the model rate.
+// A hop spans hostRate * modelHopSize / modelRate host samples, which is rarely an integer,
+// so hop lengths alternate between the two nearest integers. An exact integer accumulator
+// keeps every hop boundary within one sample of its true position, with no drift.
+class FractionalHopScheduler
+{
+public:
+    void prepare (double hostRate, double modelRate, int modelHopSize)
+    {
+        numerator = std::llround (hostRate) * modelHopSize;
+        denominator = std::llround (modelRate);
+        jassert (numerator > 0 && denominator > 0);
+        reset();
+    }
+
+    // Hop boundaries are rounded up, so a resampler fed one hop always has the input
+    // for a whole hop at the model rate.
+    void reset() { remainder = denominator - 1; }
+
+    // Number of host samples in the next hop.
+    int getNextHopSize() const { return static_cast<int> ((remainder + numerator) / denominator); }
+    int getMaxHopSize() const { return static_cast<int> ((numerator + denominator - 1) / denominator); }
+
+    // Moves on to the next hop.
+    void advance() { remainder = (remainder + numerator) % denominator; }
+
+private:
+    int64_t numerator = 0;
+    int64_t denominator = 1;
+    int64_t remainder = 0;
+};
+
+} // namespace ddsp
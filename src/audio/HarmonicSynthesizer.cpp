@@ -56,29 +56,33 @@ namespace
 
 using namespace juce;
 
-HarmonicSynthesizer::HarmonicSynthesizer (int nh, int nos, float sr)
-    : previousPhase (0.f),
-      previousF0 (0.f),
-      previousAmplitude (0.f),
-      numHarmonics (nh),
-      numOutputSamples (nos),
-      sampleRate (sr),
-      harmonicSeries (numHarmonics),
-      harmonicAmplitudes (numHarmonics, std::vector<float> (numOutputSamples, 0)),
-      phases (numOutputSamples),
-      sinusoids (numOutputSamples, numHarmonics)
+HarmonicSynthesizer::HarmonicSynthesizer (int nh, float sr)
+    : previousPhase (0.f), previousF0 (0.f), previousAmplitude (0.f), numHarmonics (nh), sampleRate (sr)
 {
-    previousHarmonicDistribution.resize (numHarmonics);
-    frameFrequencies.resize (numHarmonics);
-    renderBuffer.resize (numOutputSamples);
+}
 
-    harmonicSeries.resize (numHarmonics);
-    frequencyEnvelope.resize (numOutputSamples);
-    std::iota (std::begin (harmonicSeries), std::end (harmonicSeries), 1.f);
+void HarmonicSynthesizer::prepare (int newNumOutputSamples, MemoryArena& arena)
+{
+    jassert (newNumOutputSamples > 0);
+    numOutputSamples = newNumOutputSamples;
+
+    previousHarmonicDistribution = arena.allocate<float> (numHarmonics);
+    harmonicSeries = arena.allocate<float> (numHarmonics);
+    frameFrequencies = arena.allocate<float> (numHarmonics);
+    frequencyEnvelope = arena.allocate<float> (numOutputSamples);
+    phases = arena.allocate<float> (numOutputSamples);
+    renderBuffer = arena.allocate<float> (numOutputSamples);
+    harmonicAmplitudes = arena.allocate<float> (numHarmonics * numOutputSamples);
+    sinusoids = arena.allocate<float> (numOutputSamples * numHarmonics);
+
+    if (! arena.isMeasuring())
+    {
+        std::iota (harmonicSeries, harmonicSeries + numHarmonics, 1.f);
+        reset();
+    }
 }
 
-const std::vector<float>&
-    HarmonicSynthesizer::render (std::vector<float>& harmonicDistribution, float amplitude, float f0)
+const float* HarmonicSynthesizer::render (float* harmonicDistribution, float amplitude, float f0)
 {
     normalizeHarmonicDistribution (harmonicDistribution, amplitude, f0);
     previousAmplitude = amplitude;
@@ -89,26 +93,26 @@ const std::vector<float>&
 
     for (int i = 0; i < numHarmonics; i++)
     {
-        midwayLerp (previousHarmonicDistribution[i], harmonicDistribution[i], harmonicAmplitudes[i]);
+        midwayLerp (previousHarmonicDistribution[i],
+                    harmonicDistribution[i],
+                    harmonicAmplitudes + static_cast<size_t> (i) * numOutputSamples);
     }
-    previousHarmonicDistribution = harmonicDistribution;
+    std::copy_n (harmonicDistribution, numHarmonics, previousHarmonicDistribution);
 
     return synthesizeHarmonics();
 }
 
-void HarmonicSynthesizer::normalizeHarmonicDistribution (std::vector<float>& harmonicDistribution,
-                                                         float amplitude,
-                                                         float f0)
+void HarmonicSynthesizer::normalizeHarmonicDistribution (float* harmonicDistribution, float amplitude, float f0)
 {
     // The DDSP models sometimes predict harmonic values above their nyquist frequency.
     // Here we remove those and normalize the sum to 1.
 
     // Calculate the frequencies for this frame: f0 x harmonic series.
-    FloatVectorOperations::multiply (frameFrequencies.data(), harmonicSeries.data(), f0, numHarmonics);
+    FloatVectorOperations::multiply (frameFrequencies, harmonicSeries, f0, numHarmonics);
 
     // Remove harmonics above Nyquist: this is at the model sample rate, not the DAW sample rate.
     // This step is prior to normalization during training, so we replicate that order here.
-    for (int i = 0; i < frameFrequencies.size(); i++)
+    for (int i = 0; i < numHarmonics; i++)
     {
         if (frameFrequencies[i] >= sampleRate / 2.f)
         {
@@ -117,13 +121,13 @@ void HarmonicSynthesizer::normalizeHarmonicDistribution (std::vector<float>& har
     }
 
     // Normalize so the frequency coeffecients sum up to 1 again.
-    auto total = std::accumulate (harmonicDistribution.begin(), harmonicDistribution.end(), 0.f);
+    auto total = std::accumulate (harmonicDistribution, harmonicDistribution + numHarmonics, 0.f);
     if (total != 0.f)
     {
-        FloatVectorOperations::multiply (harmonicDistribution.data(), 1.f / total, numHarmonics);
+        FloatVectorOperations::multiply (harmonicDistribution, 1.f / total, numHarmonics);
     }
 
-    FloatVectorOperations::multiply (harmonicDistribution.data(), amplitude, numHarmonics);
+    FloatVectorOperations::multiply (harmonicDistribution, amplitude, numHarmonics);
 }
 
 /*
@@ -149,55 +153,55 @@ at each sample t, y(t) is then calculated by taking the sin() and applying
 the appropriate amplitude value as calculated by the model. Finally, these
 harmonics are added together to create the final wave.
 */
-const std::vector<float>& HarmonicSynthesizer::synthesizeHarmonics()
+const float* HarmonicSynthesizer::synthesizeHarmonics()
 {
     // Generates audio from sample-wise frequencies for a bank of oscillators.
 
     // Calculate the angular frequency. Hz -> radians per sample.
-    FloatVectorOperations::multiply (
-        frequencyEnvelope.data(), MathConstants<float>::twoPi / sampleRate, numOutputSamples);
+    FloatVectorOperations::multiply (frequencyEnvelope, MathConstants<float>::twoPi / sampleRate, numOutputSamples);
 
     // Calculate the integration of angular frequency as instantaneous phase.
-    std::partial_sum (frequencyEnvelope.begin(), frequencyEnvelope.end(), phases.begin());
+    std::partial_sum (frequencyEnvelope, frequencyEnvelope + numOutputSamples, phases);
 
     // Add previous total phase.
-    FloatVectorOperations::add (phases.data(), previousPhase, numOutputSamples);
+    FloatVectorOperations::add (phases, previousPhase, numOutputSamples);
 
     // Wrap and store the total phase.
-    previousPhase = fmod (phases.back(), MathConstants<float>::twoPi);
+    previousPhase = fmod (phases[numOutputSamples - 1], MathConstants<float>::twoPi);
 
     // Apply phases for each sample to its harmonic series.
     // Apply the appropriate DDSP model amplitudes to each harmonic.
     // `sinusoids` has the shape `numOutputSamples` x `numHarmonics`.
-    for (int i = 0; i < sinusoids.getNumRows(); i++)
+    for (int i = 0; i < numOutputSamples; i++)
     {
-        for (int j = 0, harmonicOrder = 1; j < sinusoids.getNumColumns(); j++, harmonicOrder++)
+        float* row = sinusoids + static_cast<size_t> (i) * numHarmonics;
+        const float* amplitudes = harmonicAmplitudes + i;
+        for (int j = 0, harmonicOrder = 1; j < numHarmonics; j++, harmonicOrder++)
         {
-            sinusoids (i, j) = (sin (phases[i] * harmonicOrder)) * harmonicAmplitudes[j][i];
+            row[j] = (sin (phases[i] * harmonicOrder)) * amplitudes[static_cast<size_t> (j) * numOutputSamples];
         }
     }
 
     // Sum up the harmonics for each timestep.
-    for (int i = 0; i < sinusoids.getNumRows(); i++)
+    for (int i = 0; i < numOutputSamples; i++)
     {
-        auto rowStart = sinusoids.begin() + (i * sinusoids.getNumColumns());
-        auto rowEnd = rowStart + sinusoids.getNumColumns();
-        renderBuffer[i] = std::accumulate (rowStart, rowEnd, 0.f);
+        const float* rowStart = sinusoids + static_cast<size_t> (i) * numHarmonics;
+        renderBuffer[i] = std::accumulate (rowStart, rowStart + numHarmonics, 0.f);
     }
 
     return renderBuffer;
 }
 
-void HarmonicSynthesizer::midwayLerp (float first, float last, std::vector<float>& result)
+void HarmonicSynthesizer::midwayLerp (float first, float last, float* result)
 {
     // This interpolation is a mix between linear and nearest neighbor, with the first half
     // being linear between the two given values and the last half repeating the last value.
     // This type of interpolation was chosen over a simple linear approach due to "swooping"
     // artifacts generated over the 20ms hop size when the two endpoint values are sufficiently
     // far apart.
-    const auto middle = result.begin() + result.size() / 2;
-    interpolateLinearly (result.begin(), middle, first, last);
-    std::fill (middle, result.end(), last);
+    float* middle = result + numOutputSamples / 2;
+    interpolateLinearly (result, middle, first, last);
+    std::fill (middle, result + numOutputSamples, last);
 }
 
 void HarmonicSynthesizer::reset()
@@ -205,14 +209,19 @@ void HarmonicSynthesizer::reset()
     previousPhase = 0;
     previousF0.reset();
     previousAmplitude = 0;
-    sinusoids.clear();
-    harmonicAmplitudes = std::vector<std::vector<float>> (numHarmonics, std::vector<float> (numOutputSamples, 0.0f));
-
-    std::fill (previousHarmonicDistribution.begin(), previousHarmonicDistribution.end(), 0.f);
-    std::fill (frameFrequencies.begin(), frameFrequencies.end(), 0.f);
-    std::fill (frequencyEnvelope.begin(), frequencyEnvelope.end(), 0.f);
-    std::fill (phases.begin(), phases.end(), 0.f);
-    std::fill (renderBuffer.begin(), renderBuffer.end(), 0.f);
+
+    if (renderBuffer == nullptr)
+    {
+        // Not prepared yet.
+        return;
+    }
+    std::fill_n (previousHarmonicDistribution, numHarmonics, 0.f);
+    std::fill_n (frameFrequencies, numHarmonics, 0.f);
+    std::fill_n (frequencyEnvelope, numOutputSamples, 0.f);
+    std::fill_n (phases, numOutputSamples, 0.f);
+    std::fill_n (renderBuffer, numOutputSamples, 0.f);
+    std::fill_n (harmonicAmplitudes, numHarmonics * numOutputSamples, 0.f);
+    std::fill_n (sinusoids, numOutputSamples * numHarmonics, 0.f);
 }
 
 } // namespace ddsp
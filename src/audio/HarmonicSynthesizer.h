@@ -14,41 +14,61 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+
 #pragma once
 
 #include <optional>
 
 #include "JuceHeader.h"
 
+#include "util/MemoryArena.h"
+
 namespace ddsp
 {
 
 class HarmonicSynthesizer
 {
 public:
-    HarmonicSynthesizer (int numHarmonics, int numOutputSamples, float sampleRate);
+    HarmonicSynthesizer (int numHarmonics, float sampleRate);
+
+    // Takes the buffers for frames of numOutputSamples from arena and resets. Called in both
+    // layout passes of the arena. Not real-time safe.
+    void prepare (int newNumOutputSamples, MemoryArena& arena);
 
     // Clears all internal scratch buffers and state variables.
     void reset();
 
-    const std::vector<float>& render (std::vector<float>& harmonicDistribution, float amplitude, float f0);
+    // Renders numHarmonics amplitudes, which are normalized in place. Returns numOutputSamples
+    // samples, valid until the next call.
+    const float* render (float* harmonicDistribution, float amplitude, float f0);
 
 private:
-    void normalizeHarmonicDistribution (std::vector<float>& harmonicDistribution, float amplitude, float f0);
-    const std::vector<float>& synthesizeHarmonics();
-    void midwayLerp (float first, float last, std::vector<float>& result);
+    void normalizeHarmonicDistribution (float* harmonicDistribution, float amplitude, float f0);
+
+    const float* synthesizeHarmonics();
+
+    void midwayLerp (float first, float last, float* result);
 
     // Harmonic synthesizer state-related variables.
-    std::vector<float> previousHarmonicDistribution;
     float previousPhase;
     std::optional<float> previousF0;
     float previousAmplitude;
 
-    int numHarmonics, numOutputSamples;
+    int numHarmonics, numOutputSamples = 0;
     float sampleRate;
-    std::vector<float> harmonicSeries, frequencyEnvelope, frameFrequencies, phases, renderBuffer;
-    std::vector<std::vector<float>> harmonicAmplitudes;
-    juce::dsp::Matrix<float> sinusoids;
+
+    // Arena buffers of numHarmonics values.
+    float* previousHarmonicDistribution = nullptr;
+    float* harmonicSeries = nullptr;
+    float* frameFrequencies = nullptr;
+    // Arena buffers of numOutputSamples values.
+    float* frequencyEnvelope = nullptr;
+    float* phases = nullptr;
+    float* renderBuffer = nullptr;
+    // Arena matrices: numHarmonics rows of numOutputSamples amplitudes, and
+    // numOutputSamples rows of numHarmonics sinusoids.
+    float* harmonicAmplitudes = nullptr;
+    float* sinusoids = nullptr;
 };
 
 } // namespace ddsp
@@ -19,6 +19,8 @@ limitations under the License.
 namespace ddsp
 {
 
+MidiInputProcessor::MidiInputProcessor() : eventFifo (kMidiEventQueueSize) {}
+
 void MidiInputProcessor::prepareToPlay (double sampleRate, int blockSize)
 {
     jassert (blockSize > 0);
@@ -28,52 +30,118 @@ void MidiInputProcessor::prepareToPlay (double sampleRate, int blockSize)
     adsr.setSampleRate (sampleRate);
 }
 
-void MidiInputProcessor::processMidiMessages (juce::MidiBuffer& midiMessages)
+void MidiInputProcessor::reset (int numPaddingSamples)
+{
+    eventFifo.reset();
+    blockPosition = 0;
+    hopPosition = -numPaddingSamples;
+    adsr.reset();
+}
+
+void MidiInputProcessor::processMidiMessages (const juce::MidiBuffer& midiMessages, int numSamples)
 {
     for (const auto metadata : midiMessages)
     {
-        auto message = metadata.getMessage();
-        const int midiNoteNumber = static_cast<float> (message.getNoteNumber());
+        const auto message = metadata.getMessage();
 
+        MidiEvent event;
+        event.timestamp = blockPosition + metadata.samplePosition;
         if (message.isNoteOn())
         {
-            adsr.noteOn();
-
-            // TODO: Add a lock-free message queue to pass midi messages.
-            currentMidiNote.store (midiNoteNumber, std::memory_order_release);
-            currentMidiVelocity.store (message.getFloatVelocity(), std::memory_order_release);
+            event.type = MidiEvent::Type::kNoteOn;
+            event.value = message.getNoteNumber();
+            event.velocity = message.getFloatVelocity();
         }
-        if (message.isNoteOff())
+        else if (message.isNoteOff())
         {
-            // Only turn off if the current note is turned off.
-            if (midiNoteNumber == currentMidiNote.load (std::memory_order_acquire))
-            {
-                adsr.noteOff();
-            }
+            event.type = MidiEvent::Type::kNoteOff;
+            event.value = message.getNoteNumber();
+        }
+        else if (message.isPitchWheel())
+        {
+            event.type = MidiEvent::Type::kPitchBend;
+            event.value = message.getPitchWheelValue();
         }
-        if (message.isPitchWheel())
+        else
         {
-            currentPitchBend.store (message.getPitchWheelValue(), std::memory_order_release);
+            continue;
         }
+
+        int start1, size1, start2, size2;
+        eventFifo.prepareToWrite (1, start1, size1, start2, size2);
+        if (size1 == 0)
+        {
+            numDroppedEvents.fetch_add (1, std::memory_order_relaxed);
+            continue;
+        }
+        events[start1] = event;
+        eventFifo.finishedWrite (1);
     }
+
+    blockPosition += numSamples;
 }
 
-AudioFeatures MidiInputProcessor::getCurrentPredictControlsInput()
+AudioFeatures MidiInputProcessor::getCurrentPredictControlsInput (int numHostSamples)
 {
+    const int64_t hopEnd = hopPosition + numHostSamples;
+
+    // Split the hop at each event that falls within it, so the envelope sees every event
+    // at its own sample offset.
+    int numRendered = 0;
+    while (eventFifo.getNumReady() > 0)
+    {
+        int start1, size1, start2, size2;
+        eventFifo.prepareToRead (1, start1, size1, start2, size2);
+        const MidiEvent& event = events[start1];
+        if (event.timestamp >= hopEnd)
+        {
+            break;
+        }
+
+        // Host sample offset in the hop, mapped onto the envelope's samples.
+        const auto offset = static_cast<int> (std::max<int64_t> (0, event.timestamp - hopPosition) * userHopSize
+                                              / numHostSamples);
+        adsr.advance (offset - numRendered);
+        numRendered = std::max (numRendered, offset);
+
+        applyEvent (event);
+        eventFifo.finishedRead (1);
+    }
+    adsr.advance (userHopSize - numRendered);
+    hopPosition = hopEnd;
+
     AudioFeatures predictControlsInput;
-    const float f0_hz = getFreqFromNoteAndBend (currentMidiNote.load (std::memory_order_acquire),
-                                                currentPitchBend.load (std::memory_order_acquire));
+    const float f0_hz = getFreqFromNoteAndBend (currentMidiNote, currentPitchBend);
     const float f0_norm = juce::mapFromLog10 (f0_hz, kPitchRangeMin_Hz, kPitchRangeMax_Hz);
     predictControlsInput.f0_norm = f0_norm;
     predictControlsInput.f0_hz = f0_hz;
+    // The envelope at the end of the hop, like the features the models were trained on, which
+    // sample the loudness once per frame rather than averaging it.
+    predictControlsInput.loudness_norm = adsr.getValue() * currentMidiVelocity;
+
+    return predictControlsInput;
+}
 
-    for (int i = 0; i < userHopSize; ++i)
+void MidiInputProcessor::applyEvent (const MidiEvent& event)
+{
+    switch (event.type)
     {
-        predictControlsInput.loudness_norm =
-            adsr.getNextSample() * currentMidiVelocity.load (std::memory_order_acquire);
+        case MidiEvent::Type::kNoteOn:
+            adsr.noteOn();
+            currentMidiNote = event.value;
+            currentMidiVelocity = event.velocity;
+            break;
+        case MidiEvent::Type::kNoteOff:
+            // Only turn off if the current note is turned off.
+            if (event.value == currentMidiNote)
+            {
+                adsr.noteOff();
+            }
+            break;
+        case MidiEvent::Type::kPitchBend:
+            currentPitchBend = event.value;
+            break;
     }
-
-    return predictControlsInput;
 }
 
 void MidiInputProcessor::setAttack (float attackTimeSeconds)
@@ -16,41 +16,91 @@ limitations under the License.
 
 #pragma once
 
+#include <array>
+
 #include "JuceHeader.h"
 
+#include "audio/ADSREnvelope.h"
 #include "audio/tflite/ModelBase.h"
 #include "audio/tflite/ModelTypes.h"
+#include "util/Constants.h"
 #include "util/InputUtils.h"
 
 namespace ddsp
 {
 
+// Turns MIDI into pitch and loudness controls, one model hop at a time.
+// MIDI arrives on the audio thread and is timestamped into a preallocated single-producer,
+// single-consumer queue. The render thread drains it and applies each event at its sample
+// offset within the hop, so all envelope state is owned by the render thread.
 class MidiInputProcessor
 {
 public:
+    MidiInputProcessor();
+
+    // The envelope runs at sampleRate and every call to getCurrentPredictControlsInput()
+    // covers blockSize of its samples.
     void prepareToPlay (double sampleRate, int blockSize);
-    void processMidiMessages (juce::MidiBuffer& midiMessages);
-    // Threadsafe call to fetch audio-related features for further processing.
-    ddsp::AudioFeatures getCurrentPredictControlsInput();
+    // Clears pending events and restarts both clocks. The first hop starts numPaddingSamples
+    // host samples before the first block passed to processMidiMessages().
+    void reset (int numPaddingSamples);
+
+    // Audio thread: queues the events of the next block of numSamples host samples.
+    void processMidiMessages (const juce::MidiBuffer& midiMessages, int numSamples);
+    // Render thread: applies the events that fall within the next hop of numHostSamples
+    // and returns the controls at its end.
+    ddsp::AudioFeatures getCurrentPredictControlsInput (int numHostSamples);
 
     // ADSR setters/getters. Modifies the amplitude envelope of each set midi note.
+    // Render thread only.
     void setAttack (float attackTimeSeconds);
     void setDecay (float decayTimeSeconds);
     void setSustain (float sustainLevel);
     void setRelease (float releaseTimeSeconds);
 
+    // Events dropped because the queue was full.
+    int getNumDroppedEvents() const { return numDroppedEvents.load (std::memory_order_relaxed); }
+
     // TODO: Add MIDI feature snapping module.
     // TODO: Add Vibrato/LFO for pitch/loudness.
 
 private:
+    struct MidiEvent
+    {
+        enum class Type
+        {
+            kNoteOn,
+            kNoteOff,
+            kPitchBend
+        };
+
+        Type type = Type::kNoteOn;
+        // Host sample position of the event.
+        int64_t timestamp = 0;
+        // Note number or pitch wheel value.
+        int value = 0;
+        float velocity = 0.0f;
+    };
+
+    void applyEvent (const MidiEvent& event);
+
     // User-provided hop-size, intended to be overwritten after calling prepareToPlay().
     int userHopSize = 0;
 
-    std::atomic<int> currentPitchBend = { static_cast<int> (ddsp::kPitchBendBase) };
-    std::atomic<float> currentMidiNote = { ddsp::kMidiNoteA4 };
-    std::atomic<float> currentMidiVelocity = { 0.0f };
+    juce::AbstractFifo eventFifo;
+    std::array<MidiEvent, kMidiEventQueueSize> events;
+    std::atomic<int> numDroppedEvents = { 0 };
+
+    // Audio thread clock.
+    int64_t blockPosition = 0;
+
+    // Render thread state.
+    int64_t hopPosition = 0;
+    int currentPitchBend = static_cast<int> (ddsp::kPitchBendBase);
+    int currentMidiNote = static_cast<int> (ddsp::kMidiNoteA4);
+    float currentMidiVelocity = 0.0f;
 
-    juce::ADSR adsr;
+    ADSREnvelope adsr;
     juce::ADSR::Parameters adsrParams;
 };
 
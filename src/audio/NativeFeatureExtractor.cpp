@@ -0,0 +1,238 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+Pitch is estimated with the YIN algorithm (de Cheveigné & Kawahara, 2002).
+The difference function of a lag tau over a window of W samples
+
+d(tau) = sum_{j < W} (x[j] - x[j + tau])^2 = E(0) + E(tau) - 2 r(tau)
+
+is computed from window energies E, taken from prefix sums, and the
+cross-correlation r between the first window and the whole frame, taken
+from one product of FFTs. The first dip of the cumulative mean normalized
+difference below a threshold gives the period, refined by parabolic
+interpolation. Unvoiced frames and silence hold the last voiced pitch,
+similar to how the extract_features_micro model never drops its estimate.
+
+Loudness is the mean power of the frame in dB after A-weighting, computed
+in the frequency domain from the same frame spectrum. It is floored at
+-80 dB and normalized like the DDSP training pipeline.
+
+The prefix sums are recomputed from the frame every call, in double.
+Shifting them along with a streamed frame would subtract the energy of the
+dropped samples, and after a loud passage the cancellation error of that
+subtraction can exceed the energy of a quiet frame. Frames that are silent
+even at the largest A-weighting gain skip both FFTs. The spectra are
+recomputed every hop too: with a 1024-sample frame and a 320-sample hop a
+sliding DFT would cost more than one FFT. The analysis therefore costs the
+same at every hop size, and its share of the render time grows as the hop
+shrinks, see the NativeFeatureExtractor/process benchmarks.
+*/
+
+#include "audio/NativeFeatureExtractor.h"
+#include "util/Constants.h"
+#include "util/InputUtils.h"
+
+namespace ddsp
+{
+
+namespace
+{
+    // The FFT is twice the frame size so the correlation doesn't wrap around.
+    constexpr int kFFTOrder = 11;
+    // YIN integration window, the maximum lag is bounded by the rest of the frame.
+    constexpr int kYinWindowSize = kModelFrameSize / 2;
+    // Lags are searched between the periods of these pitches.
+    constexpr float kMinPitch_Hz = 40.0f;
+    constexpr float kMaxPitch_Hz = 2000.0f;
+    // Threshold on the cumulative mean normalized difference for the first dip.
+    constexpr float kYinThreshold = 0.15f;
+    // If no dip crosses kYinThreshold, the global minimum must be below this to count as voiced.
+    constexpr float kUnvoicedThreshold = 0.4f;
+    // Mean power of -80 dB, below which the frame is considered silent.
+    constexpr float kSilencePower = 1.0e-8f;
+    constexpr float kLoudnessRange_dB = 80.0f;
+
+    // A-weighting (IEC 61672) as a power gain, normalized to unity at 1 kHz.
+    double aWeightingPowerGain (double f)
+    {
+        const double f2 = f * f;
+        const double ra = (12194.0 * 12194.0 * f2 * f2)
+                          / ((f2 + 20.6 * 20.6) * std::sqrt ((f2 + 107.7 * 107.7) * (f2 + 737.9 * 737.9))
+                             * (f2 + 12194.0 * 12194.0));
+        return ra * ra * std::pow (10.0, 2.0 / 10.0);
+    }
+} // namespace
+
+NativeFeatureExtractor::NativeFeatureExtractor()
+    : frame (kModelFrameSize, 0.0f),
+      fft (kFFTOrder),
+      frameSpectrum (fft.getSize() * 2),
+      windowSpectrum (fft.getSize() * 2),
+      aWeighting (fft.getSize() / 2 + 1),
+      energy (kModelFrameSize + 1),
+      difference (kYinWindowSize + 1),
+      previousF0_Hz (kFreqA4_Hz)
+{
+    static_assert ((1 << kFFTOrder) == 2 * kModelFrameSize);
+
+    // Fold the A-weighting, the one-sided spectrum and Parseval's normalization into one gain
+    // per bin, so the mean power of the frame is a single weighted sum over the bins.
+    const int numBins = static_cast<int> (aWeighting.size());
+    const double binWidth_Hz = kModelSampleRate_Hz / fft.getSize();
+    for (int k = 0; k < numBins; ++k)
+    {
+        const double oneSided = (k == 0 || k == numBins - 1) ? 1.0 : 2.0;
+        const double powerGain = aWeightingPowerGain (k * binWidth_Hz);
+        aWeighting[k] =
+            static_cast<float> (powerGain * oneSided / (static_cast<double> (fft.getSize()) * kModelFrameSize));
+        maxPowerGain = std::max (maxPowerGain, static_cast<float> (powerGain));
+    }
+}
+
+void NativeFeatureExtractor::process (AudioFeatures& output)
+{
+    updateEnergy();
+
+    if (static_cast<float> (energy[kModelFrameSize] / kModelFrameSize) * maxPowerGain < kSilencePower)
+    {
+        output.loudness_db = -kLoudnessRange_dB;
+        output.f0_hz = previousF0_Hz;
+    }
+    else
+    {
+        // Spectrum of the whole frame, shared by the loudness and pitch estimates.
+        std::fill (frameSpectrum.begin(), frameSpectrum.end(), 0.0f);
+        std::copy (frame.begin(), frame.end(), frameSpectrum.begin());
+        fft.performRealOnlyForwardTransform (frameSpectrum.data(), true);
+
+        output.loudness_db = computeLoudness();
+        output.f0_hz = estimatePitch();
+    }
+
+    output.loudness_norm = normalizedLoudness (output.loudness_db);
+    output.f0_norm = normalizedPitch (output.f0_hz);
+}
+
+void NativeFeatureExtractor::reset()
+{
+    std::fill (frame.begin(), frame.end(), 0.0f);
+    std::fill (energy.begin(), energy.end(), 0.0);
+    previousF0_Hz = kFreqA4_Hz;
+}
+
+void NativeFeatureExtractor::updateEnergy()
+{
+    // Prefix sums of the squared frame, E(tau) is energy[tau + W] - energy[tau].
+    energy[0] = 0.0;
+    for (int i = 0; i < kModelFrameSize; ++i)
+    {
+        const double sample = frame[i];
+        energy[i + 1] = energy[i] + sample * sample;
+    }
+}
+
+float NativeFeatureExtractor::computeLoudness()
+{
+    const auto* bins = reinterpret_cast<const std::complex<float>*> (frameSpectrum.data());
+
+    float meanPower = 0.0f;
+    for (size_t k = 0; k < aWeighting.size(); ++k)
+    {
+        meanPower += aWeighting[k] * std::norm (bins[k]);
+    }
+
+    const float power_dB = 10.0f * std::log10 (std::max (meanPower, kSilencePower));
+    return std::max (power_dB, -kLoudnessRange_dB);
+}
+
+float NativeFeatureExtractor::estimatePitch()
+{
+    const auto windowEnergy = static_cast<float> (energy[kYinWindowSize]);
+    if (windowEnergy / kYinWindowSize < kSilencePower)
+    {
+        return previousF0_Hz;
+    }
+
+    // Cross-correlation r(tau) = sum_{j < W} x[j] x[j + tau] as the inverse FFT of conj(W) * X.
+    std::fill (windowSpectrum.begin(), windowSpectrum.end(), 0.0f);
+    std::copy (frame.begin(), frame.begin() + kYinWindowSize, windowSpectrum.begin());
+    fft.performRealOnlyForwardTransform (windowSpectrum.data(), true);
+
+    const auto* frameBins = reinterpret_cast<const std::complex<float>*> (frameSpectrum.data());
+    auto* windowBins = reinterpret_cast<std::complex<float>*> (windowSpectrum.data());
+    for (int k = 0; k <= fft.getSize() / 2; ++k)
+    {
+        windowBins[k] = std::conj (windowBins[k]) * frameBins[k];
+    }
+    fft.performRealOnlyInverseTransform (windowSpectrum.data());
+    const float* correlation = windowSpectrum.data();
+
+    const int minLag = static_cast<int> (kModelSampleRate_Hz / kMaxPitch_Hz);
+    const int maxLag = std::min (kYinWindowSize - 1, static_cast<int> (std::ceil (kModelSampleRate_Hz / kMinPitch_Hz)));
+
+    // Cumulative mean normalized difference function.
+    difference[0] = 1.0f;
+    float runningSum = 0.0f;
+    for (int tau = 1; tau <= maxLag + 1; ++tau)
+    {
+        const auto lagEnergy = static_cast<float> (energy[tau + kYinWindowSize] - energy[tau]);
+        const float d = windowEnergy + lagEnergy - 2.0f * correlation[tau];
+        runningSum += d;
+        difference[tau] = runningSum > 0.0f ? d * tau / runningSum : 1.0f;
+    }
+
+    // Take the first dip below the threshold, falling back to the global minimum.
+    int bestLag = -1;
+    for (int tau = minLag; tau <= maxLag; ++tau)
+    {
+        if (difference[tau] < kYinThreshold)
+        {
+            while (tau < maxLag && difference[tau + 1] < difference[tau])
+            {
+                ++tau;
+            }
+            bestLag = tau;
+            break;
+        }
+    }
+
+    if (bestLag < 0)
+    {
+        bestLag = static_cast<int> (std::min_element (difference.begin() + minLag, difference.begin() + maxLag + 1)
+                                    - difference.begin());
+        if (difference[bestLag] > kUnvoicedThreshold)
+        {
+            return previousF0_Hz;
+        }
+    }
+
+    // Parabolic interpolation around the dip.
+    float lag = static_cast<float> (bestLag);
+    const float left = difference[bestLag - 1];
+    const float centre = difference[bestLag];
+    const float right = difference[bestLag + 1];
+    const float curvature = left - 2.0f * centre + right;
+    if (curvature > 0.0f)
+    {
+        lag += 0.5f * (left - right) / curvature;
+    }
+
+    previousF0_Hz = kModelSampleRate_Hz / lag;
+    return previousF0_Hz;
+}
+
+} // namespace ddsp
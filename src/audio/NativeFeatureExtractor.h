@@ -0,0 +1,71 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "audio/FeatureExtractor.h"
+#include "util/Constants.h"
+
+namespace ddsp
+{
+
+// Lightweight alternative to the extract_features_micro model for clean, monophonic input.
+// Pitch is estimated with YIN using an FFT cross-correlation, loudness is the A-weighted
+// mean power of the frame.
+class NativeFeatureExtractor : public FeatureExtractor
+{
+public:
+    NativeFeatureExtractor();
+
+    float* getInputBuffer() override { return frame.data(); }
+    void process (AudioFeatures& output) override;
+
+    // Clears the frame and the held pitch used for unvoiced frames.
+    void reset();
+
+    // Working memory, excluding the FFT's own tables.
+    size_t getMemoryFootprint() const
+    {
+        return sizeof (float)
+                   * (frame.size() + frameSpectrum.size() + windowSpectrum.size() + aWeighting.size()
+                      + difference.size())
+               + sizeof (double) * energy.size();
+    }
+
+private:
+    void updateEnergy();
+    float estimatePitch();
+    float computeLoudness();
+
+    std::vector<float> frame;
+    juce::dsp::FFT fft;
+    // Interleaved complex spectra of the full frame and its first YIN window.
+    std::vector<float> frameSpectrum, windowSpectrum;
+    // Per-bin A-weighting power gains, and the largest one as a bound for skipping silent frames.
+    std::vector<float> aWeighting;
+    float maxPowerGain = 1.0f;
+    // Cumulative energy of the frame, in double so that differences of its sums stay accurate.
+    std::vector<double> energy;
+    // YIN difference function.
+    std::vector<float> difference;
+
+    // Last voiced pitch, held through unvoiced frames.
+    float previousF0_Hz;
+};
+
+} // namespace ddsp
@@ -34,92 +34,111 @@ namespace ddsp
 
 using namespace juce;
 
-NoiseSynthesizer::NoiseSynthesizer (int nna, int nos)
-    : impulseResponseSize ((nna - 1) * 2), numOutputSamples (nos), windowFFT (7), convolveFFT (9)
+NoiseSynthesizer::NoiseSynthesizer (int nna)
+    : numNoiseAmplitudes (nna), impulseResponseSize ((nna - 1) * 2), windowFFT (7), convolveFFT (9)
 {
-    createZeroPhaseHannWindow();
-    noiseAudio.resize (numOutputSamples);
-    magnitudes.resize (windowFFT.getSize());
-    windowedImpulseResponse.resize (convolveFFT.getSize() * 2);
-    whiteNoise.resize (convolveFFT.getSize() * 2);
 }
 
-const std::vector<float>& NoiseSynthesizer::render (const std::vector<float>& mags)
+void NoiseSynthesizer::prepare (int newNumOutputSamples, MemoryArena& arena)
+{
+    // The frame is cropped from a single convolution block.
+    jassert (newNumOutputSamples > 0
+             && (impulseResponseSize - 1) / 2 - 1 + newNumOutputSamples <= convolveFFT.getSize());
+    numOutputSamples = newNumOutputSamples;
+
+    zpHannWindow = arena.allocate<float> (impulseResponseSize);
+    noiseAudio = arena.allocate<float> (numOutputSamples);
+    windowedImpulseResponse = arena.allocate<float> (convolveFFT.getSize() * 2);
+    whiteNoise = arena.allocate<float> (convolveFFT.getSize() * 2);
+    magnitudes = arena.allocate<std::complex<float>> (windowFFT.getSize());
+
+    if (! arena.isMeasuring())
+    {
+        createZeroPhaseHannWindow();
+        reset();
+    }
+}
+
+const float* NoiseSynthesizer::render (const float* mags)
 {
     applyWindowToImpulseResponse (mags);
     convolve();
     return noiseAudio;
 }
 
-void NoiseSynthesizer::applyWindowToImpulseResponse (const std::vector<float>& mags)
+void NoiseSynthesizer::applyWindowToImpulseResponse (const float* mags)
 {
     // Clear and fill complex vector for ifft
-    std::fill (magnitudes.begin(), magnitudes.end(), 0.f);
-    for (int i = 0; i < mags.size(); i++)
+    std::fill_n (magnitudes, windowFFT.getSize(), 0.f);
+    for (int i = 0; i < numNoiseAmplitudes; i++)
         magnitudes[i].real (mags[i]);
 
     // Cast complex* to float* for use with JUCE fft
-    auto impulseResponse = reinterpret_cast<float*> (magnitudes.data());
+    auto impulseResponse = reinterpret_cast<float*> (magnitudes);
 
     // Obtain impulse response
     windowFFT.performRealOnlyInverseTransform (impulseResponse);
 
     // Apply the window to the IR
-    juce::FloatVectorOperations::multiply (impulseResponse, zpHannWindow.data(), impulseResponseSize);
+    juce::FloatVectorOperations::multiply (impulseResponse, zpHannWindow, impulseResponseSize);
 
     // Put into causal form
     std::rotate (impulseResponse, impulseResponse + windowFFT.getSize() / 2, impulseResponse + windowFFT.getSize());
 
-    std::fill (windowedImpulseResponse.begin(), windowedImpulseResponse.end(), 0.f);
-    std::copy (impulseResponse, impulseResponse + impulseResponseSize, windowedImpulseResponse.begin());
+    std::fill_n (windowedImpulseResponse, convolveFFT.getSize() * 2, 0.f);
+    std::copy (impulseResponse, impulseResponse + impulseResponseSize, windowedImpulseResponse);
 }
 
 void NoiseSynthesizer::convolve()
 {
-    for (int i = 0; i < whiteNoise.size(); i++)
+    for (int i = 0; i < convolveFFT.getSize() * 2; i++)
         whiteNoise[i] = jmap (random.nextFloat(), -1.f, 1.f);
 
-    convolveFFT.performRealOnlyForwardTransform (whiteNoise.data());
-    convolveFFT.performRealOnlyForwardTransform (windowedImpulseResponse.data());
+    convolveFFT.performRealOnlyForwardTransform (whiteNoise);
+    convolveFFT.performRealOnlyForwardTransform (windowedImpulseResponse);
 
-    auto whiteNoiseFreqs = reinterpret_cast<std::complex<float>*> (whiteNoise.data());
-    auto impulseResponseFreqs = reinterpret_cast<std::complex<float>*> (windowedImpulseResponse.data());
+    auto whiteNoiseFreqs = reinterpret_cast<std::complex<float>*> (whiteNoise);
+    auto impulseResponseFreqs = reinterpret_cast<std::complex<float>*> (windowedImpulseResponse);
 
     // Filter the white noise
     for (int i = 0; i < convolveFFT.getSize() / 2 + 1; i++)
         whiteNoiseFreqs[i] *= impulseResponseFreqs[i];
 
-    convolveFFT.performRealOnlyInverseTransform (whiteNoise.data());
+    convolveFFT.performRealOnlyInverseTransform (whiteNoise);
 
     cropAndCompensateDelay (whiteNoise, impulseResponseSize);
 }
 
-void NoiseSynthesizer::cropAndCompensateDelay (const std::vector<float>& inputAudio, int irSize)
+void NoiseSynthesizer::cropAndCompensateDelay (const float* inputAudio, int irSize)
 {
     // Compensate for the group delay of the filter by trimming the front.
     // The group delay is constant because the filter is linear phase.
-    auto start = inputAudio.begin() + ((irSize - 1) / 2 - 1);
-    std::copy (start, start + numOutputSamples, noiseAudio.begin());
+    auto start = inputAudio + ((irSize - 1) / 2 - 1);
+    std::copy (start, start + numOutputSamples, noiseAudio);
 }
 
 void NoiseSynthesizer::createZeroPhaseHannWindow()
 {
     // Create Hann Window
-    zpHannWindow.resize (impulseResponseSize);
-    for (int i = 0; i < zpHannWindow.size(); i++)
-        zpHannWindow[i] = 0.5f * (1.f - cos (MathConstants<float>::twoPi * i / (float) zpHannWindow.size()));
+    for (int i = 0; i < impulseResponseSize; i++)
+        zpHannWindow[i] = 0.5f * (1.f - cos (MathConstants<float>::twoPi * i / (float) impulseResponseSize));
 
     // Put in zero-phase form
-    std::rotate (zpHannWindow.begin(), zpHannWindow.begin() + zpHannWindow.size() / 2, zpHannWindow.end());
+    std::rotate (zpHannWindow, zpHannWindow + impulseResponseSize / 2, zpHannWindow + impulseResponseSize);
 }
 
 void NoiseSynthesizer::reset()
 {
-    std::fill (noiseAudio.begin(), noiseAudio.end(), 0.f);
-    std::fill (whiteNoise.begin(), whiteNoise.end(), 0.f);
-    std::fill (windowedImpulseResponse.begin(), windowedImpulseResponse.end(), 0.f);
-    std::fill (magnitudes.begin(), magnitudes.end(), 0.f);
     random.setSeed (42);
+    if (noiseAudio == nullptr)
+    {
+        // Not prepared yet.
+        return;
+    }
+    std::fill_n (noiseAudio, numOutputSamples, 0.f);
+    std::fill_n (whiteNoise, convolveFFT.getSize() * 2, 0.f);
+    std::fill_n (windowedImpulseResponse, convolveFFT.getSize() * 2, 0.f);
+    std::fill_n (magnitudes, windowFFT.getSize(), 0.f);
 }
 
 } // namespace ddsp
@@ -14,37 +14,51 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+
 #pragma once
 
 #include "JuceHeader.h"
 
+#include "util/MemoryArena.h"
+
 namespace ddsp
 {
 
 class NoiseSynthesizer
 {
 public:
-    NoiseSynthesizer (int numNoiseAmplitudes, int numOutputSamples);
+    NoiseSynthesizer (int numNoiseAmplitudes);
+
+    // Takes the buffers for frames of numOutputSamples from arena and resets. Called in both
+    // layout passes of the arena. Not real-time safe.
+    void prepare (int newNumOutputSamples, MemoryArena& arena);
 
     // Clears all internal scratch buffers and state variables.
     void reset();
 
-    const std::vector<float>& render (const std::vector<float>& mags);
+    // Filters noise by numNoiseAmplitudes magnitudes. Returns numOutputSamples samples, valid
+    // until the next call.
+    const float* render (const float* mags);
 
 private:
     void createZeroPhaseHannWindow();
-
-    void applyWindowToImpulseResponse (const std::vector<float>& mags);
+    void applyWindowToImpulseResponse (const float* mags);
     void convolve();
-    void cropAndCompensateDelay (const std::vector<float>& audio, int irSize);
-
-    std::vector<float> zpHannWindow, noiseAudio, windowedImpulseResponse, whiteNoise;
-    std::vector<std::complex<float>> magnitudes;
-
-    const int impulseResponseSize, numOutputSamples;
+    void cropAndCompensateDelay (const float* audio, int irSize);
 
+    const int numNoiseAmplitudes;
+    const int impulseResponseSize;
+    int numOutputSamples = 0;
     juce::dsp::FFT windowFFT, convolveFFT;
     juce::Random random;
+
+    // Arena buffers. The convolution buffers hold convolveFFT.getSize() * 2 values for the
+    // in-place real transforms.
+    float* zpHannWindow = nullptr;
+    float* noiseAudio = nullptr;
+    float* windowedImpulseResponse = nullptr;
+    float* whiteNoise = nullptr;
+    std::complex<float>* magnitudes = nullptr;
 };
 
 } // namespace ddsp
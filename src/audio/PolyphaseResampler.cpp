@@ -0,0 +1,233 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+The rate change outputRate / inputRate is reduced to upFactor / downFactor,
+and output sample n sits at input position n * downFactor / upFactor. Its
+fractional part is always a multiple of 1 / upFactor, so one table of
+Kaiser-windowed sinc coefficients per fractional position covers every
+output sample, and each output is a single dot product with the input
+history. The position is tracked with integers and never drifts.
+
+The lowpass cutoff sits just below the Nyquist frequency of the lower of
+the two rates, and the kernel spans a fixed number of zero crossings of it.
+A 3:1 decimation therefore needs one table of 3x as many taps, while the
+441:160 conversion of 44.1 kHz uses 160 shorter tables. Conversions whose
+upFactor would need too many tables, like those of non-standard sample
+rates, interpolate linearly between a fixed set of tables instead.
+
+The filter is linear phase, so the group delay is half the kernel length.
+*/
+
+#include <numeric>
+
+#include "audio/PolyphaseResampler.h"
+
+#if JUCE_USE_SSE_INTRINSICS
+    #include <immintrin.h>
+#elif JUCE_USE_ARM_NEON
+    #include <arm_neon.h>
+#endif
+
+namespace ddsp
+{
+
+namespace
+{
+    // Above this many fractional positions, tables are interpolated.
+    constexpr int64_t kMaxPhases = 1024;
+
+    struct QualitySettings
+    {
+        // Kernel half-length in zero crossings of the lower rate's lowpass.
+        int zeroCrossings;
+        // Kaiser window shape, larger is more stopband attenuation and a wider transition.
+        double kaiserBeta;
+        // Cutoff relative to the lower Nyquist frequency.
+        double rolloff;
+    };
+
+    constexpr QualitySettings kQualitySettings[] = {
+        { 8, 7.0, 0.85 }, // kLow
+        { 16, 9.0, 0.9 }, // kMedium
+        { 32, 11.0, 0.94 }, // kHigh
+    };
+
+    float dotProduct (const float* a, const float* b, int size)
+    {
+        int i = 0;
+        float result = 0.0f;
+#if JUCE_USE_SSE_INTRINSICS
+        __m128 sum = _mm_setzero_ps();
+        for (; i + 4 <= size; i += 4)
+        {
+            sum = _mm_add_ps (sum, _mm_mul_ps (_mm_loadu_ps (a + i), _mm_loadu_ps (b + i)));
+        }
+        alignas (16) float lanes[4];
+        _mm_store_ps (lanes, sum);
+        result = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif JUCE_USE_ARM_NEON
+        float32x4_t sum = vdupq_n_f32 (0.0f);
+        for (; i + 4 <= size; i += 4)
+        {
+            sum = vmlaq_f32 (sum, vld1q_f32 (a + i), vld1q_f32 (b + i));
+        }
+        const float32x2_t pairs = vadd_f32 (vget_low_f32 (sum), vget_high_f32 (sum));
+        result = vget_lane_f32 (vpadd_f32 (pairs, pairs), 0);
+#endif
+        for (; i < size; ++i)
+        {
+            result += a[i] * b[i];
+        }
+        return result;
+    }
+
+    double sinc (double x)
+    {
+        return x == 0.0 ? 1.0 : std::sin (juce::MathConstants<double>::pi * x) / (juce::MathConstants<double>::pi * x);
+    }
+} // namespace
+
+void PolyphaseResampler::prepare (double inputRate, double outputRate, int maxInputSamples, Quality quality)
+{
+    const auto inputRate_Hz = static_cast<int64_t> (std::llround (inputRate));
+    const auto outputRate_Hz = static_cast<int64_t> (std::llround (outputRate));
+    jassert (inputRate_Hz > 0 && outputRate_Hz > 0);
+
+    const int64_t divisor = std::gcd (inputRate_Hz, outputRate_Hz);
+    upFactor = outputRate_Hz / divisor;
+    downFactor = inputRate_Hz / divisor;
+
+    if (isBypassed())
+    {
+        numTaps = 0;
+        numPhases = 0;
+        coefficients.clear();
+        history.clear();
+        reset();
+        return;
+    }
+
+    const auto& settings = kQualitySettings[static_cast<int> (quality)];
+    const double ratio = static_cast<double> (upFactor) / static_cast<double> (downFactor);
+    // Input samples per zero crossing of the lowpass.
+    const int stretch = static_cast<int> (std::ceil (1.0 / std::min (1.0, ratio)));
+    numTaps = 2 * settings.zeroCrossings * stretch;
+    // Cycles per input sample.
+    const double cutoff = 0.5 * settings.rolloff * std::min (1.0, ratio);
+
+    interpolatePhases = upFactor > kMaxPhases;
+    numPhases = static_cast<int> (interpolatePhases ? kMaxPhases + 1 : upFactor);
+    coefficients.resize (static_cast<size_t> (numPhases) * numTaps);
+
+    const double halfLength = numTaps / 2.0;
+    const double windowNorm = juce::dsp::SpecialFunctions::besselI0 (settings.kaiserBeta);
+    const double phaseStep = 1.0 / static_cast<double> (interpolatePhases ? kMaxPhases : upFactor);
+    std::vector<double> kernel (numTaps);
+
+    for (int p = 0; p < numPhases; ++p)
+    {
+        // Taps are stored in input order, so the kernel is evaluated backwards from the output position.
+        auto* taps = coefficients.data() + static_cast<size_t> (p) * numTaps;
+        double sum = 0.0;
+        for (int k = 0; k < numTaps; ++k)
+        {
+            const double t = p * phaseStep + halfLength - 1.0 - k;
+            const double x = t / halfLength;
+            const double window = std::abs (x) < 1.0 ? juce::dsp::SpecialFunctions::besselI0 (
+                                                           settings.kaiserBeta * std::sqrt (1.0 - x * x))
+                                                           / windowNorm
+                                                     : 0.0;
+            kernel[k] = 2.0 * cutoff * sinc (2.0 * cutoff * t) * window;
+            sum += kernel[k];
+        }
+        // Unity gain at DC for every fractional position.
+        for (int k = 0; k < numTaps; ++k)
+        {
+            taps[k] = static_cast<float> (kernel[k] / sum);
+        }
+    }
+
+    // At most numTaps unread samples are carried over between blocks.
+    history.resize (static_cast<size_t> (numTaps + maxInputSamples));
+    reset();
+}
+
+void PolyphaseResampler::reset()
+{
+    std::fill (history.begin(), history.end(), 0.0f);
+    // Starting on numTaps - 1 zeros centres the first output sample half a kernel before the input.
+    numHistorySamples = std::max (0, numTaps - 1);
+    readIndex = 0;
+    phase = 0;
+}
+
+int PolyphaseResampler::process (const float* input, int numInputSamples, float* output, int maxOutputSamples)
+{
+    if (isBypassed())
+    {
+        jassert (numInputSamples <= maxOutputSamples);
+        std::copy (input, input + numInputSamples, output);
+        return numInputSamples;
+    }
+
+    jassert (numHistorySamples + numInputSamples <= static_cast<int> (history.size()));
+    std::copy (input, input + numInputSamples, history.begin() + numHistorySamples);
+    const int numAvailable = numHistorySamples + numInputSamples;
+
+    int numOutputSamples = 0;
+    while (readIndex + numTaps <= numAvailable && numOutputSamples < maxOutputSamples)
+    {
+        const float* x = history.data() + readIndex;
+        if (interpolatePhases)
+        {
+            const double position = static_cast<double> (phase) * kMaxPhases / static_cast<double> (upFactor);
+            const int index = static_cast<int> (position);
+            const float y0 = dotProduct (x, getPhaseCoefficients (index), numTaps);
+            const float y1 = dotProduct (x, getPhaseCoefficients (index + 1), numTaps);
+            output[numOutputSamples] = y0 + static_cast<float> (position - index) * (y1 - y0);
+        }
+        else
+        {
+            output[numOutputSamples] = dotProduct (x, getPhaseCoefficients (static_cast<int> (phase)), numTaps);
+        }
+        ++numOutputSamples;
+
+        phase += downFactor;
+        readIndex += static_cast<int> (phase / upFactor);
+        phase %= upFactor;
+    }
+
+    // Keep the samples still needed by upcoming outputs at the front.
+    numHistorySamples = numAvailable - readIndex;
+    std::copy (history.begin() + readIndex, history.begin() + numAvailable, history.begin());
+    readIndex = 0;
+
+    return numOutputSamples;
+}
+
+int PolyphaseResampler::getMaxOutputSamples (int numInputSamples) const
+{
+    if (isBypassed())
+    {
+        return numInputSamples;
+    }
+    return static_cast<int> ((numInputSamples + numTaps) * upFactor / downFactor) + 1;
+}
+
+double PolyphaseResampler::getLatencyInInputSamples() const { return numTaps / 2.0; }
+
+} // namespace ddsp
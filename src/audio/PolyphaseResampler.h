@@ -0,0 +1,80 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace ddsp
+{
+
+// Streaming polyphase FIR resampler for a fixed rational rate conversion, e.g. 3:1 for
+// 48 kHz to 16 kHz or 441:160 for 44.1 kHz to 16 kHz. Equal rates are passed through.
+class PolyphaseResampler
+{
+public:
+    // Trades stopband attenuation and transition width for group delay and cost.
+    enum class Quality
+    {
+        kLow = 0,
+        kMedium,
+        kHigh
+    };
+
+    // Designs the filter tables for converting inputRate to outputRate and sizes the history
+    // for blocks of up to maxInputSamples. Allocates, so call it before playback.
+    void prepare (double inputRate, double outputRate, int maxInputSamples, Quality quality = Quality::kMedium);
+
+    // Clears the input history and restarts the phase.
+    void reset();
+
+    // Resamples numInputSamples into output and returns the number of samples written, at most
+    // maxOutputSamples. Input not needed for those outputs is kept for the next call, so blocks
+    // of any length stay phase continuous. When numInputSamples is a multiple of the conversion's
+    // input period, exactly numInputSamples * outputRate / inputRate samples are written.
+    int process (const float* input, int numInputSamples, float* output, int maxOutputSamples);
+
+    int getMaxOutputSamples (int numInputSamples) const;
+
+    // Group delay of the linear-phase filter in samples at the input rate.
+    double getLatencyInInputSamples() const;
+    bool isBypassed() const { return upFactor == downFactor; }
+    size_t getMemoryFootprint() const { return sizeof (float) * (coefficients.size() + history.size()); }
+
+private:
+    const float* getPhaseCoefficients (int phaseIndex) const
+    {
+        return coefficients.data() + static_cast<size_t> (phaseIndex) * numTaps;
+    }
+
+    // The conversion is outputRate / inputRate = upFactor / downFactor, in lowest terms.
+    int64_t upFactor = 1, downFactor = 1;
+    int numTaps = 0;
+    // Coefficients for numPhases fractional delays, numTaps each. When upFactor is too large for
+    // one table per phase, adjacent tables are interpolated and an extra closing table is stored.
+    int numPhases = 0;
+    bool interpolatePhases = false;
+    std::vector<float> coefficients;
+
+    // Input history followed by the current block, and the read position in it.
+    std::vector<float> history;
+    int numHistorySamples = 0;
+    int readIndex = 0;
+    // Fractional read position in units of 1 / upFactor input samples.
+    int64_t phase = 0;
+};
+
+} // namespace ddsp
@@ -24,35 +24,94 @@ FeatureExtractionModel::FeatureExtractionModel()
                  BinaryData::extract_features_micro_tfliteSize,
                  kNumFeatureExtractionThreads)
 {
+    jassert (getNumElements (*interpreter->input_tensor (0)) == kModelFrameSize);
+    if (interpreter->input_tensor (0)->type != kTfLiteFloat32)
+    {
+        quantizedInputStorage.resize (kModelFrameSize);
+        quantizedInputFrame = quantizedInputStorage.data();
+    }
+
+    // Output tensors are in the order pw_db, f0_hz, pw_scaled, f0_scaled.
+    jassert (interpreter->outputs().size() == 4);
+    bindTensors();
 }
 
-void FeatureExtractionModel::call (const juce::AudioBuffer<float>& audioInput, AudioFeatures& output)
+void FeatureExtractionModel::bindTensors()
 {
-    // Fill tensor with audio buffer.
-    for (int i = 0; i < audioInput.getNumSamples(); ++i)
+    inputTensor = TypedTensor::fromTensor (*interpreter->input_tensor (0));
+    inputBuffer = quantizedInputFrame != nullptr ? quantizedInputFrame : static_cast<float*> (inputTensor.data);
+
+    loudnessDb = TypedTensor::fromTensor (*interpreter->output_tensor (3));
+    f0Hz = TypedTensor::fromTensor (*interpreter->output_tensor (2));
+    loudnessNorm = TypedTensor::fromTensor (*interpreter->output_tensor (1));
+    f0Norm = TypedTensor::fromTensor (*interpreter->output_tensor (0));
+}
+
+void FeatureExtractionModel::placeTensors (MemoryArena& arena)
+{
+    std::vector<int> tensorIndices (interpreter->inputs().begin(), interpreter->inputs().end());
+    tensorIndices.insert (tensorIndices.end(), interpreter->outputs().begin(), interpreter->outputs().end());
+
+    bool placed = true;
+    for (const int tensorIndex : tensorIndices)
     {
-        interpreter->typed_input_tensor<float> (0)[i] = audioInput.getSample (0, i);
+        const size_t numBytes = interpreter->tensor (tensorIndex)->bytes;
+        void* data = arena.allocate (numBytes);
+        placed = placed
+                 && (arena.isMeasuring()
+                     || interpreter->SetCustomAllocationForTensor (tensorIndex, { data, numBytes }) == kTfLiteOk);
+    }
+    if (quantizedInputFrame != nullptr)
+    {
+        auto* frame = arena.allocate<float> (kModelFrameSize);
+        quantizedInputFrame = frame != nullptr ? frame : quantizedInputStorage.data();
     }
 
-    // Call model.
-    if (auto status = interpreter->Invoke(); status != kTfLiteOk)
+    if (arena.isMeasuring())
     {
-        std::cerr << "Failed to compute, status code: " << status << std::endl;
+        return;
     }
+    if (! placed)
+    {
+        // Tensors that were not moved keep their place in the TFLite arena.
+        DBG ("Feature extraction tensors not placed in the memory arena");
+    }
+    auto status = interpreter->AllocateTensors();
+    jassert (status == kTfLiteOk);
+    bindTensors();
+
+    // Lets the first invocation's lazy setup allocate here rather than on the render thread.
+    status = interpreter->Invoke();
+    jassert (status == kTfLiteOk);
+    juce::ignoreUnused (status);
+}
+
+void FeatureExtractionModel::call (const juce::AudioBuffer<float>& audioInput, AudioFeatures& output)
+{
+    // Fill tensor with audio buffer.
+    std::memcpy (inputBuffer, audioInput.getReadPointer (0), sizeof (float) * audioInput.getNumSamples());
+    process (output);
+}
 
-    std::vector<int> tensorIndices (interpreter->outputs().size());
+void FeatureExtractionModel::process (AudioFeatures& output)
+{
+    if (quantizedInputFrame != nullptr)
+    {
+        inputTensor.write (quantizedInputFrame, kModelFrameSize);
+    }
 
-    // pw_db, f0_hz, pw_scaled, f0_scaled
-    for (size_t i = 0; i < interpreter->outputs().size(); ++i)
+    // Call model.
+    const EventTracer::ScopedTrace trace (*tracer, "FeatureExtraction Invoke");
+    if (auto status = interpreter->Invoke(); status != kTfLiteOk)
     {
-        tensorIndices[i] = interpreter->outputs()[i];
+        logger->log (LogEvent::kFeatureExtractionInvokeFailed, status);
     }
 
-    output.loudness_db = *interpreter->typed_tensor<float> (tensorIndices[3]);
-    output.f0_hz = *interpreter->typed_tensor<float> (tensorIndices[2]);
+    loudnessDb.read (&output.loudness_db, 1);
+    f0Hz.read (&output.f0_hz, 1);
     // TODO: change loudness to power.
-    output.loudness_norm = *interpreter->typed_tensor<float> (tensorIndices[1]);
-    output.f0_norm = *interpreter->typed_tensor<float> (tensorIndices[0]);
+    loudnessNorm.read (&output.loudness_norm, 1);
+    f0Norm.read (&output.f0_norm, 1);
 }
 
 } // namespace ddsp
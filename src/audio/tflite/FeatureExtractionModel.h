@@ -18,17 +18,48 @@ limitations under the License.
 
 #include "JuceHeader.h"
 
+#include "audio/FeatureExtractor.h"
 #include "audio/tflite/ModelBase.h"
 #include "audio/tflite/ModelTypes.h"
+#include "audio/tflite/TypedTensor.h"
+#include "util/MemoryArena.h"
+#include "util/EventTracer.h"
+#include "util/RealtimeLogger.h"
 
 namespace ddsp
 {
 
-class FeatureExtractionModel : public ModelBase<juce::AudioBuffer<float>, AudioFeatures>
+class FeatureExtractionModel : public ModelBase<juce::AudioBuffer<float>, AudioFeatures>, public FeatureExtractor
 {
 public:
     FeatureExtractionModel();
     void call (const juce::AudioBuffer<float>& input, AudioFeatures& output) override;
+
+    // Input tensor memory of kModelFrameSize samples. Writing the frame here directly and
+    // calling process() avoids copying it into the tensor. Quantized models get a float frame
+    // instead, which process() converts.
+    float* getInputBuffer() override { return inputBuffer; }
+    // Runs the model on the frame currently held by the input tensor.
+    void process (AudioFeatures& output) override;
+
+    // Moves the input and output tensors into arena through TFLite custom allocations. Called in
+    // both layout passes of the arena, the frame is not preserved. Not real-time safe.
+    void placeTensors (MemoryArena& arena);
+
+private:
+    // Resolves the I/O tensors, which move when tensors are reallocated.
+    void bindTensors();
+
+    float* inputBuffer = nullptr;
+    TypedTensor inputTensor;
+    // Float frame of quantized models.
+    float* quantizedInputFrame = nullptr;
+    std::vector<float> quantizedInputStorage;
+    // pw_db, f0_hz, pw_scaled, f0_scaled
+    TypedTensor loudnessDb, f0Hz, loudnessNorm, f0Norm;
+
+    juce::SharedResourcePointer<RealtimeLogger> logger;
+    juce::SharedResourcePointer<EventTracer> tracer;
 };
 
 } // namespace ddsp
@@ -16,54 +16,109 @@ limitations under the License.
 
 #include "audio/tflite/InferencePipeline.h"
 #include "util/InputUtils.h"
+#include "util/RealtimeSanitizer.h"
 
 namespace ddsp
 {
 
 InferencePipeline::InferencePipeline (juce::AudioProcessorValueTreeState& t)
-    : tree (t),
-      inputRingBuffer (/*size=*/61440),
-      outputRingBuffer (/*size=*/61440),
-      noiseSynthesizer (kNoiseAmpsSize, kModelHopSize),
-      harmonicSynthesizer (kHarmonicsSize, kModelHopSize, kModelSampleRate_Hz)
+    : traceInstance (tracer->getNextInstanceId()),
+      tree (t),
+      modelPool (kModelPoolMemoryBudget_bytes),
+      noiseSynthesizer (kNoiseAmpsSize),
+      harmonicSynthesizer (kHarmonicsSize, kModelSampleRate_Hz)
 {
-    featureExtractionModel = std::make_unique<FeatureExtractionModel>();
+    params.attack = tree.getRawParameterValue ("Attack");
+    params.decay = tree.getRawParameterValue ("Decay");
+    params.sustain = tree.getRawParameterValue ("Sustain");
+    params.release = tree.getRawParameterValue ("Release");
+    params.pitchShift = tree.getRawParameterValue ("PitchShift");
+    params.inputPitch = tree.getRawParameterValue ("InputPitch");
+    params.inputGain = tree.getRawParameterValue ("InputGain");
+    params.harmonicGain = tree.getRawParameterValue ("HarmonicGain");
+    params.noiseGain = tree.getRawParameterValue ("NoiseGain");
+    params.featureExtractor = tree.getRawParameterValue ("FeatureExtractor");
+
+    // The synth is driven by MIDI alone and never needs the pitch detection model.
+    if (! JucePlugin_IsSynth)
+    {
+        featureExtractionModel = std::make_unique<FeatureExtractionModel>();
+    }
+    activeFeatureExtractor =
+        featureExtractionModel ? static_cast<FeatureExtractor*> (featureExtractionModel.get())
+                               : &nativeFeatureExtractor;
 }
 
-InferencePipeline::~InferencePipeline() {}
+InferencePipeline::~InferencePipeline() { stopTimer(); }
 
-void InferencePipeline::prepareToPlay (double sr, int samplesPerBlock)
+void InferencePipeline::prepareToPlay (double sr, int samplesPerBlock, bool synchronous)
 {
+    // The buffers move, so the render thread must not be running. The owner restarts it.
+    stopTimer();
     sampleRate = sr;
 
-    // Calculate the hopsize and framesize of the model at the
-    // user's sample rate in order to load the holding input buffer.
+    // The model hop rarely spans a whole number of samples at the user's sample rate,
+    // e.g. 22050 * 320 / 16000 = 441 but 47999 * 320 / 16000 = 959.98. The scheduler alternates
+    // between the nearest hop sizes so the hop boundaries never drift. The analysis frame is kept
+    // at the model sample rate, so each hop only the new samples are downsampled.
+    hopScheduler.prepare (sampleRate, kModelSampleRate_Hz, modelHopSize);
+    const int maxHopSize = hopScheduler.getMaxHopSize();
 
-    // The frame size is the amount that is copied for downsampling and is
-    // independent of the amount that is removed from the buffer after processing (hopsize).
-    // Use ceil to ensure there are enough samples to correctly perform downsampling later.
-    userFrameSize = static_cast<int> (ceil (sampleRate * kModelFrameSize / kModelSampleRate_Hz));
+    DBG ("User Sample Rate: " << sampleRate);
+    DBG ("User Max Hop Size: " << maxHopSize);
 
-    // If the hopsize of the model does not convert evenly to the user's sample rate, logic
-    // must be written to handle this when advancing the pointer in the holding input buffer.
-    // E.g. 44100 * 320 / 16000 = 882
-    // As is, this works with standard sample rates of 44.1k, 48k, 88.2k, 96k, 176.4k and 192k.
-    userHopSize = static_cast<int> (sampleRate * kModelHopSize / kModelSampleRate_Hz);
+    const int ringCapacity = AudioRingBuffer::getCapacityFor (sampleRate, samplesPerBlock, maxHopSize);
+    if (! JucePlugin_IsSynth)
+    {
+        inputResampler.prepare (sampleRate, kModelSampleRate_Hz, maxHopSize, resamplerQuality);
+        inputRingBuffer.prepare (1, ringCapacity, arenaOptions.lockPages);
+    }
+    outputResampler.prepare (kModelSampleRate_Hz, sampleRate, modelHopSize, resamplerQuality);
+    outputRingBuffer.prepare (1, ringCapacity, arenaOptions.lockPages);
 
-    DBG ("User Sample Rate: " << sampleRate);
-    DBG ("User Frame Size: " << userFrameSize);
-    DBG ("User Hop Size: " << userHopSize);
+    // The synth renders a hop as soon as the MIDI for it has arrived, so its output only has to
+    // wait for one hop. The timer thread additionally needs a host block and a timer period.
+    outputPrefillSize = 0;
+    if (JucePlugin_IsSynth)
+    {
+        outputPrefillSize = maxHopSize;
+        if (! synchronous)
+        {
+            outputPrefillSize += samplesPerBlock
+                                 + static_cast<int> (std::ceil (getRenderInterval_ms() / 1000.0 * sr));
+        }
+    }
+
+    // One allocation for all hot buffers, sized by a first layout pass.
+    arena.beginLayout();
+    allocateBuffers();
+    arena.commit (arenaOptions);
+    allocateBuffers();
+    DBG (getMemoryReport().toString());
 
-    modelInputBuffer.setSize (1, userFrameSize);
-    resampledModelInputBuffer.setSize (1, kModelFrameSize);
-    synthesisBuffer.setSize (1, kModelHopSize);
-    resampledModelOutputBuffer.setSize (1, userHopSize);
+    // Every hop renders modelHopSize samples at the model rate, whatever the host rate.
+    profiler.setHopBudget_us (1.0e6 * modelHopSize / kModelSampleRate_Hz);
+    profiler.reset();
 
-    midiInputProcessor.prepareToPlay (sampleRate, userHopSize);
+    // The envelope is clocked per model hop, which is a whole number of samples at the model rate.
+    midiInputProcessor.prepareToPlay (kModelSampleRate_Hz, modelHopSize);
 
     reset();
 }
 
+void InferencePipeline::allocateBuffers()
+{
+    synthesisBuffer = arena.allocate<float> (modelHopSize);
+    maxNumResampledSamples = outputResampler.getMaxOutputSamples (modelHopSize);
+    resampledModelOutputBuffer = arena.allocate<float> (maxNumResampledSamples);
+    harmonicSynthesizer.prepare (modelHopSize, arena);
+    noiseSynthesizer.prepare (modelHopSize, arena);
+    if (featureExtractionModel)
+    {
+        featureExtractionModel->placeTensors (arena);
+    }
+}
+
 void InferencePipeline::reset()
 {
     if (currentPredictControlsModel)
@@ -71,132 +126,360 @@ void InferencePipeline::reset()
         currentPredictControlsModel->reset();
     }
 
+    nativeFeatureExtractor.reset();
+    std::fill_n (activeFeatureExtractor->getInputBuffer(), kModelFrameSize, 0.0f);
+
     noiseSynthesizer.reset();
     harmonicSynthesizer.reset();
 
-    modelInputBuffer.clear();
-    synthesisBuffer.clear();
-    resampledModelInputBuffer.clear();
-    resampledModelOutputBuffer.clear();
-
-    inputRingBuffer.clear();
-    // Zero pad.
-    if (userFrameSize > 0)
+    if (synthesisBuffer != nullptr)
     {
-        juce::AudioBuffer<float> zeroBuf (1, userFrameSize);
-        zeroBuf.clear();
-        // Do we need to reset input/outputRingBuffer here?
-        inputRingBuffer.push (zeroBuf);
+        std::fill_n (synthesisBuffer, modelHopSize, 0.0f);
+        std::fill_n (resampledModelOutputBuffer, maxNumResampledSamples, 0.0f);
     }
 
+    inputResampler.reset();
+    outputResampler.reset();
+    hopScheduler.reset();
+
+    inputRingBuffer.clear();
     outputRingBuffer.clear();
+    numInputSamplesReceived.store (0);
+    numInputSamplesRendered = 0;
+    midiInputProcessor.reset (0);
 
-    inputInterpolator.reset();
-    outputInterpolator.reset();
+    if (JucePlugin_IsSynth && outputPrefillSize > 0)
+    {
+        outputRingBuffer.pushSilence (outputPrefillSize);
+    }
+    else if (! JucePlugin_IsSynth && sampleRate > 0.0)
+    {
+        // Zero pad. Together with the cleared analysis frame this renders the first hop from
+        // silence, as if a whole frame of zeros had been queued.
+        inputRingBuffer.pushSilence (hopScheduler.getNextHopSize());
+    }
+
+    numOverflows.store (0);
+    numUnderflows.store (0);
 }
 
 void InferencePipeline::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processMidi (midiMessages, buffer.getNumSamples());
+    pushInput (buffer.getReadPointer (0), buffer.getNumSamples());
+}
+
+void InferencePipeline::processBlockSynchronously (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+{
+    processMidi (midiMessages, buffer.getNumSamples());
+
+    // Chunks end at hop boundaries so each hop is rendered as soon as its input is complete.
+    // The rings then never hold more than a hop, whatever the host block size.
+    float* samples = buffer.getWritePointer (0);
+    for (int start = 0; start < buffer.getNumSamples();)
+    {
+        const int numToHopBoundary = std::max (1, hopScheduler.getNextHopSize() - getNumPendingInputSamples());
+        const int chunkSize = std::min (buffer.getNumSamples() - start, numToHopBoundary);
+
+        pushInput (samples + start, chunkSize);
+        render();
+        pullOutput (samples + start, chunkSize);
+
+        start += chunkSize;
+    }
+}
+
+void InferencePipeline::getNextBlock (juce::AudioBuffer<float>& bufferToFill)
+{
+    pullOutput (bufferToFill.getWritePointer (0), bufferToFill.getNumSamples());
+}
+
+void InferencePipeline::processMidi (const juce::MidiBuffer& midiMessages, int numSamples)
 {
     if (JucePlugin_IsSynth)
     {
-        midiInputProcessor.processMidiMessages (midiMessages);
+        midiInputProcessor.processMidiMessages (midiMessages, numSamples);
+    }
+}
 
-        // TODO: move this to slider callback
-        midiInputProcessor.setAttack (*tree.getRawParameterValue ("Attack"));
-        midiInputProcessor.setDecay (*tree.getRawParameterValue ("Decay"));
-        midiInputProcessor.setSustain (*tree.getRawParameterValue ("Sustain"));
-        midiInputProcessor.setRelease (*tree.getRawParameterValue ("Release"));
+void InferencePipeline::pushInput (const float* samples, int numSamples)
+{
+    if (JucePlugin_IsSynth)
+    {
+        // The synth has no audio input, only the passing time matters. Released after the
+        // block's MIDI events were queued, so the render thread sees them first.
+        numInputSamplesReceived.fetch_add (numSamples, std::memory_order_release);
+        return;
     }
 
-    inputRingBuffer.push (buffer);
+    // The ring keeps what fits, the rest of the block is lost.
+    if (const int freeSpace = inputRingBuffer.getFreeSpace(); freeSpace < numSamples)
+    {
+        numOverflows.fetch_add (1, std::memory_order_relaxed);
+        logger->log (LogEvent::kInputOverflow, numSamples, freeSpace);
+        tracer->instant ("input overflow", traceInstance);
+    }
+    inputRingBuffer.push (samples, numSamples);
 }
 
-void InferencePipeline::getNextBlock (juce::AudioBuffer<float>& bufferToFill)
+int InferencePipeline::getNumPendingInputSamples() const
+{
+    if (JucePlugin_IsSynth)
+    {
+        return static_cast<int> (numInputSamplesReceived.load (std::memory_order_acquire) - numInputSamplesRendered);
+    }
+    return inputRingBuffer.getNumReady();
+}
+
+void InferencePipeline::pullOutput (float* samples, int numSamples)
 {
-    if (outputRingBuffer.getNumReady() >= bufferToFill.getNumSamples())
+    if (const int numReady = outputRingBuffer.getNumReady(); numReady >= numSamples)
     {
-        outputRingBuffer.copy (bufferToFill);
-        outputRingBuffer.pop (bufferToFill.getNumSamples());
+        outputRingBuffer.copy (samples, numSamples);
+        outputRingBuffer.pop (numSamples);
     }
     else
     {
-        DBG ("Not enough samples (this rarely happens)");
+        // The render thread fell behind, output silence rather than a partial block.
+        juce::FloatVectorOperations::clear (samples, numSamples);
+        numUnderflows.fetch_add (1, std::memory_order_relaxed);
+        logger->log (LogEvent::kOutputUnderflow, numSamples, numReady);
+        // The trace shows what kept the render thread from keeping up.
+        tracer->instant ("output underflow", traceInstance);
+        tracer->requestDump();
     }
 }
 
 void InferencePipeline::render()
 {
-    if (swappingModel)
+    const RealtimeScope realtimeScope ("inference");
+    const EventTracer::ScopedTrace trace (*tracer, "render", traceInstance);
+
+    // Swap in the requested model at the hop boundary. If the message thread is busy
+    // building a model we keep rendering with the current one.
+    if (const juce::SpinLock::ScopedTryLockType lock (modelLock);
+        lock.isLocked() && nextPredictControlsModel != nullptr)
+    {
+        currentPredictControlsModel = std::exchange (nextPredictControlsModel, nullptr);
+        // Pooled models carry the GRU state from their last use.
+        currentPredictControlsModel->reset();
+        tracer->instant ("model swap", traceInstance);
+    }
+
+    if (currentPredictControlsModel == nullptr)
     {
-        currentPredictControlsModel = std::move (nextPredictControlsModel);
-        swappingModel = false;
+        return;
     }
 
-    while (inputRingBuffer.getNumReady() >= userFrameSize)
+    while (getNumPendingInputSamples() >= hopScheduler.getNextHopSize())
     {
+        const StageProfiler::ScopedStage hopStage (profiler, RenderStage::kHop);
+        const int hopSize = hopScheduler.getNextHopSize();
+
         if (JucePlugin_IsSynth)
         {
-            predictControlsInput = midiInputProcessor.getCurrentPredictControlsInput();
+            const StageProfiler::ScopedStage stage (profiler, RenderStage::kMidiControls);
+
+            // The envelope belongs to the render thread.
+            // TODO: move this to slider callback
+            midiInputProcessor.setAttack (*params.attack);
+            midiInputProcessor.setDecay (*params.decay);
+            midiInputProcessor.setSustain (*params.sustain);
+            midiInputProcessor.setRelease (*params.release);
+
+            predictControlsInput = midiInputProcessor.getCurrentPredictControlsInput (hopSize);
         }
         else
         {
-            // 2a: Downsample user frame's worth of input buffer.
-            jassert (modelInputBuffer.getNumSamples() == userFrameSize);
-            inputRingBuffer.copy (modelInputBuffer);
-            inputInterpolator.process (sampleRate / kModelSampleRate_Hz,
-                                       modelInputBuffer.getReadPointer (0),
-                                       resampledModelInputBuffer.getWritePointer (0),
-                                       resampledModelInputBuffer.getNumSamples());
-            jassert (resampledModelInputBuffer.getNumSamples() == kModelFrameSize);
-
-            // 2b: Run through the model.
-            featureExtractionModel->call (resampledModelInputBuffer, predictControlsInput);
+            auto& featureExtractor = getFeatureExtractor();
+
+            {
+                const StageProfiler::ScopedStage stage (profiler, RenderStage::kInputResample);
+
+                // 2a: Downsample the new hop of input, read in place from the ring buffer,
+                // straight onto the end of the extractor's frame.
+                const int numResampled = inputResampler.process (inputRingBuffer.getReadPointer (0, hopSize),
+                                                                 hopSize,
+                                                                 featureExtractor.shiftInputBuffer (modelHopSize),
+                                                                 modelHopSize);
+                jassert (numResampled == modelHopSize);
+                juce::ignoreUnused (numResampled);
+            }
+
+            // 2b: Extract pitch and loudness.
+            const StageProfiler::ScopedStage stage (profiler, RenderStage::kFeatureExtraction);
+            featureExtractor.process (predictControlsInput);
         }
 
         // Shift the pitch before the UI and model.
         predictControlsInput.f0_hz =
-            offsetPitch (predictControlsInput.f0_hz, *tree.getRawParameterValue ("PitchShift"));
+            offsetPitch (predictControlsInput.f0_hz, *params.pitchShift);
         predictControlsInput.f0_norm = normalizedPitch (predictControlsInput.f0_hz);
 
         // Store and scale the normalized pitch and loudness.
         currentPitch.store (predictControlsInput.f0_norm);
         currentRMS.store (predictControlsInput.loudness_norm);
-        predictControlsInput.f0_norm -= *tree.getRawParameterValue ("InputPitch");
-        predictControlsInput.loudness_norm -= *tree.getRawParameterValue ("InputGain");
+        predictControlsInput.f0_norm -= *params.inputPitch;
+        predictControlsInput.loudness_norm -= *params.inputGain;
 
-        currentPredictControlsModel->call (predictControlsInput, synthesisInput);
+        {
+            const StageProfiler::ScopedStage stage (profiler, RenderStage::kControlPrediction);
+            currentPredictControlsModel->call (predictControlsInput, synthesisInput);
+        }
 
-        synthesisInput.amplitude *= *tree.getRawParameterValue ("HarmonicGain");
+        synthesisInput.amplitude *= *params.harmonicGain;
         juce::FloatVectorOperations::multiply (
-            synthesisInput.noiseAmps.data(), *tree.getRawParameterValue ("NoiseGain"), synthesisInput.noiseAmps.size());
-
-        const auto& harmonicOutput =
-            harmonicSynthesizer.render (synthesisInput.harmonics, synthesisInput.amplitude, synthesisInput.f0_hz);
+            synthesisInput.noiseAmps.data(), *params.noiseGain, static_cast<int> (synthesisInput.noiseAmps.size()));
 
-        const auto& noiseOutput = noiseSynthesizer.render (synthesisInput.noiseAmps);
+        const float* harmonicOutput;
+        {
+            const StageProfiler::ScopedStage stage (profiler, RenderStage::kHarmonicSynthesis);
+            const EventTracer::ScopedTrace harmonicTrace (*tracer, "harmonic synthesis", traceInstance);
+            harmonicOutput = harmonicSynthesizer.render (
+                synthesisInput.harmonics.data(), synthesisInput.amplitude, synthesisInput.f0_hz);
+        }
 
-        for (int i = 0; i < synthesisBuffer.getNumSamples(); ++i)
+        const float* noiseOutput;
         {
-            synthesisBuffer.getWritePointer (0)[i] = harmonicOutput[i] + noiseOutput[i];
+            const StageProfiler::ScopedStage stage (profiler, RenderStage::kNoiseSynthesis);
+            const EventTracer::ScopedTrace noiseTrace (*tracer, "noise synthesis", traceInstance);
+            noiseOutput = noiseSynthesizer.render (synthesisInput.noiseAmps.data());
         }
 
-        outputInterpolator.process (kModelSampleRate_Hz / sampleRate,
-                                    synthesisBuffer.getReadPointer (0),
-                                    resampledModelOutputBuffer.getWritePointer (0),
-                                    resampledModelOutputBuffer.getNumSamples());
+        juce::FloatVectorOperations::add (synthesisBuffer, harmonicOutput, noiseOutput, modelHopSize);
+
+        int numUpsampled;
+        {
+            const StageProfiler::ScopedStage stage (profiler, RenderStage::kOutputResample);
+            // The number of output samples follows the hop size, the resampler keeps its phase across hops.
+            numUpsampled = outputResampler.process (
+                synthesisBuffer, modelHopSize, resampledModelOutputBuffer, maxNumResampledSamples);
+        }
         // 2d: Enqueue to outputRingBuffer.
-        outputRingBuffer.push (resampledModelOutputBuffer);
+        outputRingBuffer.push (resampledModelOutputBuffer, numUpsampled);
+
         // 2e: Dequeue hop size samples from input buffer.
-        inputRingBuffer.pop (userHopSize);
+        if (JucePlugin_IsSynth)
+        {
+            numInputSamplesRendered += hopSize;
+        }
+        else
+        {
+            inputRingBuffer.pop (hopSize);
+        }
+        hopScheduler.advance();
     }
 }
 
-void InferencePipeline::hiResTimerCallback() { render(); }
+void InferencePipeline::hiResTimerCallback()
+{
+    tracer->nameCurrentThread ("inference");
+    render();
+}
 
 void InferencePipeline::loadModel (const ModelInfo& mi)
 {
-    nextPredictControlsModel = std::make_unique<PredictControlsModel> (mi);
-    swappingModel = true;
+    const juce::SpinLock::ScopedLockType lock (modelLock);
+    nextPredictControlsModel = modelPool.acquire (mi, { currentPredictControlsModel });
+}
+
+void InferencePipeline::preloadModel (const ModelInfo& mi)
+{
+    const juce::SpinLock::ScopedLockType lock (modelLock);
+    modelPool.acquire (mi, { currentPredictControlsModel, nextPredictControlsModel });
+}
+
+bool InferencePipeline::isModelPooled (const ModelInfo& mi)
+{
+    const juce::SpinLock::ScopedLockType lock (modelLock);
+    return modelPool.find (mi) != nullptr;
+}
+
+void InferencePipeline::setModelPoolMemoryBudget (size_t bytes)
+{
+    const juce::SpinLock::ScopedLockType lock (modelLock);
+    modelPool.setMemoryBudget (bytes, { currentPredictControlsModel, nextPredictControlsModel });
+}
+
+FeatureExtractor& InferencePipeline::getFeatureExtractor()
+{
+    const auto* param = params.featureExtractor;
+    const bool useNative =
+        param != nullptr && static_cast<int> (*param) == static_cast<int> (FeatureExtractorType::kNative);
+    FeatureExtractor* selected = useNative ? static_cast<FeatureExtractor*> (&nativeFeatureExtractor)
+                                           : featureExtractionModel.get();
+
+    if (selected != activeFeatureExtractor)
+    {
+        std::copy_n (activeFeatureExtractor->getInputBuffer(), kModelFrameSize, selected->getInputBuffer());
+        activeFeatureExtractor = selected;
+    }
+    return *activeFeatureExtractor;
+}
+
+void InferencePipeline::setResamplerQuality (PolyphaseResampler::Quality quality) { resamplerQuality = quality; }
+
+void InferencePipeline::setModelHopSize (int hopSize)
+{
+    jassert (hopSize >= kMinModelHopSize && hopSize <= kModelHopSize);
+    modelHopSize = juce::jlimit (kMinModelHopSize, kModelHopSize, hopSize);
+}
+
+int InferencePipeline::getRenderInterval_ms() const
+{
+    // Render at least once per hop, so shorter hops are not held back by the timer.
+    const auto hop_ms = static_cast<int> (1000.0f * modelHopSize / kModelSampleRate_Hz);
+    return juce::jlimit (1, static_cast<int> (kModelInferenceTimerCallbackInterval_ms), hop_ms);
+}
+
+int InferencePipeline::getLatencySamples() const
+{
+    double latency = outputResampler.getLatencyInInputSamples() * sampleRate / kModelSampleRate_Hz;
+    if (JucePlugin_IsSynth)
+    {
+        latency += outputPrefillSize;
+    }
+    else
+    {
+        // The pitch detection model needs a full 64ms frame to get an accurate reading. The hop
+        // ending the frame is the part that has to be waited for, the rest is lookahead that
+        // shorter hops do not shrink.
+        latency += (kTotalInferenceLatency_ms / 1000.0) * sampleRate;
+        latency += static_cast<double> (modelHopSize - kModelHopSize) * sampleRate / kModelSampleRate_Hz;
+        latency += inputResampler.getLatencyInInputSamples();
+    }
+    return static_cast<int> (std::round (latency));
+}
+
+InferencePipeline::MemoryReport InferencePipeline::getMemoryReport()
+{
+    MemoryReport report;
+    report.arena = arena.getCapacity();
+    report.arenaUsed = arena.getNumBytesUsed();
+    report.arenaLocked = arena.isLocked();
+    report.arenaHugePages = arena.hasHugePages();
+    report.ringBuffers = inputRingBuffer.getMemoryFootprint() + outputRingBuffer.getMemoryFootprint();
+    report.resamplers = inputResampler.getMemoryFootprint() + outputResampler.getMemoryFootprint();
+    report.featureExtraction = nativeFeatureExtractor.getMemoryFootprint()
+                               + (featureExtractionModel ? featureExtractionModel->getMemoryFootprint() : 0);
+
+    const juce::SpinLock::ScopedLockType lock (modelLock);
+    report.modelPool = modelPool.getMemoryUsage();
+    return report;
+}
+
+juce::String InferencePipeline::MemoryReport::toString() const
+{
+    juce::String text;
+    text << "Memory: " << static_cast<juce::int64> (getTotal()) << " bytes" << juce::newLine;
+    text << "  arena: " << static_cast<juce::int64> (arena) << " (" << static_cast<juce::int64> (arenaUsed)
+         << " used" << (arenaLocked ? ", locked" : "") << (arenaHugePages ? ", huge pages" : "") << ")"
+         << juce::newLine;
+    text << "  ring buffers: " << static_cast<juce::int64> (ringBuffers) << juce::newLine;
+    text << "  resamplers: " << static_cast<juce::int64> (resamplers) << juce::newLine;
+    text << "  feature extraction: " << static_cast<juce::int64> (featureExtraction) << juce::newLine;
+    text << "  model pool: " << static_cast<juce::int64> (modelPool);
+    return text;
 }
 
 float InferencePipeline::getRMS() const { return currentRMS.load(); }
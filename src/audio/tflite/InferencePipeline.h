@@ -19,13 +19,21 @@ limitations under the License.
 #include "JuceHeader.h"
 
 #include "audio/AudioRingBuffer.h"
+#include "audio/FractionalHopScheduler.h"
 #include "audio/HarmonicSynthesizer.h"
 #include "audio/MidiInputProcessor.h"
+#include "audio/NativeFeatureExtractor.h"
 #include "audio/NoiseSynthesizer.h"
+#include "audio/PolyphaseResampler.h"
 #include "audio/tflite/FeatureExtractionModel.h"
 #include "audio/tflite/ModelBase.h"
 #include "audio/tflite/ModelLibrary.h"
+#include "audio/tflite/ModelPool.h"
 #include "audio/tflite/PredictControlsModel.h"
+#include "util/EventTracer.h"
+#include "util/MemoryArena.h"
+#include "util/RealtimeLogger.h"
+#include "util/StageProfiler.h"
 
 namespace ddsp
 {
@@ -36,51 +44,163 @@ public:
     InferencePipeline (juce::AudioProcessorValueTreeState& t);
     ~InferencePipeline() override;
 
-    void prepareToPlay (double sampleRate, int samplesPerBlock);
+    // synchronous is true when render() runs on the audio thread, see processBlockSynchronously().
+    void prepareToPlay (double sampleRate, int samplesPerBlock, bool synchronous);
     void reset();
 
+    // Queues the block for the render thread.
     void processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
+    // Renders on the calling thread and replaces the first channel of buffer with the output.
+    // Accepts blocks of any size.
+    void processBlockSynchronously (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages);
     void getNextBlock (juce::AudioBuffer<float>& bufferToFill);
     void render();
     void hiResTimerCallback() override;
 
+    // Switches to mi at the next hop boundary. Models kept warm in the pool are switched
+    // without rebuilding, otherwise the model is built on the calling thread first.
     void loadModel (const ModelInfo& mi);
+    // Builds mi into the pool without switching to it.
+    void preloadModel (const ModelInfo& mi);
+    bool isModelPooled (const ModelInfo& mi);
+    void setModelPoolMemoryBudget (size_t bytes);
+
+    // Resampling filter quality, takes effect at the next prepareToPlay().
+    void setResamplerQuality (PolyphaseResampler::Quality quality);
+    // Model samples per control frame, from kMinModelHopSize to kModelHopSize. Shorter hops lower
+    // the latency but run the control model more often. Takes effect at the next prepareToPlay().
+    void setModelHopSize (int hopSize);
+    int getModelHopSize() const { return modelHopSize; }
+    // Period of the render timer, at most one hop.
+    int getRenderInterval_ms() const;
+    // Total plugin latency at the prepared sample rate, including the resampling filters.
+    int getLatencySamples() const;
+
+    // Blocks that did not fit the input ring, and blocks output as silence because the
+    // render thread fell behind, since the last reset().
+    int getNumOverflows() const { return numOverflows.load (std::memory_order_relaxed); }
+    int getNumUnderflows() const { return numUnderflows.load (std::memory_order_relaxed); }
+
+    // Placement of the per-instance memory arena, takes effect at the next prepareToPlay().
+    void setMemoryArenaOptions (const MemoryArena::Options& options) { arenaOptions = options; }
+
+    // Memory owned by this instance, in bytes.
+    struct MemoryReport
+    {
+        // Scratch, synthesis and feature extraction I/O buffers.
+        size_t arena = 0;
+        size_t arenaUsed = 0;
+        bool arenaLocked = false;
+        bool arenaHugePages = false;
+        // Mirrored mappings of their own, which an arena cannot share.
+        size_t ringBuffers = 0;
+        size_t resamplers = 0;
+        // Working memory of both feature extractors, including the TFLite arena of the model.
+        size_t featureExtraction = 0;
+        // Every pooled control model.
+        size_t modelPool = 0;
+
+        size_t getTotal() const { return arena + ringBuffers + resamplers + featureExtraction + modelPool; }
+        juce::String toString() const;
+    };
+
+    // Takes the model lock, call it off the audio thread.
+    MemoryReport getMemoryReport();
+
+    // Per-stage timings of render(), see StageProfiler. Off by default, lock-free to read.
+    // Cleared by prepareToPlay().
+    void setProfilingEnabled (bool shouldBeEnabled) { profiler.setEnabled (shouldBeEnabled); }
+    bool isProfilingEnabled() const { return profiler.isEnabled(); }
+    StageProfiler::Report getRenderTimings() const { return profiler.getReport(); }
+    void resetRenderTimings() { profiler.reset(); }
+
+    // Tags the events this instance records in the process-wide EventTracer.
+    uint32_t getTraceInstance() const { return traceInstance; }
 
     float getRMS() const;
     float getPitch() const;
 
 private:
-    int userFrameSize = 0;
-    int userHopSize = 0;
+    // Takes every hot buffer from the arena. Run once to measure and once to place them.
+    void allocateBuffers();
+
+    void processMidi (const juce::MidiBuffer& midiMessages, int numSamples);
+    void pushInput (const float* samples, int numSamples);
+    void pullOutput (float* samples, int numSamples);
+    // Host samples received but not rendered yet. The effect counts its queued audio,
+    // the synth only the elapsed MIDI time.
+    int getNumPendingInputSamples() const;
+
+    // Extractor selected by the "FeatureExtractor" parameter. On a switch the analysis frame
+    // is carried over so streaming continues without a gap.
+    FeatureExtractor& getFeatureExtractor();
+
     double sampleRate = 0.0;
+    int modelHopSize = kModelHopSize;
+    FractionalHopScheduler hopScheduler;
 
     std::atomic<float> currentPitch = { 0.0f };
     std::atomic<float> currentRMS = { 0.0f };
-    std::atomic<bool> swappingModel = false;
-
-    void changeModel();
+    std::atomic<int> numOverflows = { 0 };
+    std::atomic<int> numUnderflows = { 0 };
+    juce::SharedResourcePointer<RealtimeLogger> logger;
+    juce::SharedResourcePointer<EventTracer> tracer;
+    const uint32_t traceInstance;
+    StageProfiler profiler;
 
     // Param state.
     juce::AudioProcessorValueTreeState& tree;
+    // Parameters read every hop, resolved once since looking them up by name allocates.
+    // The envelope parameters only exist in the synth, the feature extractor choice only in the effect.
+    struct Parameters
+    {
+        std::atomic<float>* attack = nullptr;
+        std::atomic<float>* decay = nullptr;
+        std::atomic<float>* sustain = nullptr;
+        std::atomic<float>* release = nullptr;
+        std::atomic<float>* pitchShift = nullptr;
+        std::atomic<float>* inputPitch = nullptr;
+        std::atomic<float>* inputGain = nullptr;
+        std::atomic<float>* harmonicGain = nullptr;
+        std::atomic<float>* noiseGain = nullptr;
+        std::atomic<float>* featureExtractor = nullptr;
+    } params;
 
     // DSP components.
-    juce::WindowedSincInterpolator inputInterpolator;
-    juce::WindowedSincInterpolator outputInterpolator;
+    PolyphaseResampler inputResampler;
+    PolyphaseResampler outputResampler;
+    PolyphaseResampler::Quality resamplerQuality = PolyphaseResampler::Quality::kMedium;
+
+    // Backs the scratch buffers, the synthesizers and the feature extraction model's I/O tensors.
+    MemoryArena arena;
+    MemoryArena::Options arenaOptions;
 
-    // Scratch buffers.
-    juce::AudioBuffer<float> modelInputBuffer;
-    juce::AudioBuffer<float> synthesisBuffer;
-    juce::AudioBuffer<float> resampledModelInputBuffer;
-    juce::AudioBuffer<float> resampledModelOutputBuffer;
+    // Scratch buffers in the arena, one hop at the model rate and its resampled size.
+    float* synthesisBuffer = nullptr;
+    float* resampledModelOutputBuffer = nullptr;
+    int maxNumResampledSamples = 0;
 
     // FIFOs.
     AudioRingBuffer inputRingBuffer;
     AudioRingBuffer outputRingBuffer;
+    // Silence queued ahead of the synth's output, which is all of its latency.
+    int outputPrefillSize = 0;
+
+    // Synth clock, written by the audio thread and read by the render thread.
+    std::atomic<int64_t> numInputSamplesReceived = { 0 };
+    int64_t numInputSamplesRendered = 0;
 
-    // TF models.
+    // TF models. The synth has no feature extraction model.
     std::unique_ptr<FeatureExtractionModel> featureExtractionModel;
-    std::unique_ptr<PredictControlsModel> currentPredictControlsModel;
-    std::unique_ptr<PredictControlsModel> nextPredictControlsModel;
+    NativeFeatureExtractor nativeFeatureExtractor;
+    // Holds the current 16 kHz analysis frame in its input buffer.
+    FeatureExtractor* activeFeatureExtractor = nullptr;
+    // Owns every PredictControlsModel, the pointers below reference pooled models.
+    ModelPool modelPool;
+    // Guards the pool and nextPredictControlsModel. The render thread only ever try-locks it.
+    juce::SpinLock modelLock;
+    PredictControlsModel* currentPredictControlsModel = nullptr;
+    PredictControlsModel* nextPredictControlsModel = nullptr;
 
     // Synthesis.
     NoiseSynthesizer noiseSynthesizer;
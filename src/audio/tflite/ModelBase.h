@@ -18,10 +18,13 @@ limitations under the License.
 
 #include "JuceHeader.h"
 
+#include "audio/tflite/ModelDescription.h"
+#include "audio/tflite/TypedTensor.h"
+#include "audio/tflite/XNNPackDelegate.h"
+
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/kernels/register.h"
 #include "tensorflow/lite/model.h"
-#include "tensorflow/lite/optional_debug_tools.h"
 
 namespace ddsp
 {
@@ -30,67 +33,91 @@ template <typename Input, typename Output>
 class ModelBase
 {
 public:
-    ModelBase (const char* modelDataPtr, size_t dataSize, int numThreads)
+    ModelBase (const char* modelDataPtr, size_t dataSize, int numThreads) : numInterpreterThreads (numThreads)
     {
         modelBuffer = tflite::FlatBufferModel::VerifyAndBuildFromBuffer (modelDataPtr, dataSize);
         jassert (modelBuffer != nullptr);
 
-        tflite::ops::builtin::BuiltinOpResolver resolver;
-        tflite::InterpreterBuilder builder (*modelBuffer, resolver);
-
-        builder.SetNumThreads (numThreads);
-        auto status = builder (&interpreter);
-        jassert (status == kTfLiteOk);
-        jassert (interpreter != nullptr);
-
-        status = interpreter->AllocateTensors();
+        interpreter = buildInterpreter();
+        auto status = interpreter->AllocateTensors();
         jassert (status == kTfLiteOk);
     }
 
     virtual ~ModelBase() = default;
 
-    // Describe the model's inputs and outputs.
-    void describe()
+    // Tensors, memory and execution plan of the model. With numProfiledInvocations > 0 the model
+    // is also invoked that many times to time its ops, see profileInterpreter(). Not real-time safe.
+    virtual ModelDescription describe (int numProfiledInvocations = 0)
     {
-        tflite::PrintInterpreterState (interpreter.get());
+        auto description = describeInterpreter (*interpreter);
+        profileInterpreter (*interpreter, numProfiledInvocations, description);
+        return description;
+    }
 
-        // Inspect inputs.
-        DBG ("Interpreter num inputs: " << interpreter->inputs().size() << "\n");
+    // Approximate memory owned by the interpreter, excluding the read-only weights
+    // which are mapped from the model data and tensors placed in custom allocations.
+    virtual size_t getMemoryFootprint() const
+    {
+        return interpreter != nullptr ? getInterpreterFootprint (*interpreter) : 0;
+    }
 
-        for (int i = 0; i < interpreter->inputs().size(); ++i)
-        {
-            const char* inputName = interpreter->GetInputName (i);
-            auto type = interpreter->input_tensor (i)->type;
-            auto size = interpreter->input_tensor (i)->bytes / sizeof (type);
-            const int tensorIndex = interpreter->inputs()[i];
-
-            DBG ("Input name: " << inputName);
-            DBG ("Input size: " << size);
-            DBG ("Input type: " << TfLiteTypeGetName (type));
-            DBG ("Input tensor idx: " << tensorIndex << "\n");
-        }
+    // TODO: return error code.
+    virtual void call (const Input& input, Output& output) = 0;
 
-        // Inspect outputs.
-        DBG ("Interpreter num outputs: " << interpreter->outputs().size() << "\n");
+protected:
+    // Builds an interpreter of the model with the delegate applied. Its tensors are not allocated
+    // yet, so custom allocations can still be set. Not real-time safe.
+    std::unique_ptr<tflite::Interpreter> buildInterpreter()
+    {
+        // Delegates are applied explicitly below instead of by the resolver.
+        tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+        tflite::InterpreterBuilder builder (*modelBuffer, resolver);
+#if DDSP_ENABLE_XNNPACK
+        // The ops XNNPACK leaves to TFLite run on the invoking thread, so a second pool does not
+        // compete with the shared one for the cores.
+        builder.SetNumThreads (xnnpack->isEnabled() ? 1 : numInterpreterThreads);
+#else
+        builder.SetNumThreads (numInterpreterThreads);
+#endif
+
+        std::unique_ptr<tflite::Interpreter> result;
+        auto status = builder (&result);
+        jassert (status == kTfLiteOk);
+        jassert (result != nullptr);
 
-        for (int i = 0; i < interpreter->outputs().size(); ++i)
+#if DDSP_ENABLE_XNNPACK
+        if (xnnpack->isEnabled() && ! xnnpack->apply (*result))
         {
-            const char* outputName = interpreter->GetOutputName (i);
-            auto type = interpreter->output_tensor (i)->type;
-            auto size = interpreter->output_tensor (i)->bytes / sizeof (type);
-            const int tensorIndex = interpreter->outputs()[i];
-
-            DBG ("Output name: " << outputName);
-            DBG ("Output size: " << size);
-            DBG ("Output type: " << TfLiteTypeGetName (type));
-            DBG ("Output tensor idx: " << tensorIndex << "\n");
+            // A failed delegation can leave the graph half modified, start over without it.
+            result.reset();
+            builder.SetNumThreads (numInterpreterThreads);
+            status = builder (&result);
+            jassert (status == kTfLiteOk);
         }
+#endif
+        juce::ignoreUnused (status);
+        return result;
     }
 
-    // TODO: return error code.
-    virtual void call (const Input& input, Output& output) = 0;
+    static size_t getInterpreterFootprint (const tflite::Interpreter& target)
+    {
+        size_t bytes = 0;
+        for (size_t i = 0; i < target.tensors_size(); ++i)
+        {
+            const TfLiteTensor* tensor = target.tensor (static_cast<int> (i));
+            if (tensor->allocation_type != kTfLiteMmapRo && tensor->allocation_type != kTfLiteCustom)
+            {
+                bytes += tensor->bytes;
+            }
+        }
+        return bytes;
+    }
 
-protected:
+#if DDSP_ENABLE_XNNPACK
+    // Declared first so the delegate outlives the interpreters.
+    juce::SharedResourcePointer<XNNPackDelegate> xnnpack;
+#endif
+    const int numInterpreterThreads;
     std::unique_ptr<tflite::FlatBufferModel> modelBuffer;
     std::unique_ptr<tflite::Interpreter> interpreter;
 };
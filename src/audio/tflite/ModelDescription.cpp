@@ -0,0 +1,309 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+The arena planner packs intermediate tensors with overlapping lifetimes into
+one buffer, so summing their sizes overstates it. The arena size is instead
+the span from the lowest to the highest address of its tensors.
+
+While a profiler is attached, the interpreter records one operator event
+per node of the execution plan per invocation, with the node index as
+metadata and the subgraph index as extra metadata. A delegate node is a
+single event, whatever the delegate does inside it.
+*/
+
+#include "audio/tflite/ModelDescription.h"
+
+#include "tensorflow/lite/profiling/buffered_profiler.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace ddsp
+{
+
+namespace
+{
+    const char* getAllocationName (TfLiteAllocationType type)
+    {
+        switch (type)
+        {
+            case kTfLiteMmapRo:
+                return "weights";
+            case kTfLiteArenaRw:
+                return "arena";
+            case kTfLiteArenaRwPersistent:
+                return "persistent";
+            case kTfLiteDynamic:
+                return "dynamic";
+            case kTfLiteCustom:
+                return "custom";
+            default:
+                return "other";
+        }
+    }
+
+    ModelDescription::Tensor describeTensor (const tflite::Interpreter& interpreter, int index)
+    {
+        const TfLiteTensor& tensor = *interpreter.tensor (index);
+        ModelDescription::Tensor description;
+        description.name = tensor.name != nullptr ? tensor.name : "";
+        description.index = index;
+        description.type = TfLiteTypeGetName (tensor.type);
+        if (tensor.dims != nullptr)
+        {
+            description.shape.assign (tensor.dims->data, tensor.dims->data + tensor.dims->size);
+        }
+        description.bytes = tensor.bytes;
+        if (tensor.type == kTfLiteInt8 || tensor.type == kTfLiteUInt8)
+        {
+            description.scale = tensor.params.scale;
+            description.zeroPoint = tensor.params.zero_point;
+        }
+        description.allocation = getAllocationName (tensor.allocation_type);
+        return description;
+    }
+
+    double getPercentile (const std::vector<double>& sorted, double fraction)
+    {
+        const auto rank = static_cast<size_t> (std::ceil (fraction * static_cast<double> (sorted.size())));
+        return sorted[std::clamp<size_t> (rank, 1, sorted.size()) - 1];
+    }
+
+    juce::var toVar (const ModelDescription::Tensor& tensor)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty ("name", tensor.name);
+        object->setProperty ("index", tensor.index);
+        object->setProperty ("type", tensor.type);
+        juce::Array<juce::var> shape;
+        for (const int dimension : tensor.shape)
+        {
+            shape.add (dimension);
+        }
+        object->setProperty ("shape", shape);
+        object->setProperty ("bytes", static_cast<juce::int64> (tensor.bytes));
+        if (tensor.scale > 0.0f)
+        {
+            object->setProperty ("scale", tensor.scale);
+            object->setProperty ("zeroPoint", static_cast<int> (tensor.zeroPoint));
+        }
+        object->setProperty ("allocation", tensor.allocation);
+        return object;
+    }
+
+    juce::var toVar (const ModelDescription::Op& op)
+    {
+        auto* object = new juce::DynamicObject();
+        object->setProperty ("node", op.nodeIndex);
+        object->setProperty ("name", op.name);
+        object->setProperty ("delegated", op.delegated);
+        object->setProperty ("originalOps", op.numOriginalOps);
+        if (op.numInvocations > 0)
+        {
+            object->setProperty ("invocations", op.numInvocations);
+            object->setProperty ("totalTime_us", op.totalTime_us);
+            object->setProperty ("meanTime_us", op.getMeanTime_us());
+        }
+        return object;
+    }
+} // namespace
+
+ModelDescription describeInterpreter (const tflite::Interpreter& interpreter)
+{
+    ModelDescription description;
+    for (const int index : interpreter.inputs())
+    {
+        description.inputs.push_back (describeTensor (interpreter, index));
+    }
+    for (const int index : interpreter.outputs())
+    {
+        description.outputs.push_back (describeTensor (interpreter, index));
+    }
+
+    // Address range of each arena.
+    std::map<TfLiteAllocationType, std::pair<uintptr_t, uintptr_t>> arenaRanges;
+    for (size_t i = 0; i < interpreter.tensors_size(); ++i)
+    {
+        const TfLiteTensor& tensor = *interpreter.tensor (static_cast<int> (i));
+        if (tensor.allocation_type == kTfLiteMmapRo)
+        {
+            description.weightBytes += tensor.bytes;
+        }
+        else if ((tensor.allocation_type == kTfLiteArenaRw || tensor.allocation_type == kTfLiteArenaRwPersistent)
+                 && tensor.data.raw != nullptr && tensor.bytes > 0)
+        {
+            const auto begin = reinterpret_cast<uintptr_t> (tensor.data.raw);
+            auto& range = arenaRanges.try_emplace (tensor.allocation_type, begin, begin + tensor.bytes).first->second;
+            range.first = std::min (range.first, begin);
+            range.second = std::max (range.second, begin + tensor.bytes);
+        }
+    }
+    for (const auto& [type, range] : arenaRanges)
+    {
+        (type == kTfLiteArenaRw ? description.arenaBytes : description.persistentArenaBytes) =
+            range.second - range.first;
+    }
+
+    for (const int nodeIndex : interpreter.execution_plan())
+    {
+        const auto* nodeAndRegistration = interpreter.node_and_registration (nodeIndex);
+        const TfLiteNode& node = nodeAndRegistration->first;
+        const TfLiteRegistration& registration = nodeAndRegistration->second;
+
+        ModelDescription::Op op;
+        op.nodeIndex = nodeIndex;
+        if (node.delegate != nullptr)
+        {
+            // Delegate kernels are registered under the delegate's name.
+            op.name = registration.custom_name != nullptr ? registration.custom_name : "delegate";
+            op.delegated = true;
+            op.numOriginalOps = static_cast<const TfLiteDelegateParams*> (node.builtin_data)->nodes_to_replace->size;
+            description.numDelegatedOps += op.numOriginalOps;
+        }
+        else if (registration.builtin_code == tflite::BuiltinOperator_CUSTOM)
+        {
+            op.name = registration.custom_name != nullptr ? registration.custom_name : "custom";
+        }
+        else
+        {
+            const auto code = static_cast<tflite::BuiltinOperator> (registration.builtin_code);
+            op.name = tflite::EnumNameBuiltinOperator (code);
+        }
+        description.numOriginalOps += op.numOriginalOps;
+        description.ops.push_back (op);
+    }
+    return description;
+}
+
+void profileInterpreter (tflite::Interpreter& interpreter, int numInvocations, ModelDescription& description)
+{
+    if (numInvocations <= 0)
+    {
+        return;
+    }
+
+    // One event per node and one for the invocation itself, each time.
+    const auto numEntries = static_cast<uint32_t> ((description.ops.size() + 1) * numInvocations);
+    tflite::profiling::BufferedProfiler profiler (numEntries, /*allow_dynamic_buffer_increase=*/true);
+    interpreter.SetProfiler (&profiler);
+
+    std::vector<double> invokeTimes_us;
+    invokeTimes_us.reserve (static_cast<size_t> (numInvocations));
+    profiler.StartProfiling();
+    for (int i = 0; i < numInvocations; ++i)
+    {
+        const auto start = juce::Time::getHighResolutionTicks();
+        interpreter.Invoke();
+        invokeTimes_us.push_back (
+            1.0e6 * juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start));
+    }
+    profiler.StopProfiling();
+    interpreter.SetProfiler (nullptr);
+
+    std::map<int64_t, ModelDescription::Op*> opsByNode;
+    for (auto& op : description.ops)
+    {
+        op.numInvocations = 0;
+        op.totalTime_us = 0.0;
+        opsByNode[op.nodeIndex] = &op;
+    }
+    for (const auto* event : profiler.GetProfileEvents())
+    {
+        if (event->event_type != tflite::Profiler::EventType::OPERATOR_INVOKE_EVENT
+            || event->extra_event_metadata != 0)
+        {
+            continue;
+        }
+        if (const auto found = opsByNode.find (event->event_metadata); found != opsByNode.end())
+        {
+            ++found->second->numInvocations;
+            found->second->totalTime_us += static_cast<double> (event->elapsed_time);
+        }
+    }
+
+    description.setInvokeTimes (std::move (invokeTimes_us));
+}
+
+void ModelDescription::setInvokeTimes (std::vector<double> times_us)
+{
+    numProfiledInvocations = static_cast<int> (times_us.size());
+    if (times_us.empty())
+    {
+        return;
+    }
+    std::sort (times_us.begin(), times_us.end());
+    invokeP50_us = getPercentile (times_us, 0.5);
+    invokeP99_us = getPercentile (times_us, 0.99);
+    invokeMax_us = times_us.back();
+    invokeMean_us = std::accumulate (times_us.begin(), times_us.end(), 0.0) / static_cast<double> (times_us.size());
+}
+
+juce::var ModelDescription::toVar() const
+{
+    auto* object = new juce::DynamicObject();
+    object->setProperty ("name", name);
+    object->setProperty ("engine", engine);
+
+    juce::Array<juce::var> inputTensors, outputTensors, opList;
+    for (const auto& tensor : inputs)
+    {
+        inputTensors.add (ddsp::toVar (tensor));
+    }
+    for (const auto& tensor : outputs)
+    {
+        outputTensors.add (ddsp::toVar (tensor));
+    }
+    for (const auto& op : ops)
+    {
+        opList.add (ddsp::toVar (op));
+    }
+    object->setProperty ("inputs", inputTensors);
+    object->setProperty ("outputs", outputTensors);
+
+    object->setProperty ("arenaBytes", static_cast<juce::int64> (arenaBytes));
+    object->setProperty ("persistentArenaBytes", static_cast<juce::int64> (persistentArenaBytes));
+    object->setProperty ("weightBytes", static_cast<juce::int64> (weightBytes));
+
+    object->setProperty ("originalOps", numOriginalOps);
+    object->setProperty ("delegatedOps", numDelegatedOps);
+    object->setProperty ("delegateCoverage", getDelegateCoverage());
+    object->setProperty ("ops", opList);
+
+    if (numProfiledInvocations > 0)
+    {
+        auto* invoke = new juce::DynamicObject();
+        invoke->setProperty ("invocations", numProfiledInvocations);
+        invoke->setProperty ("p50_us", invokeP50_us);
+        invoke->setProperty ("p99_us", invokeP99_us);
+        invoke->setProperty ("max_us", invokeMax_us);
+        invoke->setProperty ("mean_us", invokeMean_us);
+        object->setProperty ("invoke", invoke);
+    }
+    return object;
+}
+
+juce::String ModelDescription::toJson() const { return juce::JSON::toString (toVar()); }
+
+juce::String toJson (const std::vector<ModelDescription>& descriptions)
+{
+    juce::Array<juce::var> models;
+    for (const auto& description : descriptions)
+    {
+        models.add (description.toVar());
+    }
+    return juce::JSON::toString (models);
+}
+
+} // namespace ddsp
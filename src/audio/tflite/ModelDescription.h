@@ -0,0 +1,106 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "tensorflow/lite/interpreter.h"
+
+namespace ddsp
+{
+
+// What a model's interpreter looks like and costs: its I/O tensors, memory, execution plan,
+// delegate coverage and, if it was profiled, per-op timings. Serializes to JSON for offline
+// analysis, e.g. to check that a custom model fits the CPU budget of a track.
+struct ModelDescription
+{
+    struct Tensor
+    {
+        juce::String name;
+        int index = -1;
+        juce::String type;
+        std::vector<int> shape;
+        size_t bytes = 0;
+        // Per-tensor quantization, scale 0 if the tensor is not quantized.
+        float scale = 0.0f;
+        int32_t zeroPoint = 0;
+        // Where the data lives: "weights", "arena", "persistent", "dynamic" or "custom".
+        juce::String allocation;
+    };
+
+    // Node of the execution plan.
+    struct Op
+    {
+        int nodeIndex = -1;
+        // Builtin operator, or the delegate's name for delegate nodes.
+        juce::String name;
+        bool delegated = false;
+        // Ops of the original graph this node runs, more than 1 for delegate nodes.
+        int numOriginalOps = 1;
+        // Over the profiling window, a delegate node is timed as a whole.
+        int64_t numInvocations = 0;
+        double totalTime_us = 0.0;
+
+        double getMeanTime_us() const { return numInvocations > 0 ? totalTime_us / numInvocations : 0.0; }
+    };
+
+    juce::String name;
+    // "TFLite", or "native" if NativeControlEngine runs the model. Ops are always TFLite's.
+    juce::String engine = "TFLite";
+    std::vector<Tensor> inputs;
+    std::vector<Tensor> outputs;
+
+    // Span of the interpreter's tensor arena, intermediate tensors share it.
+    size_t arenaBytes = 0;
+    size_t persistentArenaBytes = 0;
+    // Read-only weights, mapped from the model data.
+    size_t weightBytes = 0;
+
+    std::vector<Op> ops;
+    int numOriginalOps = 0;
+    int numDelegatedOps = 0;
+
+    // Whole invocations over the profiling window, on the engine that runs the model.
+    int numProfiledInvocations = 0;
+    double invokeP50_us = 0.0;
+    double invokeP99_us = 0.0;
+    double invokeMax_us = 0.0;
+    double invokeMean_us = 0.0;
+
+    // Fraction of the original ops run by a delegate.
+    double getDelegateCoverage() const
+    {
+        return numOriginalOps > 0 ? static_cast<double> (numDelegatedOps) / numOriginalOps : 0.0;
+    }
+    // Sets the invocation statistics from one duration per invocation.
+    void setInvokeTimes (std::vector<double> times_us);
+
+    juce::var toVar() const;
+    juce::String toJson() const;
+};
+
+// Tensors, memory and execution plan of the interpreter's primary subgraph.
+ModelDescription describeInterpreter (const tflite::Interpreter& interpreter);
+
+// Invokes the interpreter numInvocations times with tflite::profiling::BufferedProfiler attached
+// and adds the per-op and per-invocation timings to description. Not real-time safe. Whatever
+// the invocations leave in the tensors, e.g. recurrent state, is up to the caller to reset.
+void profileInterpreter (tflite::Interpreter& interpreter, int numInvocations, ModelDescription& description);
+
+juce::String toJson (const std::vector<ModelDescription>& descriptions);
+
+} // namespace ddsp
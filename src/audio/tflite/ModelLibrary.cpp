@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #include "audio/tflite/ModelLibrary.h"
+#include "audio/tflite/PredictControlsModel.h"
 #include "util/Constants.h"
 
 #include "tensorflow/lite/interpreter.h"
@@ -122,10 +123,12 @@ void ModelLibrary::searchPathForModels()
 
         for (auto& m : modelArray)
         {
-            ModelInfo modelInfo (m.getFileNameWithoutExtension(),
-                                 loadModelTimestamp (m.loadFileAsString().toRawUTF8(), m.getSize()),
-                                 m.loadFileAsString().toRawUTF8(),
-                                 m.getSize());
+            // Binary, a string would end at the first zero byte of the weights.
+            juce::MemoryBlock data;
+            m.loadFileAsData (data);
+            const auto* bytes = static_cast<const char*> (data.getData());
+            ModelInfo modelInfo (
+                m.getFileNameWithoutExtension(), loadModelTimestamp (bytes, data.getSize()), bytes, data.getSize());
 
             if (validateModel (modelInfo))
                 models.emplace_back (modelInfo);
@@ -167,166 +170,70 @@ juce::String ModelLibrary::loadModelTimestamp (const char* modelDataPtr, size_t
     return "";
 }
 
-bool ModelLibrary::validateModel (ModelInfo modelInfo)
+bool ModelLibrary::validateModel (const ModelInfo& modelInfo)
 {
     juce::StringArray errorMsg;
+    if (! validateModel (modelInfo, errorMsg))
+    {
+        showAlertWindow (modelInfo.name, errorMsg);
+        return false;
+    }
+    return true;
+}
 
+bool ModelLibrary::validateModel (const ModelInfo& modelInfo, juce::StringArray& errors)
+{
     std::unique_ptr<tflite::FlatBufferModel> modelBuffer;
     std::unique_ptr<tflite::Interpreter> interpreter;
-    tflite::ops::builtin::BuiltinOpResolver resolver;
+    tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
 
     // Check if the model is able to load.
     modelBuffer = tflite::FlatBufferModel::VerifyAndBuildFromBuffer (modelInfo.data.begin(), modelInfo.data.getSize());
 
     if (modelBuffer == nullptr)
     {
-        errorMsg.add ("Invalid .tflite file.\n");
-        showAlertWindow (modelInfo.name, errorMsg);
+        errors.add ("Invalid .tflite file.\n");
         return false;
     }
 
     // Continue setting up model.
     tflite::InterpreterBuilder initBuilder (*modelBuffer, resolver);
     initBuilder (&interpreter);
-    jassert (interpreter != nullptr);
-
-    interpreter->SetNumThreads (1);
-    jassert (interpreter->AllocateTensors() == kTfLiteOk);
-
-    // Check if model has correct number of I/O tensors.
-    if (interpreter->inputs().size() != kNumPredictControlsInputTensors)
+    if (interpreter == nullptr)
     {
-        errorMsg.add ("Invalid number of input tensors: " + std::to_string (interpreter->inputs().size()) + "\n");
-    }
-
-    if (interpreter->outputs().size() != kNumPredictControlsOutputTensors)
-    {
-        errorMsg.add ("Invalid number of output tensors: " + std::to_string (interpreter->outputs().size()) + "\n");
-    }
-
-    if (! errorMsg.isEmpty())
-    {
-        showAlertWindow (modelInfo.name, errorMsg);
+        errors.add ("Unsupported operations.\n");
         return false;
     }
 
-    // Check if tensors have the correct names. Sometimes the colab
-    // puts them in different orders so we will stay order-agnostic here.
-    // We also do not want repeats.
-    juce::StringArray inputNames;
-    inputNames.add (kInputTensorName_F0.data());
-    inputNames.add (kInputTensorName_Loudness.data());
-    inputNames.add (kInputTensorName_State.data());
-
-    for (int i = 0; i < interpreter->inputs().size(); i++)
-    {
-        auto name = interpreter->GetInputName (i);
-        if (int idx = inputNames.indexOf (name); idx != -1)
-        {
-            inputNames.remove (idx);
-        }
-        else
-        {
-            errorMsg.add ("Invalid input tensor name " + std::string (name) + "\n");
-        }
-    }
-
-    juce::StringArray outputNames;
-    outputNames.add (kOutputTensorName_Amplitude.data());
-    outputNames.add (kOutputTensorName_Harmonics.data());
-    outputNames.add (kOutputTensorName_NoiseAmps.data());
-    outputNames.add (kOutputTensorName_State.data());
-
-    for (int i = 0; i < interpreter->outputs().size(); i++)
-    {
-        auto name = interpreter->GetOutputName (i);
-        if (int idx = outputNames.indexOf (name); idx != -1)
-        {
-            outputNames.remove (idx);
-        }
-        else
-        {
-            errorMsg.add ("Invalid output tensor name " + std::string (name) + "\n");
-        }
-    }
-
-    if (! errorMsg.isEmpty())
+    interpreter->SetNumThreads (1);
+    if (interpreter->AllocateTensors() != kTfLiteOk)
     {
-        showAlertWindow (modelInfo.name, errorMsg);
+        errors.add ("Could not allocate tensors.\n");
         return false;
     }
 
-    // Check if tensors have correct sizes.
-    for (int i = 0; i < interpreter->inputs().size(); i++)
+    // Check if model has correct number of I/O tensors.
+    if (interpreter->inputs().size() != kNumPredictControlsInputTensors)
     {
-        const std::string_view name = interpreter->GetInputName (i);
-        auto size = interpreter->input_tensor (i)->bytes / sizeof (float);
-
-        if (name == kInputTensorName_F0)
-        {
-            if (size != kF0Size)
-            {
-                errorMsg.add ("Invalid tensor size " + std::to_string (size) + " for " + name.data() + "\n");
-            }
-        }
-        else if (name == kInputTensorName_Loudness)
-        {
-            if (size != kLoudnessSize)
-            {
-                errorMsg.add ("Invalid tensor size " + std::to_string (size) + " for " + name.data() + "\n");
-            }
-        }
-        else if (name == kInputTensorName_State)
-        {
-            if (size != kGruModelStateSize)
-            {
-                errorMsg.add ("Invalid tensor size " + std::to_string (size) + " for " + name.data() + "\n");
-            }
-        }
+        errors.add ("Invalid number of input tensors: " + std::to_string (interpreter->inputs().size()) + "\n");
     }
 
-    for (int i = 0; i < interpreter->outputs().size(); i++)
+    if (interpreter->outputs().size() != kNumPredictControlsOutputTensors)
     {
-        const std::string_view name = interpreter->GetOutputName (i);
-        auto size = interpreter->output_tensor (i)->bytes / sizeof (float);
-
-        if (name == kOutputTensorName_Amplitude)
-        {
-            if (size != kAmplitudeSize)
-            {
-                errorMsg.add ("Invalid tensor size " + std::to_string (size) + " for " + name.data() + "\n");
-            }
-        }
-        else if (name == kOutputTensorName_Harmonics)
-        {
-            if (size != kHarmonicsSize)
-            {
-                errorMsg.add ("Invalid tensor size " + std::to_string (size) + " for " + name.data() + "\n");
-            }
-        }
-        else if (name == kOutputTensorName_NoiseAmps)
-        {
-            if (size != kNoiseAmpsSize)
-            {
-                errorMsg.add ("Invalid tensor size " + std::to_string (size) + " for " + name.data() + "\n");
-            }
-        }
-        else if (name == kOutputTensorName_State)
-        {
-            if (size != kGruModelStateSize)
-            {
-                errorMsg.add ("Invalid tensor size " + std::to_string (size) + " for " + name.data() + "\n");
-            }
-        }
+        errors.add ("Invalid number of output tensors: " + std::to_string (interpreter->outputs().size()) + "\n");
     }
 
-    if (! errorMsg.isEmpty())
+    if (! errors.isEmpty())
     {
-        showAlertWindow (modelInfo.name, errorMsg);
         return false;
     }
 
-    return true;
+    // Check that every tensor role binds by name, size and type. Sometimes the colab
+    // puts them in different orders so the binding table is order-agnostic.
+    // This is the same binding the model uses at runtime.
+    PredictControlsModel::bindTensors (*interpreter, errors);
+
+    return errors.isEmpty();
 }
 
 void ModelLibrary::clearUserModels()
@@ -45,8 +45,13 @@ public:
     juce::File getPathToUserModels();
     const std::vector<ModelInfo>& getModelList() const { return models; }
 
+    // Checks that the model loads and binds every control model tensor, adding the reasons
+    // to errors if not. Shows nothing to the user.
+    static bool validateModel (const ModelInfo& modelInfo, juce::StringArray& errors);
+
 private:
-    bool validateModel (ModelInfo modelInfo);
+    // Validates and shows an alert with the reasons if the model is invalid.
+    bool validateModel (const ModelInfo& modelInfo);
     void showAlertWindow (juce::String modelName, juce::StringArray messages);
     void setPathToUserModels();
     void loadEmbeddedModels();
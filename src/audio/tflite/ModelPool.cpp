@@ -0,0 +1,114 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "audio/tflite/ModelPool.h"
+
+namespace ddsp
+{
+
+ModelPool::ModelPool (size_t memoryBudgetBytes) : memoryBudget (memoryBudgetBytes) {}
+
+PredictControlsModel* ModelPool::acquire (const ModelInfo& mi,
+                                          std::initializer_list<const PredictControlsModel*> pinnedModels)
+{
+    auto* entry = findEntry (mi);
+
+    if (entry == nullptr)
+    {
+        entry = entries.emplace_back (std::make_unique<Entry> (mi)).get();
+        entry->footprint = mi.data.getSize() + entry->model.getMemoryFootprint();
+        DBG ("Model pool: built " << mi.name << " (" << static_cast<int> (entry->footprint / 1024) << " KB)");
+    }
+
+    entry->lastUsed = ++useCounter;
+    evict (&entry->model, pinnedModels);
+
+    return &entry->model;
+}
+
+PredictControlsModel* ModelPool::find (const ModelInfo& mi)
+{
+    if (auto* entry = findEntry (mi))
+    {
+        entry->lastUsed = ++useCounter;
+        return &entry->model;
+    }
+    return nullptr;
+}
+
+void ModelPool::setMemoryBudget (size_t bytes, std::initializer_list<const PredictControlsModel*> pinnedModels)
+{
+    memoryBudget = bytes;
+    evict (nullptr, pinnedModels);
+}
+
+size_t ModelPool::getMemoryUsage() const
+{
+    size_t total = 0;
+    for (const auto& entry : entries)
+    {
+        total += entry->footprint;
+    }
+    return total;
+}
+
+void ModelPool::clear() { entries.clear(); }
+
+ModelPool::Entry* ModelPool::findEntry (const ModelInfo& mi)
+{
+    for (auto& entry : entries)
+    {
+        if (entry->info.name == mi.name && entry->info.timestamp == mi.timestamp
+            && entry->info.data.getSize() == mi.data.getSize())
+        {
+            return entry.get();
+        }
+    }
+    return nullptr;
+}
+
+void ModelPool::evict (const PredictControlsModel* keep,
+                       std::initializer_list<const PredictControlsModel*> pinnedModels)
+{
+    const auto isPinned = [&] (const Entry& e)
+    {
+        return &e.model == keep || std::find (pinnedModels.begin(), pinnedModels.end(), &e.model) != pinnedModels.end();
+    };
+
+    while (getMemoryUsage() > memoryBudget)
+    {
+        // Find the least-recently-used model that is safe to drop.
+        auto victim = entries.end();
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (! isPinned (**it) && (victim == entries.end() || (*it)->lastUsed < (*victim)->lastUsed))
+            {
+                victim = it;
+            }
+        }
+
+        if (victim == entries.end())
+        {
+            // Everything left is in use, the pool may exceed its budget until the next eviction.
+            break;
+        }
+
+        DBG ("Model pool: evicted " << (*victim)->info.name);
+        entries.erase (victim);
+    }
+}
+
+} // namespace ddsp
@@ -0,0 +1,72 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "audio/tflite/ModelLibrary.h"
+#include "audio/tflite/PredictControlsModel.h"
+
+namespace ddsp
+{
+
+// Least-recently-used pool of fully prepared PredictControlsModels.
+// Keeping interpreters warm turns switching between recently used models into a
+// pointer swap instead of a flatbuffer verify, interpreter build and tensor allocation.
+// Not thread-safe: the owner is responsible for serializing access.
+class ModelPool
+{
+public:
+    ModelPool (size_t memoryBudgetBytes);
+
+    // Returns a prepared model for mi, building it if it is not pooled yet.
+    // Evicts least-recently-used models until the pool fits its memory budget,
+    // skipping the returned model and any model in pinnedModels.
+    PredictControlsModel* acquire (const ModelInfo& mi,
+                                   std::initializer_list<const PredictControlsModel*> pinnedModels);
+
+    // Returns the pooled model for mi without building it, or nullptr.
+    PredictControlsModel* find (const ModelInfo& mi);
+
+    void setMemoryBudget (size_t bytes, std::initializer_list<const PredictControlsModel*> pinnedModels);
+    size_t getMemoryBudget() const { return memoryBudget; }
+    size_t getMemoryUsage() const;
+    int getNumModels() const { return static_cast<int> (entries.size()); }
+
+    void clear();
+
+private:
+    struct Entry
+    {
+        Entry (const ModelInfo& mi) : info (mi), model (info) {}
+
+        // Private copy of the model data, the interpreter references it for its whole lifetime.
+        const ModelInfo info;
+        PredictControlsModel model;
+        size_t footprint = 0;
+        uint64_t lastUsed = 0;
+    };
+
+    Entry* findEntry (const ModelInfo& mi);
+    void evict (const PredictControlsModel* keep, std::initializer_list<const PredictControlsModel*> pinnedModels);
+
+    std::vector<std::unique_ptr<Entry>> entries;
+    size_t memoryBudget = 0;
+    uint64_t useCounter = 0;
+};
+
+} // namespace ddsp
@@ -24,10 +24,11 @@ namespace ddsp
 
 struct SynthesisControls
 {
-    float amplitude;
-    float f0_hz;
-    std::vector<float> noiseAmps = std::vector<float> (kNoiseAmpsSize);
-    std::vector<float> harmonics = std::vector<float> (kHarmonicsSize);
+    float amplitude = 0.0f;
+    float f0_hz = 0.0f;
+    // Fixed size, so copying the struct never allocates.
+    std::array<float, kNoiseAmpsSize> noiseAmps {};
+    std::array<float, kHarmonicsSize> harmonics {};
 };
 
 struct AudioFeatures
@@ -0,0 +1,1262 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+The control model is DDSP's RnnFcDecoder around one GRU step. Each input
+goes through a stack of dense layers with layer norm and leaky ReLU, the
+GRU cell runs on the concatenated stack outputs and the carried state, and
+a second stack on the GRU output and the input stacks feeds the dense
+output heads, which exp_sigmoid scales into amplitudes. At a batch size of
+one TFLite spends about as long dispatching the ops as computing them.
+
+The architecture is matched once, backwards from the graph outputs, in the
+graph of an interpreter built without delegates. A dense layer is a
+FULLY_CONNECTED, optionally followed by the ops of a layer norm, whose only
+constants may be its epsilon, scale and offset, and by a LEAKY_RELU. The
+GRU cell is what lies between the state output, the state input and two
+FULLY_CONNECTED projections of three gates each. Ops that only change the
+shape are looked through, and float16 or int8 weights behind DEQUANTIZE
+are expanded to floats.
+
+The ops do not pin down every detail, the order of the gates within the
+projections for one. So the model is run against the interpreter on a
+fixed control sequence, with each gate order in turn, and only accepted if
+the outputs agree.
+
+Nearly all of the arithmetic is in the matrix-vector products. Their weights
+are packed into panels of kPanelRows rows, interleaved by column, so the
+kernel reads each weight once from contiguous memory while it keeps a whole
+panel of sums in SIMD registers and the input vector in L1. Layer norm,
+activation and gates are then applied in one pass over the products.
+*/
+
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
+
+#include "audio/tflite/NativeControlEngine.h"
+#include "audio/tflite/TypedTensor.h"
+#include "util/Constants.h"
+
+#include "tensorflow/lite/builtin_ops.h"
+#include "tensorflow/lite/c/builtin_op_data.h"
+#include "tensorflow/lite/kernels/register.h"
+
+#if JUCE_USE_SSE_INTRINSICS
+    #include <immintrin.h>
+#elif JUCE_USE_ARM_NEON
+    #include <arm_neon.h>
+#endif
+
+namespace ddsp
+{
+
+namespace
+{
+    // Output rows per weight panel, two SIMD registers of sums.
+    constexpr int kPanelRows = 8;
+    constexpr int kCacheLineFloats = 64 / sizeof (float);
+
+    // Hops run against the interpreter per gate order, and to accept the model.
+    constexpr int kNumGateOrderHops = 4;
+    constexpr int kNumVerificationHops = 32;
+    // Summation order differs from TFLite's kernels, so the outputs agree only up to rounding.
+    constexpr float kMaxRelativeError = 1.0e-3f;
+
+    int roundUp (int value, int multiple) { return (value + multiple - 1) / multiple * multiple; }
+
+    float sigmoid (float x) { return 1.0f / (1.0f + std::exp (-x)); }
+
+    // Packs the row-major numRows x numCols matrix into panels of kPanelRows rows. Within a
+    // panel the rows are interleaved by column, rows past numRows are left as zeros.
+    void packWeights (const float* weights, int numRows, int numCols, float* panels)
+    {
+        for (int row = 0; row < numRows; ++row)
+        {
+            float* panel = panels + static_cast<size_t> (row / kPanelRows) * kPanelRows * numCols;
+            for (int col = 0; col < numCols; ++col)
+            {
+                panel[col * kPanelRows + row % kPanelRows] = weights[static_cast<size_t> (row) * numCols + col];
+            }
+        }
+    }
+
+    // y = W x + b with W packed by packWeights(). bias may be nullptr.
+    void gemv (const float* panels, const float* x, const float* bias, float* y, int numRows, int numCols)
+    {
+        for (int row = 0; row < numRows; row += kPanelRows, panels += kPanelRows * numCols)
+        {
+            alignas (16) float sums[kPanelRows];
+            int col = 0;
+            const float* w = panels;
+#if JUCE_USE_SSE_INTRINSICS
+            // Two sets of sums for even and odd columns hide the latency of the additions.
+            __m128 lo0 = _mm_setzero_ps(), hi0 = _mm_setzero_ps();
+            __m128 lo1 = _mm_setzero_ps(), hi1 = _mm_setzero_ps();
+            for (; col + 2 <= numCols; col += 2, w += 2 * kPanelRows)
+            {
+                const __m128 x0 = _mm_set1_ps (x[col]);
+                const __m128 x1 = _mm_set1_ps (x[col + 1]);
+                lo0 = _mm_add_ps (lo0, _mm_mul_ps (_mm_load_ps (w), x0));
+                hi0 = _mm_add_ps (hi0, _mm_mul_ps (_mm_load_ps (w + 4), x0));
+                lo1 = _mm_add_ps (lo1, _mm_mul_ps (_mm_load_ps (w + 8), x1));
+                hi1 = _mm_add_ps (hi1, _mm_mul_ps (_mm_load_ps (w + 12), x1));
+            }
+            _mm_store_ps (sums, _mm_add_ps (lo0, lo1));
+            _mm_store_ps (sums + 4, _mm_add_ps (hi0, hi1));
+#elif JUCE_USE_ARM_NEON
+            float32x4_t lo0 = vdupq_n_f32 (0.0f), hi0 = vdupq_n_f32 (0.0f);
+            float32x4_t lo1 = vdupq_n_f32 (0.0f), hi1 = vdupq_n_f32 (0.0f);
+            for (; col + 2 <= numCols; col += 2, w += 2 * kPanelRows)
+            {
+                lo0 = vmlaq_n_f32 (lo0, vld1q_f32 (w), x[col]);
+                hi0 = vmlaq_n_f32 (hi0, vld1q_f32 (w + 4), x[col]);
+                lo1 = vmlaq_n_f32 (lo1, vld1q_f32 (w + 8), x[col + 1]);
+                hi1 = vmlaq_n_f32 (hi1, vld1q_f32 (w + 12), x[col + 1]);
+            }
+            vst1q_f32 (sums, vaddq_f32 (lo0, lo1));
+            vst1q_f32 (sums + 4, vaddq_f32 (hi0, hi1));
+#else
+            std::fill_n (sums, kPanelRows, 0.0f);
+#endif
+            for (; col < numCols; ++col, w += kPanelRows)
+            {
+                for (int i = 0; i < kPanelRows; ++i)
+                {
+                    sums[i] += w[i] * x[col];
+                }
+            }
+
+            const int numPanelRows = std::min (kPanelRows, numRows - row);
+            for (int i = 0; i < numPanelRows; ++i)
+            {
+                y[row + i] = sums[i] + (bias != nullptr ? bias[row + i] : 0.0f);
+            }
+        }
+    }
+
+    bool isShapeOnly (int code)
+    {
+        return code == kTfLiteBuiltinReshape || code == kTfLiteBuiltinSqueeze || code == kTfLiteBuiltinExpandDims;
+    }
+
+    // Values of a constant int32 tensor, such as an axis or slice bounds.
+    bool readConstantInts (const TfLiteTensor& tensor, std::vector<int>& values)
+    {
+        if (tensor.type != kTfLiteInt32 || tensor.allocation_type != kTfLiteMmapRo)
+        {
+            return false;
+        }
+        values.assign (tensor.data.i32, tensor.data.i32 + getNumElements (tensor));
+        return true;
+    }
+
+    // Broadcasts a constant of one value, or checks it holds size values.
+    bool expandConstant (std::vector<float>& values, int size)
+    {
+        if (values.size() == 1)
+        {
+            values.assign (static_cast<size_t> (size), values[0]);
+        }
+        return static_cast<int> (values.size()) == size;
+    }
+} // namespace
+
+// The interpreter's primary subgraph, with the node producing each tensor.
+class NativeControlEngine::Graph
+{
+public:
+    explicit Graph (tflite::Interpreter& interpreterToRead) : interpreter (interpreterToRead)
+    {
+        producers.assign (interpreter.tensors_size(), -1);
+        for (const int node : interpreter.execution_plan())
+        {
+            const TfLiteIntArray& outputs = *getNode (node).outputs;
+            for (int i = 0; i < outputs.size; ++i)
+            {
+                producers[static_cast<size_t> (outputs.data[i])] = node;
+            }
+        }
+    }
+
+    const TfLiteNode& getNode (int node) const { return interpreter.node_and_registration (node)->first; }
+    int getCode (int node) const { return interpreter.node_and_registration (node)->second.builtin_code; }
+
+    int getInput (int node, int i) const
+    {
+        const TfLiteIntArray& inputs = *getNode (node).inputs;
+        return i < inputs.size ? inputs.data[i] : -1;
+    }
+
+    TfLiteTensor& getTensor (int index) const { return *interpreter.tensor (index); }
+    int getSize (int index) const { return getNumElements (getTensor (index)); }
+
+    // A float32 vector at a batch size of one, i.e. of at most one dimension longer than 1.
+    bool isFloatVector (int index) const
+    {
+        const TfLiteTensor& tensor = getTensor (index);
+        if (tensor.type != kTfLiteFloat32 || tensor.dims == nullptr)
+        {
+            return false;
+        }
+        return std::count_if (tensor.dims->data, tensor.dims->data + tensor.dims->size, [] (int d) { return d > 1; })
+               <= 1;
+    }
+
+    // The tensor with ops that only change its shape looked through.
+    int resolve (int tensor) const
+    {
+        while (tensor >= 0 && producers[static_cast<size_t> (tensor)] >= 0
+               && isShapeOnly (getCode (producers[static_cast<size_t> (tensor)])))
+        {
+            tensor = getInput (producers[static_cast<size_t> (tensor)], 0);
+        }
+        return tensor;
+    }
+
+    // Node computing the resolved tensor, -1 for graph inputs and constants.
+    int getProducer (int tensor) const
+    {
+        tensor = resolve (tensor);
+        return tensor >= 0 ? producers[static_cast<size_t> (tensor)] : -1;
+    }
+
+    // Values of a float, float16 or int8 constant, also if it is fed through DEQUANTIZE.
+    bool getConstant (int tensor, std::vector<float>& values) const
+    {
+        tensor = resolve (tensor);
+        if (const int node = getProducer (tensor); node >= 0)
+        {
+            if (getCode (node) != kTfLiteBuiltinDequantize)
+            {
+                return false;
+            }
+            tensor = resolve (getInput (node, 0));
+        }
+        if (tensor < 0 || getProducer (tensor) >= 0 || getTensor (tensor).allocation_type != kTfLiteMmapRo
+            || ! TypedTensor::isSupported (getTensor (tensor)))
+        {
+            return false;
+        }
+        values.resize (static_cast<size_t> (getSize (tensor)));
+        TypedTensor::fromTensor (getTensor (tensor)).read (values.data(), static_cast<int> (values.size()));
+        return true;
+    }
+
+    bool isConstant (int tensor) const
+    {
+        std::vector<float> values;
+        return getConstant (tensor, values);
+    }
+
+    // Dimensions of the constant behind tensor, as for getConstant().
+    const TfLiteIntArray* getConstantDims (int tensor) const
+    {
+        tensor = resolve (tensor);
+        if (const int node = getProducer (tensor); node >= 0)
+        {
+            tensor = resolve (getInput (node, 0));
+        }
+        return getTensor (tensor).dims;
+    }
+
+    // Resolved tensors concatenated into tensor, or tensor itself.
+    std::vector<int> getConcatenatedParts (int tensor) const
+    {
+        tensor = resolve (tensor);
+        const int node = getProducer (tensor);
+        if (node < 0 || getCode (node) != kTfLiteBuiltinConcatenation
+            || static_cast<const TfLiteConcatenationParams*> (getNode (node).builtin_data)->activation
+                   != kTfLiteActNone)
+        {
+            return { tensor };
+        }
+        std::vector<int> parts;
+        for (int i = 0; i < getNode (node).inputs->size; ++i)
+        {
+            parts.push_back (resolve (getInput (node, i)));
+        }
+        return parts;
+    }
+
+    tflite::Interpreter& interpreter;
+
+private:
+    std::vector<int> producers;
+};
+
+std::unique_ptr<NativeControlEngine> NativeControlEngine::create (const tflite::FlatBufferModel& model,
+                                                                  juce::String& error)
+{
+    // Delegates would replace the ops with their own kernels.
+    tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+    std::unique_ptr<tflite::Interpreter> interpreter;
+    if (tflite::InterpreterBuilder (model, resolver) (&interpreter) != kTfLiteOk || interpreter == nullptr
+        || interpreter->AllocateTensors() != kTfLiteOk)
+    {
+        error = "Could not build the model";
+        return nullptr;
+    }
+
+    std::unique_ptr<NativeControlEngine> engine (new NativeControlEngine());
+    if (! engine->build (Graph (*interpreter), error))
+    {
+        return nullptr;
+    }
+
+    // Keep the gate order with which the model agrees best with the interpreter.
+    std::array<int, 3> gateBlocks { 0, 1, 2 };
+    auto bestGateBlocks = gateBlocks;
+    float bestError = std::numeric_limits<float>::infinity();
+    do
+    {
+        engine->gru.gateBlocks = gateBlocks;
+        if (const float gateOrderError = engine->compareWith (*interpreter, kNumGateOrderHops);
+            gateOrderError < bestError)
+        {
+            bestError = gateOrderError;
+            bestGateBlocks = gateBlocks;
+        }
+    } while (std::next_permutation (gateBlocks.begin(), gateBlocks.end()));
+
+    engine->gru.gateBlocks = bestGateBlocks;
+    const float maxError = engine->compareWith (*interpreter, kNumVerificationHops);
+    if (! (maxError <= kMaxRelativeError))
+    {
+        error = "Outputs differ from TFLite's by up to " + juce::String (maxError);
+        return nullptr;
+    }
+
+    // Start from a cleared state.
+    const int stateSize = engine->vectorSizes[static_cast<size_t> (engine->stateInput)];
+    std::fill_n (engine->vectorData[static_cast<size_t> (engine->stateInput)], stateSize, 0.0f);
+    return engine;
+}
+
+bool NativeControlEngine::build (const Graph& graph, juce::String& error)
+{
+    const auto reject = [&error] (const juce::String& reason)
+    {
+        error = reason;
+        return false;
+    };
+
+    const tflite::Interpreter& interpreter = graph.interpreter;
+    const auto getName = [&interpreter] (int index) -> std::string
+    {
+        const char* name = interpreter.tensor (index)->name;
+        return name != nullptr ? name : "";
+    };
+
+    // Vector holding each resolved tensor the stacks may read.
+    std::map<int, int> tensorVectors;
+
+    int stateInputTensor = -1, stateOutputTensor = -1;
+    for (const bool isInput : { true, false })
+    {
+        for (const int index : isInput ? interpreter.inputs() : interpreter.outputs())
+        {
+            if (! graph.isFloatVector (index))
+            {
+                return reject ("Graph " + juce::String (isInput ? "input " : "output ") + getName (index)
+                               + " is not a float vector");
+            }
+            const std::string name = getName (index);
+            const int vector = addVector (graph.getSize (index));
+            graphTensors.emplace_back (name, vector);
+
+            if (name == (isInput ? kInputTensorName_State : kOutputTensorName_State))
+            {
+                (isInput ? stateInputTensor : stateOutputTensor) = index;
+                (isInput ? stateInput : stateOutput) = vector;
+            }
+            if (isInput)
+            {
+                tensorVectors[graph.resolve (index)] = vector;
+            }
+        }
+    }
+    if (stateInputTensor < 0 || stateOutputTensor < 0)
+    {
+        return reject ("No GRU state input and output");
+    }
+
+    // The GRU cell, and the input stacks it reads.
+    int gruInputTensor = -1;
+    if (! matchGruCell (graph, stateInputTensor, stateOutputTensor, gruInputTensor, error))
+    {
+        return false;
+    }
+    for (const int part : graph.getConcatenatedParts (gruInputTensor))
+    {
+        int source = -1;
+        Stack stack = matchStack (graph, part, source);
+        const auto it = tensorVectors.find (source);
+        if (it == tensorVectors.end() || it->second == stateInput)
+        {
+            return reject ("GRU input does not come from the control inputs");
+        }
+        stack.parts = { it->second };
+        stack.input = it->second;
+        tensorVectors[part] = stack.getOutput();
+        gru.parts.push_back (stack.getOutput());
+        inputStacks.push_back (std::move (stack));
+    }
+    gru.input = addConcatenation (gru.parts);
+    tensorVectors[graph.resolve (stateOutputTensor)] = stateOutput;
+
+    // The other outputs, and the dense heads they are computed from.
+    std::vector<int> headTensors;
+    for (const int index : interpreter.outputs())
+    {
+        if (index == stateOutputTensor)
+        {
+            continue;
+        }
+        OutputTransform transform;
+        int headTensor = -1;
+        if (! matchOutputTransform (graph, index, transform, headTensor))
+        {
+            return reject ("Unrecognized computation of output " + getName (index));
+        }
+        const auto head = std::find (headTensors.begin(), headTensors.end(), headTensor);
+        transform.head = static_cast<int> (head - headTensors.begin());
+        if (head == headTensors.end())
+        {
+            headTensors.push_back (headTensor);
+        }
+        transform.output = findTensor (getName (index));
+        outputs.push_back (transform);
+    }
+
+    int headInput = -1;
+    for (const int headTensor : headTensors)
+    {
+        DenseLayer head;
+        int input = -1;
+        if (! matchLinear (graph, headTensor, head, input) || (headInput >= 0 && graph.resolve (input) != headInput))
+        {
+            return reject ("Unrecognized output heads");
+        }
+        headInput = graph.resolve (input);
+        head.output = addVector (head.numRows);
+        heads.push_back (head);
+    }
+    for (const OutputTransform& transform : outputs)
+    {
+        if (transform.begin + transform.size > heads[static_cast<size_t> (transform.head)].numRows)
+        {
+            return reject ("Output out of range of its head");
+        }
+    }
+
+    // The output stack, on the GRU output and the input stacks.
+    int outputStackSource = -1;
+    outputStack = matchStack (graph, headInput, outputStackSource);
+    for (const int part : graph.getConcatenatedParts (outputStackSource))
+    {
+        const auto it = tensorVectors.find (part);
+        if (it == tensorVectors.end())
+        {
+            return reject ("Output stack does not read the GRU and input stacks");
+        }
+        outputStack.parts.push_back (it->second);
+    }
+    outputStack.input = addConcatenation (outputStack.parts);
+
+    // Every layer must take the size of the vector before it.
+    const auto fits = [this] (int vector, const DenseLayer& layer)
+    { return vectorSizes[static_cast<size_t> (vector)] == layer.numCols; };
+    std::vector<const Stack*> stacks { &outputStack };
+    for (const Stack& stack : inputStacks)
+    {
+        stacks.push_back (&stack);
+    }
+    for (const Stack* stack : stacks)
+    {
+        int vector = stack->input;
+        for (const DenseLayer& layer : stack->layers)
+        {
+            if (! fits (vector, layer))
+            {
+                return reject ("Mismatched dense layer sizes");
+            }
+            vector = layer.output;
+        }
+    }
+    if (! fits (gru.input, gru.inputProjection) || ! fits (stateInput, gru.stateProjection)
+        || std::any_of (heads.begin(),
+                        heads.end(),
+                        [&] (const DenseLayer& head) { return ! fits (outputStack.getOutput(), head); }))
+    {
+        return reject ("Mismatched GRU or head sizes");
+    }
+
+    // One extra cache line to align the start.
+    arenaSize = staging.size();
+    arenaStorage.calloc (arenaSize + kCacheLineFloats);
+    arena = arenaStorage.get();
+    while (reinterpret_cast<uintptr_t> (arena) % 64 != 0)
+    {
+        ++arena;
+    }
+    std::copy (staging.begin(), staging.end(), arena);
+    staging = {};
+
+    for (const int offset : vectorOffsets)
+    {
+        vectorData.push_back (arena + offset);
+    }
+    return true;
+}
+
+bool NativeControlEngine::matchLinear (const Graph& graph, int tensor, DenseLayer& layer, int& input)
+{
+    const int node = graph.getProducer (tensor);
+    if (node < 0 || graph.getCode (node) != kTfLiteBuiltinFullyConnected)
+    {
+        return false;
+    }
+
+    const auto* params = static_cast<const TfLiteFullyConnectedParams*> (graph.getNode (node).builtin_data);
+    const int weightsTensor = graph.getInput (node, 1);
+    const int biasTensor = graph.getInput (node, 2);
+    std::vector<float> weights, bias;
+    if (params->weights_format != kTfLiteFullyConnectedWeightsFormatDefault
+        || (params->activation != kTfLiteActNone && params->activation != kTfLiteActRelu)
+        || ! graph.getConstant (weightsTensor, weights) || graph.getConstantDims (weightsTensor)->size != 2
+        || (biasTensor >= 0 && ! graph.getConstant (biasTensor, bias)))
+    {
+        return false;
+    }
+
+    const int numRows = graph.getConstantDims (weightsTensor)->data[0];
+    const int numCols = graph.getConstantDims (weightsTensor)->data[1];
+    input = graph.getInput (node, 0);
+    if (! graph.isFloatVector (input) || graph.getSize (input) != numCols || graph.getSize (tensor) != numRows
+        || (biasTensor >= 0 && static_cast<int> (bias.size()) != numRows))
+    {
+        return false;
+    }
+
+    layer.numRows = numRows;
+    layer.numCols = numCols;
+    layer.weightsOffset = addWeights (weights.data(), numRows, numCols);
+    layer.biasOffset = biasTensor >= 0 ? addParameters (bias.data(), numRows) : -1;
+    if (params->activation == kTfLiteActRelu)
+    {
+        layer.alpha = 0.0f;
+    }
+    return true;
+}
+
+bool NativeControlEngine::matchDenseLayer (const Graph& graph, int tensor, DenseLayer& layer, int& input)
+{
+    DenseLayer result;
+    int current = graph.resolve (tensor);
+
+    if (const int node = graph.getProducer (current);
+        node >= 0 && (graph.getCode (node) == kTfLiteBuiltinLeakyRelu || graph.getCode (node) == kTfLiteBuiltinRelu))
+    {
+        result.alpha = graph.getCode (node) == kTfLiteBuiltinLeakyRelu
+                           ? static_cast<const TfLiteLeakyReluParams*> (graph.getNode (node).builtin_data)->alpha
+                           : 0.0f;
+        current = graph.resolve (graph.getInput (node, 0));
+    }
+
+    // A layer norm is whatever lies between here and the FULLY_CONNECTED, as long as it takes
+    // two means and one reciprocal square root, and holds no constants but the epsilon, scale
+    // and offset.
+    std::vector<float> gamma, beta;
+    if (const int node = graph.getProducer (current); node >= 0 && graph.getCode (node) != kTfLiteBuiltinFullyConnected)
+    {
+        const int size = graph.getSize (current);
+        int linearOutput = -1, numMeans = 0, numRsqrts = 0;
+        bool hasEpsilon = false;
+        std::set<int> visited;
+        std::vector<int> pending { current };
+        while (! pending.empty())
+        {
+            const int t = pending.back();
+            pending.pop_back();
+            const int producer = graph.getProducer (t);
+            if (producer < 0)
+            {
+                return false;
+            }
+            if (graph.getCode (producer) == kTfLiteBuiltinFullyConnected)
+            {
+                if (linearOutput >= 0 && linearOutput != t)
+                {
+                    return false;
+                }
+                linearOutput = t;
+                continue;
+            }
+            if (! visited.insert (producer).second)
+            {
+                continue;
+            }
+
+            const int code = graph.getCode (producer);
+            switch (code)
+            {
+                case kTfLiteBuiltinMean:
+                    ++numMeans;
+                    if (graph.getSize (graph.getNode (producer).outputs->data[0]) != 1)
+                    {
+                        return false;
+                    }
+                    pending.push_back (graph.resolve (graph.getInput (producer, 0)));
+                    break;
+                case kTfLiteBuiltinRsqrt:
+                    ++numRsqrts;
+                    [[fallthrough]];
+                case kTfLiteBuiltinSquare:
+                    pending.push_back (graph.resolve (graph.getInput (producer, 0)));
+                    break;
+                case kTfLiteBuiltinAdd:
+                case kTfLiteBuiltinSub:
+                case kTfLiteBuiltinMul:
+                case kTfLiteBuiltinSquaredDifference:
+                    for (int i = 0; i < 2; ++i)
+                    {
+                        const int operand = graph.getInput (producer, i);
+                        std::vector<float> values;
+                        if (! graph.getConstant (operand, values))
+                        {
+                            pending.push_back (graph.resolve (operand));
+                        }
+                        else if (values.size() == 1 && code == kTfLiteBuiltinAdd && ! hasEpsilon)
+                        {
+                            result.epsilon = values[0];
+                            hasEpsilon = true;
+                        }
+                        else if (static_cast<int> (values.size()) == size && code == kTfLiteBuiltinMul && gamma.empty())
+                        {
+                            gamma = std::move (values);
+                        }
+                        else if (static_cast<int> (values.size()) == size && beta.empty()
+                                 && (code == kTfLiteBuiltinAdd || code == kTfLiteBuiltinSub))
+                        {
+                            // offset - x, or x - (-offset).
+                            if (code == kTfLiteBuiltinSub && i == 1)
+                            {
+                                std::transform (values.begin(), values.end(), values.begin(), std::negate<>());
+                            }
+                            beta = std::move (values);
+                        }
+                        else
+                        {
+                            return false;
+                        }
+                    }
+                    break;
+                default:
+                    return false;
+            }
+        }
+        if (numMeans != 2 || numRsqrts != 1 || linearOutput < 0)
+        {
+            return false;
+        }
+        result.layerNorm = true;
+        current = linearOutput;
+    }
+
+    const float alpha = result.alpha;
+    result.alpha = 1.0f;
+    if (! matchLinear (graph, current, result, input))
+    {
+        return false;
+    }
+    // A fused ReLU would come before the layer norm and activation, which is not this architecture.
+    const bool hasFusedRelu = result.alpha == 0.0f;
+    if (hasFusedRelu && (result.layerNorm || alpha != 1.0f))
+    {
+        return false;
+    }
+    result.alpha = hasFusedRelu ? 0.0f : alpha;
+
+    if (! gamma.empty())
+    {
+        result.gammaOffset = addParameters (gamma.data(), result.numRows);
+    }
+    if (! beta.empty())
+    {
+        result.betaOffset = addParameters (beta.data(), result.numRows);
+    }
+    layer = result;
+    return true;
+}
+
+NativeControlEngine::Stack NativeControlEngine::matchStack (const Graph& graph, int tensor, int& input)
+{
+    Stack stack;
+    int current = graph.resolve (tensor);
+    DenseLayer layer;
+    int layerInput = -1;
+    while (matchDenseLayer (graph, current, layer, layerInput))
+    {
+        stack.layers.push_back (layer);
+        current = graph.resolve (layerInput);
+    }
+    std::reverse (stack.layers.begin(), stack.layers.end());
+    for (DenseLayer& each : stack.layers)
+    {
+        each.output = addVector (each.numRows);
+    }
+    input = current;
+    return stack;
+}
+
+bool NativeControlEngine::matchGruCell (const Graph& graph,
+                                        int stateInputTensor,
+                                        int stateOutputTensor,
+                                        int& input,
+                                        juce::String& error)
+{
+    // The gates only add, multiply, split and squash, and take no constants but the 1 of 1 - z.
+    const int state = graph.resolve (stateInputTensor);
+    std::vector<int> linearOutputs;
+    bool readsState = false;
+    std::set<int> visited;
+    std::vector<int> pending { graph.resolve (stateOutputTensor) };
+    while (! pending.empty())
+    {
+        const int t = pending.back();
+        pending.pop_back();
+        if (t == state)
+        {
+            readsState = true;
+            continue;
+        }
+        const int producer = graph.getProducer (t);
+        if (producer < 0)
+        {
+            error = "GRU cell reads more than its state";
+            return false;
+        }
+        const int code = graph.getCode (producer);
+        if (code == kTfLiteBuiltinFullyConnected)
+        {
+            if (std::find (linearOutputs.begin(), linearOutputs.end(), t) == linearOutputs.end())
+            {
+                linearOutputs.push_back (t);
+            }
+            continue;
+        }
+        if (! visited.insert (producer).second)
+        {
+            continue;
+        }
+
+        switch (code)
+        {
+            case kTfLiteBuiltinLogistic:
+            case kTfLiteBuiltinTanh:
+            case kTfLiteBuiltinSplitV:
+            case kTfLiteBuiltinSlice:
+            case kTfLiteBuiltinStridedSlice:
+                pending.push_back (graph.resolve (graph.getInput (producer, 0)));
+                break;
+            case kTfLiteBuiltinSplit:
+                pending.push_back (graph.resolve (graph.getInput (producer, 1)));
+                break;
+            case kTfLiteBuiltinAdd:
+            case kTfLiteBuiltinSub:
+            case kTfLiteBuiltinMul:
+                for (int i = 0; i < 2; ++i)
+                {
+                    const int operand = graph.getInput (producer, i);
+                    std::vector<float> values;
+                    if (! graph.getConstant (operand, values))
+                    {
+                        pending.push_back (graph.resolve (operand));
+                    }
+                    else if (std::any_of (values.begin(), values.end(), [] (float v) { return v != 1.0f; }))
+                    {
+                        error = "Unexpected constant in the GRU cell";
+                        return false;
+                    }
+                }
+                break;
+            default:
+                error = "Unexpected op " + juce::String (code) + " in the GRU cell";
+                return false;
+        }
+    }
+
+    if (linearOutputs.size() != 2 || ! readsState)
+    {
+        error = "GRU cell does not have two projections";
+        return false;
+    }
+
+    // The state projection is the one reading the state.
+    int stateProjectionInput = -1, inputProjectionInput = -1;
+    DenseLayer first, second;
+    if (! matchLinear (graph, linearOutputs[0], first, stateProjectionInput)
+        || ! matchLinear (graph, linearOutputs[1], second, inputProjectionInput))
+    {
+        error = "Unsupported GRU projections";
+        return false;
+    }
+    if (graph.resolve (stateProjectionInput) != state)
+    {
+        std::swap (first, second);
+        std::swap (stateProjectionInput, inputProjectionInput);
+    }
+
+    const int stateSize = graph.getSize (stateInputTensor);
+    if (graph.resolve (stateProjectionInput) != state || graph.getSize (stateOutputTensor) != stateSize
+        || first.numRows != 3 * stateSize || second.numRows != 3 * stateSize || first.alpha != 1.0f
+        || second.alpha != 1.0f)
+    {
+        error = "Unexpected GRU projections";
+        return false;
+    }
+
+    gru.stateProjection = first;
+    gru.inputProjection = second;
+    gru.stateProjection.output = addVector (first.numRows);
+    gru.inputProjection.output = addVector (second.numRows);
+    input = inputProjectionInput;
+    return true;
+}
+
+bool NativeControlEngine::matchOutputTransform (const Graph& graph,
+                                                int tensor,
+                                                OutputTransform& transform,
+                                                int& headTensor)
+{
+    const int size = graph.getSize (tensor);
+    int current = graph.resolve (tensor);
+    const auto getCode = [&graph] (int t)
+    {
+        const int node = graph.getProducer (t);
+        return node >= 0 ? graph.getCode (node) : -1;
+    };
+
+    // Matches code (x, constant) or, if commutative, code (constant, x). Moves current to x.
+    const auto matchConstantOp = [&] (int code, bool commutative, std::vector<float>& values)
+    {
+        const int node = graph.getProducer (current);
+        if (node < 0 || graph.getCode (node) != code)
+        {
+            return false;
+        }
+        for (int i = 1; i >= (commutative ? 0 : 1); --i)
+        {
+            if (graph.getConstant (graph.getInput (node, i), values) && expandConstant (values, size))
+            {
+                current = graph.resolve (graph.getInput (node, 1 - i));
+                return true;
+            }
+        }
+        return false;
+    };
+
+    // Normalized by the sum over the output.
+    if (const int node = graph.getProducer (current); node >= 0 && graph.getCode (node) == kTfLiteBuiltinDiv)
+    {
+        const int numerator = graph.resolve (graph.getInput (node, 0));
+        const int sum = graph.getProducer (graph.getInput (node, 1));
+        if (sum < 0 || graph.getCode (sum) != kTfLiteBuiltinSum || graph.resolve (graph.getInput (sum, 0)) != numerator
+            || graph.getSize (graph.getInput (node, 1)) != 1)
+        {
+            return false;
+        }
+        transform.normalize = true;
+        current = numerator;
+    }
+
+    std::vector<float> bias (static_cast<size_t> (size), 0.0f), exponent (static_cast<size_t> (size), 1.0f);
+    std::vector<float> scale (static_cast<size_t> (size), 1.0f), offset (static_cast<size_t> (size), 0.0f);
+    std::vector<float> values;
+    if (matchConstantOp (kTfLiteBuiltinAdd, true, values))
+    {
+        offset = values;
+    }
+    if (matchConstantOp (kTfLiteBuiltinMul, true, values))
+    {
+        scale = values;
+    }
+    const bool hasExponent = matchConstantOp (kTfLiteBuiltinPow, false, values);
+    if (hasExponent)
+    {
+        exponent = values;
+    }
+    if (getCode (current) == kTfLiteBuiltinLogistic)
+    {
+        transform.sigmoid = true;
+        current = graph.resolve (graph.getInput (graph.getProducer (current), 0));
+    }
+    else if (hasExponent)
+    {
+        return false;
+    }
+    if (matchConstantOp (kTfLiteBuiltinAdd, true, values))
+    {
+        bias = values;
+    }
+    else if (matchConstantOp (kTfLiteBuiltinSub, false, values))
+    {
+        std::transform (values.begin(), values.end(), bias.begin(), std::negate<>());
+    }
+
+    // The rows of the head this output takes.
+    transform.size = size;
+    const int node = graph.getProducer (current);
+    const int code = getCode (current);
+    if (code == kTfLiteBuiltinFullyConnected)
+    {
+        headTensor = current;
+        transform.begin = 0;
+    }
+    else if (code == kTfLiteBuiltinSplit || code == kTfLiteBuiltinSplitV)
+    {
+        // Vectors are split into consecutive runs, whatever the axis.
+        headTensor = graph.resolve (graph.getInput (node, code == kTfLiteBuiltinSplit ? 1 : 0));
+        const TfLiteIntArray& splitOutputs = *graph.getNode (node).outputs;
+        int begin = 0, i = 0;
+        for (; i < splitOutputs.size && graph.resolve (splitOutputs.data[i]) != current; ++i)
+        {
+            begin += graph.getSize (splitOutputs.data[i]);
+        }
+        if (i == splitOutputs.size)
+        {
+            return false;
+        }
+        transform.begin = begin;
+    }
+    else if (code == kTfLiteBuiltinSlice || code == kTfLiteBuiltinStridedSlice)
+    {
+        headTensor = graph.resolve (graph.getInput (node, 0));
+        const TfLiteTensor& in = graph.getTensor (headTensor);
+        std::vector<int> begin;
+        if (! readConstantInts (graph.getTensor (graph.getInput (node, 1)), begin)
+            || static_cast<int> (begin.size()) != in.dims->size)
+        {
+            return false;
+        }
+        int beginMask = 0;
+        if (code == kTfLiteBuiltinStridedSlice)
+        {
+            const auto* params = static_cast<const TfLiteStridedSliceParams*> (graph.getNode (node).builtin_data);
+            std::vector<int> strides;
+            if (! readConstantInts (graph.getTensor (graph.getInput (node, 3)), strides) || params->ellipsis_mask != 0
+                || params->new_axis_mask != 0
+                || std::any_of (strides.begin(), strides.end(), [] (int s) { return s != 1; }))
+            {
+                return false;
+            }
+            beginMask = params->begin_mask;
+        }
+        // Offset of the first element, row-major.
+        int first = 0;
+        for (int i = 0; i < in.dims->size; ++i)
+        {
+            const int dim = in.dims->data[i];
+            const int start = (beginMask >> i) & 1 ? 0 : (begin[static_cast<size_t> (i)] + dim) % dim;
+            first = first * dim + start;
+        }
+        transform.begin = first;
+    }
+    else
+    {
+        return false;
+    }
+
+    if (getCode (headTensor) != kTfLiteBuiltinFullyConnected)
+    {
+        return false;
+    }
+
+    std::vector<float> parameters;
+    for (const auto* parameter : { &bias, &exponent, &scale, &offset })
+    {
+        parameters.insert (parameters.end(), parameter->begin(), parameter->end());
+    }
+    transform.parametersOffset = addParameters (parameters.data(), static_cast<int> (parameters.size()));
+    return true;
+}
+
+int NativeControlEngine::addVector (int size)
+{
+    vectorOffsets.push_back (static_cast<int> (staging.size()));
+    vectorSizes.push_back (size);
+    staging.resize (staging.size() + static_cast<size_t> (roundUp (size, kCacheLineFloats)));
+    return static_cast<int> (vectorSizes.size()) - 1;
+}
+
+int NativeControlEngine::addParameters (const float* values, int size)
+{
+    const auto offset = static_cast<int> (staging.size());
+    staging.insert (staging.end(), values, values + size);
+    staging.resize (static_cast<size_t> (offset + roundUp (size, kCacheLineFloats)));
+    return offset;
+}
+
+int NativeControlEngine::addWeights (const float* weights, int numRows, int numCols)
+{
+    const auto offset = static_cast<int> (staging.size());
+    staging.resize (staging.size() + static_cast<size_t> (roundUp (numRows, kPanelRows) * numCols));
+    packWeights (weights, numRows, numCols, staging.data() + offset);
+    // Panels are a multiple of 8 floats, keep the next run on its own cache line.
+    staging.resize (static_cast<size_t> (roundUp (static_cast<int> (staging.size()), kCacheLineFloats)));
+    return offset;
+}
+
+int NativeControlEngine::addConcatenation (const std::vector<int>& parts)
+{
+    if (parts.size() == 1)
+    {
+        return parts[0];
+    }
+    int size = 0;
+    for (const int part : parts)
+    {
+        size += vectorSizes[static_cast<size_t> (part)];
+    }
+    return addVector (size);
+}
+
+float NativeControlEngine::compareWith (tflite::Interpreter& reference, int numHops)
+{
+    const auto getName = [&reference] (int index) -> std::string_view
+    {
+        const char* name = reference.tensor (index)->name;
+        return name != nullptr ? name : "";
+    };
+
+    const int stateSize = vectorSizes[static_cast<size_t> (stateInput)];
+    std::vector<float> referenceState (static_cast<size_t> (stateSize), 0.0f);
+    std::fill_n (vectorData[static_cast<size_t> (stateInput)], stateSize, 0.0f);
+
+    std::vector<float> values;
+    float maxError = 0.0f;
+    for (int hop = 0; hop < numHops; ++hop)
+    {
+        // Every control input sweeps its range at its own rate.
+        int numControls = 0;
+        for (const int index : reference.inputs())
+        {
+            TypedTensor tensor = TypedTensor::fromTensor (*reference.tensor (index));
+            if (getName (index) == kInputTensorName_State)
+            {
+                tensor.write (referenceState.data(), stateSize);
+                continue;
+            }
+            const float value = 0.5f + 0.45f * std::sin (0.37f * static_cast<float> (hop) + 1.3f * numControls++);
+            values.assign (static_cast<size_t> (tensor.size), value);
+            tensor.write (values.data(), tensor.size);
+            std::copy (values.begin(), values.end(), getTensorData (getName (index)));
+        }
+
+        if (reference.Invoke() != kTfLiteOk)
+        {
+            return std::numeric_limits<float>::infinity();
+        }
+        invoke();
+
+        for (const int index : reference.outputs())
+        {
+            const TypedTensor tensor = TypedTensor::fromTensor (*reference.tensor (index));
+            values.resize (static_cast<size_t> (tensor.size));
+            tensor.read (values.data(), tensor.size);
+            const float* actual = getTensorData (getName (index));
+            for (int i = 0; i < tensor.size; ++i)
+            {
+                const float expected = values[static_cast<size_t> (i)];
+                // NaN compares false, so it stays the largest error.
+                const float difference = std::abs (actual[i] - expected) / std::max (1.0f, std::abs (expected));
+                maxError = difference <= maxError ? maxError : difference;
+            }
+            if (getName (index) == kOutputTensorName_State)
+            {
+                referenceState = values;
+            }
+        }
+        std::copy_n (vectorData[static_cast<size_t> (stateOutput)],
+                     stateSize,
+                     vectorData[static_cast<size_t> (stateInput)]);
+    }
+    return maxError;
+}
+
+int NativeControlEngine::findTensor (std::string_view name) const
+{
+    const auto it = std::find_if (
+        graphTensors.begin(), graphTensors.end(), [name] (const auto& entry) { return entry.first == name; });
+    return it != graphTensors.end() ? it->second : -1;
+}
+
+float* NativeControlEngine::getTensorData (std::string_view name) const
+{
+    const int index = findTensor (name);
+    return index >= 0 ? vectorData[static_cast<size_t> (index)] : nullptr;
+}
+
+int NativeControlEngine::getTensorSize (std::string_view name) const
+{
+    const int index = findTensor (name);
+    return index >= 0 ? vectorSizes[static_cast<size_t> (index)] : 0;
+}
+
+void NativeControlEngine::swapTensorData (std::string_view first, std::string_view second)
+{
+    const int firstIndex = findTensor (first);
+    const int secondIndex = findTensor (second);
+    jassert (firstIndex >= 0 && secondIndex >= 0
+             && vectorSizes[static_cast<size_t> (firstIndex)] == vectorSizes[static_cast<size_t> (secondIndex)]);
+    std::swap (vectorData[static_cast<size_t> (firstIndex)], vectorData[static_cast<size_t> (secondIndex)]);
+}
+
+void NativeControlEngine::concatenate (const std::vector<int>& parts, int output)
+{
+    if (parts.size() > 1)
+    {
+        float* out = vectorData[static_cast<size_t> (output)];
+        for (const int part : parts)
+        {
+            out = std::copy_n (vectorData[static_cast<size_t> (part)], vectorSizes[static_cast<size_t> (part)], out);
+        }
+    }
+}
+
+void NativeControlEngine::runDense (const DenseLayer& layer, const float* input, float* output) const
+{
+    const int size = layer.numRows;
+    gemv (arena + layer.weightsOffset,
+          input,
+          layer.biasOffset >= 0 ? arena + layer.biasOffset : nullptr,
+          output,
+          size,
+          layer.numCols);
+    if (! layer.layerNorm && layer.alpha == 1.0f)
+    {
+        return;
+    }
+
+    float mean = 0.0f, invStdDev = 1.0f;
+    if (layer.layerNorm)
+    {
+        mean = std::accumulate (output, output + size, 0.0f) / static_cast<float> (size);
+        float variance = 0.0f;
+        for (int i = 0; i < size; ++i)
+        {
+            variance += (output[i] - mean) * (output[i] - mean);
+        }
+        invStdDev = 1.0f / std::sqrt (variance / static_cast<float> (size) + layer.epsilon);
+    }
+
+    const float* gamma = layer.gammaOffset >= 0 ? arena + layer.gammaOffset : nullptr;
+    const float* beta = layer.betaOffset >= 0 ? arena + layer.betaOffset : nullptr;
+    for (int i = 0; i < size; ++i)
+    {
+        float y = (output[i] - mean) * invStdDev;
+        y = y * (gamma != nullptr ? gamma[i] : 1.0f) + (beta != nullptr ? beta[i] : 0.0f);
+        output[i] = y < 0.0f ? layer.alpha * y : y;
+    }
+}
+
+void NativeControlEngine::runStack (const Stack& stack)
+{
+    concatenate (stack.parts, stack.input);
+    const float* input = vectorData[static_cast<size_t> (stack.input)];
+    for (const DenseLayer& layer : stack.layers)
+    {
+        float* output = vectorData[static_cast<size_t> (layer.output)];
+        runDense (layer, input, output);
+        input = output;
+    }
+}
+
+void NativeControlEngine::runGruCell()
+{
+    concatenate (gru.parts, gru.input);
+    const float* state = vectorData[static_cast<size_t> (stateInput)];
+    float* x = vectorData[static_cast<size_t> (gru.inputProjection.output)];
+    float* h = vectorData[static_cast<size_t> (gru.stateProjection.output)];
+    runDense (gru.inputProjection, vectorData[static_cast<size_t> (gru.input)], x);
+    runDense (gru.stateProjection, state, h);
+
+    // h' = z h + (1 - z) tanh (x_n + r h_n), with z and r the sigmoid of x + h in their blocks.
+    const int stateSize = gru.stateProjection.numCols;
+    const int update = gru.gateBlocks[0] * stateSize;
+    const int reset = gru.gateBlocks[1] * stateSize;
+    const int candidate = gru.gateBlocks[2] * stateSize;
+    float* next = vectorData[static_cast<size_t> (stateOutput)];
+    for (int i = 0; i < stateSize; ++i)
+    {
+        const float z = sigmoid (x[update + i] + h[update + i]);
+        const float r = sigmoid (x[reset + i] + h[reset + i]);
+        const float n = std::tanh (x[candidate + i] + r * h[candidate + i]);
+        next[i] = z * state[i] + (1.0f - z) * n;
+    }
+}
+
+void NativeControlEngine::runOutputTransform (const OutputTransform& transform)
+{
+    const int size = transform.size;
+    const float* x = vectorData[static_cast<size_t> (heads[static_cast<size_t> (transform.head)].output)]
+                     + transform.begin;
+    const float* bias = arena + transform.parametersOffset;
+    const float* exponent = bias + size;
+    const float* scale = exponent + size;
+    const float* offset = scale + size;
+    float* y = vectorData[static_cast<size_t> (transform.output)];
+
+    float sum = 0.0f;
+    for (int i = 0; i < size; ++i)
+    {
+        float value = x[i] + bias[i];
+        if (transform.sigmoid)
+        {
+            value = sigmoid (value);
+            value = exponent[i] == 1.0f ? value : std::pow (value, exponent[i]);
+        }
+        y[i] = scale[i] * value + offset[i];
+        sum += y[i];
+    }
+    if (transform.normalize)
+    {
+        juce::FloatVectorOperations::multiply (y, 1.0f / sum, size);
+    }
+}
+
+void NativeControlEngine::invoke()
+{
+    for (const Stack& stack : inputStacks)
+    {
+        runStack (stack);
+    }
+    runGruCell();
+    runStack (outputStack);
+    const float* features = vectorData[static_cast<size_t> (outputStack.getOutput())];
+    for (const DenseLayer& head : heads)
+    {
+        runDense (head, features, vectorData[static_cast<size_t> (head.output)]);
+    }
+    for (const OutputTransform& transform : outputs)
+    {
+        runOutputTransform (transform);
+    }
+}
+
+} // namespace ddsp
@@ -0,0 +1,147 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "tensorflow/lite/interpreter.h"
+#include "tensorflow/lite/model.h"
+
+namespace ddsp
+{
+
+// Runs the DDSP control model, one GRU step between stacks of dense layers, with fused
+// native kernels instead of the TFLite interpreter. The architecture is recognized in the
+// graph once when the model is loaded, and its weights are copied out. Graphs that do not
+// match it, or whose outputs the native kernels do not reproduce, are rejected and the
+// caller keeps using TFLite.
+class NativeControlEngine
+{
+public:
+    // Returns nullptr with the reason in error if the model is not supported.
+    static std::unique_ptr<NativeControlEngine> create (const tflite::FlatBufferModel& model, juce::String& error);
+
+    // Storage of the graph input or output called name, nullptr if there is none.
+    float* getTensorData (std::string_view name) const;
+    int getTensorSize (std::string_view name) const;
+    // Exchanges the storage of two graph tensors of the same size, e.g. to feed an output
+    // back as the next input without copying.
+    void swapTensorData (std::string_view first, std::string_view second);
+
+    // Runs the model. Real-time safe.
+    void invoke();
+
+    size_t getMemoryFootprint() const { return arenaSize * sizeof (float); }
+
+private:
+    class Graph;
+
+    // Dense layer of an fc stack: y = W x + b, then a layer norm and a leaky ReLU, both optional.
+    // Members ending in Offset index the arena, -1 if absent.
+    struct DenseLayer
+    {
+        int numRows = 0, numCols = 0;
+        int weightsOffset = -1, biasOffset = -1;
+        bool layerNorm = false;
+        float epsilon = 0.0f;
+        int gammaOffset = -1, betaOffset = -1;
+        // Slope below zero, 1 without an activation.
+        float alpha = 1.0f;
+        int output = -1;
+    };
+
+    // Dense layers applied in turn to the concatenation of parts.
+    struct Stack
+    {
+        std::vector<int> parts;
+        int input = -1;
+        std::vector<DenseLayer> layers;
+
+        int getOutput() const { return layers.empty() ? input : layers.back().output; }
+    };
+
+    // Keras GRU step with reset_after, on the concatenated outputs of the input stacks.
+    // The rows of both projections hold the update, reset and candidate gates in blocks,
+    // in the order given by gateBlocks.
+    struct GruCell
+    {
+        std::vector<int> parts;
+        int input = -1;
+        DenseLayer inputProjection, stateProjection;
+        std::array<int, 3> gateBlocks { 0, 1, 2 };
+    };
+
+    // Graph output computed elementwise from rows [begin, begin + size) of a head:
+    // y = scale * sigmoid (x + bias) ^ exponent + offset, and divided by its sum if normalize
+    // is set. Without sigmoid, y = scale * (x + bias) + offset. The four parameters are stored
+    // one after another, size values each.
+    struct OutputTransform
+    {
+        int head = 0, begin = 0, size = 0;
+        bool sigmoid = false, normalize = false;
+        int parametersOffset = -1;
+        int output = -1;
+    };
+
+    NativeControlEngine() = default;
+
+    bool build (const Graph& graph, juce::String& error);
+    bool matchDenseLayer (const Graph& graph, int tensor, DenseLayer& layer, int& input);
+    bool matchLinear (const Graph& graph, int tensor, DenseLayer& layer, int& input);
+    bool matchGruCell (const Graph& graph, int stateInput, int stateOutput, int& input, juce::String& error);
+    bool matchOutputTransform (const Graph& graph, int tensor, OutputTransform& transform, int& headTensor);
+    Stack matchStack (const Graph& graph, int tensor, int& input);
+    // Vector to concatenate parts into, the part itself if there is only one.
+    int addConcatenation (const std::vector<int>& parts);
+    int addVector (int size);
+    int addParameters (const float* values, int size);
+    int addWeights (const float* weights, int numRows, int numCols);
+    // Largest difference to the reference over numHops hops of a fixed control sequence,
+    // relative to the reference values.
+    float compareWith (tflite::Interpreter& reference, int numHops);
+    int findTensor (std::string_view name) const;
+
+    void concatenate (const std::vector<int>& parts, int output);
+    void runDense (const DenseLayer& layer, const float* input, float* output) const;
+    void runStack (const Stack& stack);
+    void runGruCell();
+    void runOutputTransform (const OutputTransform& transform);
+
+    std::vector<Stack> inputStacks;
+    GruCell gru;
+    Stack outputStack;
+    std::vector<DenseLayer> heads;
+    std::vector<OutputTransform> outputs;
+    int stateInput = -1, stateOutput = -1;
+
+    // Every vector is a run of the arena, vectorData is indexed like vectorSizes.
+    std::vector<int> vectorOffsets, vectorSizes;
+    std::vector<float*> vectorData;
+    // Graph inputs and outputs by name, with the vector they are stored in.
+    std::vector<std::pair<std::string, int>> graphTensors;
+
+    // Weights, parameters and vectors, cache-line aligned. Filled in staging while the graph is
+    // matched, then copied to arena.
+    std::vector<float> staging;
+    juce::HeapBlock<float> arenaStorage;
+    float* arena = nullptr;
+    size_t arenaSize = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (NativeControlEngine)
+};
+
+} // namespace ddsp
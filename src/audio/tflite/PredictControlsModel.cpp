@@ -20,96 +20,247 @@ limitations under the License.
 namespace ddsp
 {
 
-PredictControlsModel::PredictControlsModel (const ModelInfo& mi)
-    : ModelBase (mi.data.begin(), mi.data.getSize(), kNumPredictControlsThreads)
+namespace
 {
-    reset();
-}
+    struct TensorBindingInfo
+    {
+        std::string_view name;
+        int size;
+        bool isInput;
+        TypedTensor PredictControlsModel::TensorBindings::*binding;
+    };
 
-void PredictControlsModel::call (const AudioFeatures& input, SynthesisControls& output)
+    using Bindings = PredictControlsModel::TensorBindings;
+
+    // Every I/O tensor the model must expose, in no particular order.
+    constexpr std::array<TensorBindingInfo, kNumPredictControlsInputTensors + kNumPredictControlsOutputTensors>
+        kTensorBindingTable = { {
+            { kInputTensorName_F0, kF0Size, true, &Bindings::f0 },
+            { kInputTensorName_Loudness, kLoudnessSize, true, &Bindings::loudness },
+            { kInputTensorName_State, kGruModelStateSize, true, &Bindings::stateIn },
+            { kOutputTensorName_Amplitude, kAmplitudeSize, false, &Bindings::amplitude },
+            { kOutputTensorName_Harmonics, kHarmonicsSize, false, &Bindings::harmonics },
+            { kOutputTensorName_NoiseAmps, kNoiseAmpsSize, false, &Bindings::noiseAmps },
+            { kOutputTensorName_State, kGruModelStateSize, false, &Bindings::stateOut },
+        } };
+} // namespace
+
+PredictControlsModel::PredictControlsModel (const ModelInfo& mi, Engine engine)
+    : ModelBase (mi.data.begin(), mi.data.getSize(), kNumPredictControlsThreads)
 {
-    for (int i = 0; i < interpreter->inputs().size(); ++i)
+    if (engine == Engine::kNative)
     {
-        const std::string_view inputName (interpreter->GetInputName (i));
-
-        if (inputName == kInputTensorName_F0)
+        juce::String error;
+        nativeEngine = NativeControlEngine::create (*modelBuffer, error);
+        if (nativeEngine != nullptr && ! bindNativeTensors())
         {
-            *interpreter->typed_input_tensor<float> (i) = input.f0_norm;
+            error = "Unexpected model inputs or outputs";
+            nativeEngine.reset();
         }
-        else if (inputName == kInputTensorName_Loudness)
+        if (nativeEngine == nullptr)
         {
-            *interpreter->typed_input_tensor<float> (i) = input.loudness_norm;
+            DBG ("Running " << mi.name << " with TFLite, the native engine does not support it: " << error);
         }
-        else if (inputName == kInputTensorName_State)
-        {
-            for (int j = 0; j < gruState.size(); j++)
-            {
-                interpreter->typed_input_tensor<float> (i)[j] = gruState[j];
-            }
-        }
-        else
+    }
+
+    if (nativeEngine != nullptr)
+    {
+        // The engine holds its own copy of the weights, so the interpreter would only double the memory.
+        interpreter.reset();
+    }
+    else
+    {
+        juce::StringArray errors;
+        tensors = bindTensors (*interpreter, errors);
+        jassert (errors.isEmpty());
+    }
+
+    // The first invocation can still allocate, e.g. while delegate kernels finish their setup.
+    // Models are built off the audio thread, so get it out of the way here.
+    SynthesisControls warmUpOutput;
+    call (AudioFeatures {}, warmUpOutput);
+    reset();
+}
+
+void PredictControlsModel::call (const AudioFeatures& input, SynthesisControls& output)
+{
+    tensors.f0.write (&input.f0_norm, 1);
+    tensors.loudness.write (&input.loudness_norm, 1);
+
+    if (nativeEngine != nullptr)
+    {
+        const EventTracer::ScopedTrace trace (*tracer, "PredictControls native invoke");
+        nativeEngine->invoke();
+    }
+    else
+    {
+        const EventTracer::ScopedTrace trace (*tracer, "PredictControls Invoke");
+        // Run tflite graph computation on input.
+        if (auto status = interpreter->Invoke(); status != kTfLiteOk)
         {
-            std::cerr << "Invalid tensor name: " + juce::StringRef (inputName.data()) << std::endl;
+            logger->log (LogEvent::kPredictControlsInvokeFailed, status);
         }
     }
 
-    // Run tflite graph computation on input.
-    if (auto status = interpreter->Invoke(); status != kTfLiteOk)
+    tensors.amplitude.read (&output.amplitude, 1);
+    tensors.harmonics.read (output.harmonics.data(), kHarmonicsSize);
+    tensors.noiseAmps.read (output.noiseAmps.data(), kNoiseAmpsSize);
+
+    // Carry the GRU state over to the next hop.
+    if (nativeEngine != nullptr)
     {
-        std::cerr << "Failed to compute, status code: " << status << std::endl;
+        nativeEngine->swapTensorData (kInputTensorName_State, kOutputTensorName_State);
+        std::swap (tensors.stateIn, tensors.stateOut);
     }
-
-    for (int i = 0; i < interpreter->outputs().size(); ++i)
+    else if (tensors.stateIn.hasSameEncoding (tensors.stateOut))
     {
-        const std::string_view outputName (interpreter->GetOutputName (i));
+        std::memcpy (tensors.stateIn.data, tensors.stateOut.data, tensors.stateIn.getNumBytes());
+    }
+    else
+    {
+        tensors.stateOut.read (stateScratch.data(), kGruModelStateSize);
+        tensors.stateIn.write (stateScratch.data(), kGruModelStateSize);
+    }
 
-        if (outputName == kOutputTensorName_Amplitude)
+    int numNaNs = 0;
+    for (int i = 0; i < kHarmonicsSize; ++i)
+    {
+        if (isnan (output.harmonics[i]))
         {
-            output.amplitude = *interpreter->typed_output_tensor<float> (i);
+            ++numNaNs;
+            output.harmonics[i] = 0.f;
+            output.amplitude = 0.f;
         }
-        else if (outputName == kOutputTensorName_Harmonics)
+    }
+    if (numNaNs > 0)
+    {
+        logger->log (LogEvent::kControlsNaN, numNaNs);
+    }
+
+    output.f0_hz = input.f0_hz;
+}
+
+PredictControlsModel::TensorBindings PredictControlsModel::bindTensors (tflite::Interpreter& interpreter,
+                                                                        juce::StringArray& errors)
+{
+    TensorBindings result;
+
+    const auto bindAll = [&] (const std::vector<int>& tensorIndices, bool isInput)
+    {
+        const std::string direction = isInput ? "input" : "output";
+
+        for (const int tensorIndex : tensorIndices)
         {
-            for (int j = 0; j < kHarmonicsSize; j++)
+            TfLiteTensor* tensor = interpreter.tensor (tensorIndex);
+            const std::string_view name (tensor->name != nullptr ? tensor->name : "");
+
+            const auto entry = std::find_if (kTensorBindingTable.begin(),
+                                             kTensorBindingTable.end(),
+                                             [&] (const TensorBindingInfo& info)
+                                             { return info.isInput == isInput && info.name == name; });
+
+            if (entry == kTensorBindingTable.end())
             {
-                output.harmonics[j] = interpreter->typed_output_tensor<float> (i)[j];
+                errors.add ("Invalid " + direction + " tensor name " + std::string (name) + "\n");
+                continue;
             }
-        }
-        else if (outputName == kOutputTensorName_NoiseAmps)
-        {
-            for (int j = 0; j < kNoiseAmpsSize; j++)
+
+            if ((result.*(entry->binding)).isBound())
             {
-                output.noiseAmps[j] = interpreter->typed_output_tensor<float> (i)[j];
+                errors.add ("Repeated " + direction + " tensor name " + std::string (name) + "\n");
+                continue;
             }
-        }
-        else if (outputName == kOutputTensorName_State)
-        {
-            for (int j = 0; j < gruState.size(); j++)
+
+            if (! TypedTensor::isSupported (*tensor))
+            {
+                errors.add ("Unsupported tensor type " + std::string (TfLiteTypeGetName (tensor->type)) + " for "
+                            + std::string (name) + "\n");
+                continue;
+            }
+
+            // A wrongly sized tensor is still bound so it is not reported as missing as well.
+            const int size = getNumElements (*tensor);
+            if (size != entry->size)
             {
-                gruState[j] = interpreter->typed_output_tensor<float> (i)[j];
+                errors.add ("Invalid tensor size " + std::to_string (size) + " for " + std::string (name) + "\n");
             }
+
+            result.*(entry->binding) = TypedTensor::fromTensor (*tensor);
         }
-        else
+    };
+
+    bindAll (interpreter.inputs(), true);
+    bindAll (interpreter.outputs(), false);
+
+    for (const auto& info : kTensorBindingTable)
+    {
+        if (! (result.*(info.binding)).isBound())
         {
-            std::cerr << "Invalid tensor name: " + juce::StringRef (outputName.data()) << std::endl;
+            errors.add ("Missing tensor " + std::string (info.name) + "\n");
         }
     }
 
-    for (int i = 0; i < kHarmonicsSize; ++i)
+    return result;
+}
+
+void PredictControlsModel::reset()
+{
+    // The state lives in the state input tensor between calls.
+    tensors.stateIn.clear();
+}
+
+ModelDescription PredictControlsModel::describe (int numProfiledInvocations)
+{
+    if (nativeEngine == nullptr)
     {
-        if (isnan (output.harmonics[i]))
+        auto description = ModelBase::describe (numProfiledInvocations);
+        reset();
+        return description;
+    }
+
+    // The interpreter was dropped for the engine, describe the graph with a temporary one.
+    auto temporary = buildInterpreter();
+    auto status = temporary->AllocateTensors();
+    jassert (status == kTfLiteOk);
+    juce::ignoreUnused (status);
+    auto description = describeInterpreter (*temporary);
+    profileInterpreter (*temporary, numProfiledInvocations, description);
+
+    description.engine = "native";
+    if (numProfiledInvocations > 0)
+    {
+        std::vector<double> invokeTimes_us;
+        for (int i = 0; i < numProfiledInvocations; ++i)
         {
-            DBG ("is_nan");
-            output.harmonics[i] = 0.f;
-            output.amplitude = 0.f;
+            const auto start = juce::Time::getHighResolutionTicks();
+            nativeEngine->invoke();
+            invokeTimes_us.push_back (
+                1.0e6 * juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start));
         }
+        description.setInvokeTimes (std::move (invokeTimes_us));
     }
+    reset();
+    return description;
+}
 
-    output.f0_hz = input.f0_hz;
+bool PredictControlsModel::bindNativeTensors()
+{
+    for (const auto& info : kTensorBindingTable)
+    {
+        float* data = nativeEngine->getTensorData (info.name);
+        if (data == nullptr || nativeEngine->getTensorSize (info.name) != info.size)
+        {
+            return false;
+        }
+        tensors.*(info.binding) = TypedTensor::fromFloats (data, info.size);
+    }
+    return true;
 }
 
-void PredictControlsModel::reset()
+size_t PredictControlsModel::getMemoryFootprint() const
 {
-    juce::FloatVectorOperations::clear (gruState.data(), static_cast<int> (gruState.size()));
+    return ModelBase::getMemoryFootprint() + sizeof (stateScratch)
+           + (nativeEngine != nullptr ? nativeEngine->getMemoryFootprint() : 0);
 }
 
 const PredictControlsModel::Metadata PredictControlsModel::getMetadata (const ModelInfo& mi)
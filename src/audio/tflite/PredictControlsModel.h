@@ -21,6 +21,10 @@ limitations under the License.
 #include "audio/tflite/ModelBase.h"
 #include "audio/tflite/ModelLibrary.h"
 #include "audio/tflite/ModelTypes.h"
+#include "audio/tflite/NativeControlEngine.h"
+#include "audio/tflite/TypedTensor.h"
+#include "util/EventTracer.h"
+#include "util/RealtimeLogger.h"
 
 namespace ddsp
 {
@@ -28,11 +32,31 @@ namespace ddsp
 class PredictControlsModel : public ModelBase<AudioFeatures, SynthesisControls>
 {
 public:
-    PredictControlsModel (const ModelInfo& mi);
+    enum class Engine
+    {
+        kTFLite = 0,
+        kNative
+    };
+
+#if DDSP_ENABLE_NATIVE_ENGINE
+    static constexpr Engine kDefaultEngine = Engine::kNative;
+#else
+    static constexpr Engine kDefaultEngine = Engine::kTFLite;
+#endif
+
+    // The native engine is used if requested and it supports the model's graph, TFLite otherwise.
+    // With the native engine no TFLite interpreter is kept.
+    PredictControlsModel (const ModelInfo& mi, Engine engine = kDefaultEngine);
 
     void call (const AudioFeatures& input, SynthesisControls& output) override;
     void reset();
 
+    Engine getEngine() const { return nativeEngine != nullptr ? Engine::kNative : Engine::kTFLite; }
+    size_t getMemoryFootprint() const override;
+    // Per-op timings are always TFLite's, from a temporary interpreter with the native engine.
+    // The invocation times are those of the engine in use. Profiling resets the GRU state.
+    ModelDescription describe (int numProfiledInvocations = 0) override;
+
     // Metadata for UI rendering.
     struct Metadata
     {
@@ -46,9 +70,41 @@ public:
 
     static const Metadata getMetadata (const ModelInfo& mi);
 
+    // The interpreter's I/O tensors, resolved once after tensor allocation. Quantized and
+    // float16 tensors are converted from and to floats when they are written and read.
+    struct TensorBindings
+    {
+        TypedTensor f0;
+        TypedTensor loudness;
+        TypedTensor stateIn;
+        TypedTensor amplitude;
+        TypedTensor harmonics;
+        TypedTensor noiseAmps;
+        TypedTensor stateOut;
+    };
+
+    // Resolves every tensor role in the binding table against the interpreter's inputs and outputs.
+    // Missing, unknown, repeated, wrongly sized or unsupported tensors are reported through errors.
+    // Used by both the model itself and ModelLibrary::validateModel().
+    static TensorBindings bindTensors (tflite::Interpreter& interpreter, juce::StringArray& errors);
+
 private:
-    // GRU model state.
-    std::array<float, kGruModelStateSize> gruState;
+    // Rebinds every tensor role to the native engine. False if one is missing or wrongly sized.
+    bool bindNativeTensors();
+
+    // Tensors of the interpreter, or of the native engine when it runs. The GRU state is carried
+    // from the state output to the state input after each call with one block copy. A second
+    // interpreter with the two crosswise would avoid the copy, at the cost of a second arena and
+    // of the delegate's packed weights, many times the 2 KiB state of a pooled model.
+    TensorBindings tensors;
+    // Converts the state between encodings.
+    std::array<float, kGruModelStateSize> stateScratch {};
+
+    // Runs the model instead of the interpreter when set. The bindings then point into it.
+    std::unique_ptr<NativeControlEngine> nativeEngine;
+
+    juce::SharedResourcePointer<RealtimeLogger> logger;
+    juce::SharedResourcePointer<EventTracer> tracer;
 };
 
 } // namespace ddsp
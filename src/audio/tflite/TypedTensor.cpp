@@ -0,0 +1,286 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+Post-training quantization leaves the I/O tensors of a model either float32
+(dynamic range and float16 exports, which only shrink the weights) or int8
+(full integer exports). Quantized values map to real ones as
+scale * (q - zeroPoint), with one scale and zero point per tensor.
+
+The float16 conversion works on the bit patterns and rounds to nearest even
+like the hardware instructions do, so it needs no F16C or NEON fp16 support.
+*/
+
+#include "audio/tflite/TypedTensor.h"
+
+namespace ddsp
+{
+
+namespace
+{
+    float halfToFloat (uint16_t half)
+    {
+        const uint32_t sign = static_cast<uint32_t> (half & 0x8000u) << 16;
+        uint32_t exponent = (half >> 10) & 0x1fu;
+        uint32_t mantissa = half & 0x3ffu;
+
+        uint32_t bits;
+        if (exponent == 0x1fu)
+        {
+            // Infinity or NaN.
+            bits = sign | 0x7f800000u | (mantissa << 13);
+        }
+        else if (exponent != 0)
+        {
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        }
+        else if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Subnormal, normalized for float.
+            exponent = 113;
+            while ((mantissa & 0x400u) == 0)
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+
+        float value;
+        std::memcpy (&value, &bits, sizeof (value));
+        return value;
+    }
+
+    uint16_t floatToHalf (float value)
+    {
+        uint32_t bits;
+        std::memcpy (&bits, &value, sizeof (bits));
+        const auto sign = static_cast<uint16_t> ((bits >> 16) & 0x8000u);
+        const uint32_t magnitude = bits & 0x7fffffffu;
+
+        if (magnitude >= 0x7f800000u)
+        {
+            // Infinity or NaN, which stays a NaN.
+            return static_cast<uint16_t> (sign | 0x7c00u | (magnitude > 0x7f800000u ? 0x200u : 0u));
+        }
+        if (magnitude >= 0x477ff000u)
+        {
+            // Rounds to more than the largest half, 65504.
+            return static_cast<uint16_t> (sign | 0x7c00u);
+        }
+        if (magnitude < 0x38800000u)
+        {
+            // Below the smallest normal half, 2^-14, in steps of 2^-24.
+            if (magnitude < 0x33000000u)
+            {
+                return sign;
+            }
+            const uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+            const int shift = 126 - static_cast<int> (magnitude >> 23);
+            uint32_t result = mantissa >> shift;
+            const uint32_t remainder = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (result & 1u)))
+            {
+                ++result;
+            }
+            return static_cast<uint16_t> (sign | result);
+        }
+
+        // Rebias the exponent from 127 to 15 and round the mantissa from 23 to 10 bits.
+        uint32_t result = (magnitude - 0x38000000u) >> 13;
+        const uint32_t remainder = magnitude & 0x1fffu;
+        if (remainder > 0x1000u || (remainder == 0x1000u && (result & 1u)))
+        {
+            ++result;
+        }
+        return static_cast<uint16_t> (sign | result);
+    }
+
+    template <typename Integer>
+    void quantize (const float* values, Integer* quantized, int numValues, float scale, int32_t zeroPoint)
+    {
+        const float inverseScale = 1.0f / scale;
+        for (int i = 0; i < numValues; ++i)
+        {
+            const auto q = static_cast<int32_t> (std::lround (values[i] * inverseScale)) + zeroPoint;
+            quantized[i] = static_cast<Integer> (juce::jlimit<int32_t> (std::numeric_limits<Integer>::min(),
+                                                                        std::numeric_limits<Integer>::max(),
+                                                                        q));
+        }
+    }
+
+    template <typename Integer>
+    void dequantize (const Integer* quantized, float* values, int numValues, float scale, int32_t zeroPoint)
+    {
+        for (int i = 0; i < numValues; ++i)
+        {
+            values[i] = scale * static_cast<float> (static_cast<int32_t> (quantized[i]) - zeroPoint);
+        }
+    }
+} // namespace
+
+int getNumElements (const TfLiteTensor& tensor)
+{
+    if (tensor.dims == nullptr)
+    {
+        return 0;
+    }
+    int size = 1;
+    for (int i = 0; i < tensor.dims->size; ++i)
+    {
+        size *= tensor.dims->data[i];
+    }
+    return size;
+}
+
+bool TypedTensor::isSupported (const TfLiteTensor& tensor)
+{
+    switch (tensor.type)
+    {
+        case kTfLiteFloat32:
+        case kTfLiteFloat16:
+            return true;
+        case kTfLiteInt8:
+        case kTfLiteUInt8:
+        {
+            // Per-channel quantization has no single scale.
+            if (tensor.quantization.type == kTfLiteAffineQuantization && tensor.quantization.params != nullptr)
+            {
+                const auto* affine = static_cast<const TfLiteAffineQuantization*> (tensor.quantization.params);
+                if (affine->scale != nullptr && affine->scale->size > 1)
+                {
+                    return false;
+                }
+            }
+            return tensor.params.scale > 0.0f;
+        }
+        default:
+            return false;
+    }
+}
+
+TypedTensor TypedTensor::fromTensor (TfLiteTensor& tensor)
+{
+    jassert (isSupported (tensor));
+    TypedTensor result;
+    result.data = tensor.data.raw;
+    result.type = tensor.type;
+    result.size = getNumElements (tensor);
+    if (tensor.type == kTfLiteInt8 || tensor.type == kTfLiteUInt8)
+    {
+        result.scale = tensor.params.scale;
+        result.zeroPoint = tensor.params.zero_point;
+    }
+    return result;
+}
+
+TypedTensor TypedTensor::fromFloats (float* data, int size)
+{
+    TypedTensor result;
+    result.data = data;
+    result.type = kTfLiteFloat32;
+    result.size = size;
+    return result;
+}
+
+size_t TypedTensor::getNumBytes() const
+{
+    switch (type)
+    {
+        case kTfLiteFloat32:
+            return sizeof (float) * static_cast<size_t> (size);
+        case kTfLiteFloat16:
+            return sizeof (uint16_t) * static_cast<size_t> (size);
+        default:
+            return static_cast<size_t> (size);
+    }
+}
+
+bool TypedTensor::hasSameEncoding (const TypedTensor& other) const
+{
+    return type == other.type && scale == other.scale && zeroPoint == other.zeroPoint;
+}
+
+void TypedTensor::write (const float* values, int numValues)
+{
+    jassert (numValues <= size);
+    switch (type)
+    {
+        case kTfLiteFloat32:
+            std::memcpy (data, values, sizeof (float) * static_cast<size_t> (numValues));
+            break;
+        case kTfLiteFloat16:
+            std::transform (values, values + numValues, static_cast<uint16_t*> (data), floatToHalf);
+            break;
+        case kTfLiteInt8:
+            quantize (values, static_cast<int8_t*> (data), numValues, scale, zeroPoint);
+            break;
+        case kTfLiteUInt8:
+            quantize (values, static_cast<uint8_t*> (data), numValues, scale, zeroPoint);
+            break;
+        default:
+            jassertfalse;
+    }
+}
+
+void TypedTensor::read (float* values, int numValues) const
+{
+    jassert (numValues <= size);
+    switch (type)
+    {
+        case kTfLiteFloat32:
+            std::memcpy (values, data, sizeof (float) * static_cast<size_t> (numValues));
+            break;
+        case kTfLiteFloat16:
+        {
+            const auto* halves = static_cast<const uint16_t*> (data);
+            std::transform (halves, halves + numValues, values, halfToFloat);
+            break;
+        }
+        case kTfLiteInt8:
+            dequantize (static_cast<const int8_t*> (data), values, numValues, scale, zeroPoint);
+            break;
+        case kTfLiteUInt8:
+            dequantize (static_cast<const uint8_t*> (data), values, numValues, scale, zeroPoint);
+            break;
+        default:
+            jassertfalse;
+    }
+}
+
+void TypedTensor::clear()
+{
+    if (type == kTfLiteInt8 || type == kTfLiteUInt8)
+    {
+        // Every element encodes 0 as the same byte.
+        const float zero = 0.0f;
+        write (&zero, 1);
+        auto* bytes = static_cast<uint8_t*> (data);
+        std::memset (bytes + 1, bytes[0], static_cast<size_t> (size - 1));
+    }
+    else
+    {
+        // 0 is all zero bits in both float types.
+        std::memset (data, 0, getNumBytes());
+    }
+}
+
+} // namespace ddsp
@@ -0,0 +1,59 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "tensorflow/lite/c/common.h"
+
+namespace ddsp
+{
+
+// Number of elements of tensor, whatever its type.
+int getNumElements (const TfLiteTensor& tensor);
+
+// Model input or output tensor of one of the types our models can be exported with: float32,
+// float16, and int8 or uint8 with per-tensor affine quantization. The rest of the plugin only
+// deals in floats, values are converted to and from the tensor's type at this boundary.
+struct TypedTensor
+{
+    void* data = nullptr;
+    TfLiteType type = kTfLiteNoType;
+    int size = 0;
+    // Quantized tensors hold round (value / scale) + zeroPoint.
+    float scale = 1.0f;
+    int32_t zeroPoint = 0;
+
+    // True if the tensor's type and quantization are supported.
+    static bool isSupported (const TfLiteTensor& tensor);
+    static TypedTensor fromTensor (TfLiteTensor& tensor);
+    static TypedTensor fromFloats (float* data, int size);
+
+    bool isBound() const { return data != nullptr; }
+    size_t getNumBytes() const;
+    // Same type and quantization, so the raw data can be copied between the tensors.
+    bool hasSameEncoding (const TypedTensor& other) const;
+
+    // Converts numValues floats into the tensor.
+    void write (const float* values, int numValues);
+    // Converts the first numValues elements of the tensor to floats.
+    void read (float* values, int numValues) const;
+    // Sets every element to the encoding of 0.
+    void clear();
+};
+
+} // namespace ddsp
@@ -0,0 +1,150 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+Interpreters are built with BuiltinOpResolverWithoutDefaultDelegates, so no
+delegate is applied unless we do it here. ModifyGraphWithDelegate replaces
+every run of supported nodes in the execution plan with one delegate node,
+whose builtin data lists the nodes it took over. Nodes left in the plan
+without a delegate run on the builtin TFLite kernels.
+
+One delegate is applied to the interpreters of every model, and must outlive
+all of them. The TFLite C API cannot hand an external pthreadpool to separate
+delegates, so the pool is shared by sharing the delegate. With one thread
+XNNPACK creates no pool at all.
+*/
+
+#include "audio/tflite/XNNPackDelegate.h"
+
+#if DDSP_ENABLE_XNNPACK
+
+#include "tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace ddsp
+{
+
+XNNPackDelegate::Options XNNPackDelegate::Options::parse (const juce::String& text)
+{
+    Options result;
+    for (const auto& item : juce::StringArray::fromTokens (text, ",", ""))
+    {
+        const auto trimmed = item.trim();
+        if (trimmed == "off")
+        {
+            result.enabled = false;
+        }
+        else if (trimmed.startsWith ("threads:"))
+        {
+            result.numThreads = std::max (1, trimmed.fromFirstOccurrenceOf (":", false, false).getIntValue());
+        }
+        else if (trimmed == "float")
+        {
+            result.enableQuantized = false;
+        }
+        else if (trimmed == "fp16")
+        {
+            result.forceFp16 = true;
+        }
+    }
+    return result;
+}
+
+XNNPackDelegate::XNNPackDelegate() : options (Options::parse (std::getenv ("DDSP_XNNPACK")))
+{
+    if (! options.enabled)
+    {
+        return;
+    }
+
+    TfLiteXNNPackDelegateOptions xnnpackOptions = TfLiteXNNPackDelegateOptionsDefault();
+    xnnpackOptions.num_threads = options.numThreads;
+    xnnpackOptions.flags &= ~(TFLITE_XNNPACK_DELEGATE_FLAG_QS8 | TFLITE_XNNPACK_DELEGATE_FLAG_QU8);
+    if (options.enableQuantized)
+    {
+        xnnpackOptions.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_QS8 | TFLITE_XNNPACK_DELEGATE_FLAG_QU8;
+    }
+    if (options.forceFp16)
+    {
+        xnnpackOptions.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_FORCE_FP16;
+    }
+
+    delegate = TfLiteXNNPackDelegateCreate (&xnnpackOptions);
+    if (delegate == nullptr)
+    {
+        juce::Logger::writeToLog ("XNNPACK: failed to create the delegate, models run on TFLite kernels");
+    }
+}
+
+XNNPackDelegate::~XNNPackDelegate()
+{
+    if (delegate != nullptr)
+    {
+        TfLiteXNNPackDelegateDelete (delegate);
+    }
+}
+
+bool XNNPackDelegate::apply (tflite::Interpreter& interpreter)
+{
+    if (delegate == nullptr)
+    {
+        return false;
+    }
+
+    const size_t numOps = interpreter.execution_plan().size();
+    if (interpreter.ModifyGraphWithDelegate (delegate) != kTfLiteOk)
+    {
+        juce::Logger::writeToLog ("XNNPACK: failed to apply the delegate, falling back to TFLite kernels");
+        return false;
+    }
+
+    int numDelegatedOps = 0;
+    std::map<juce::String, int> undelegatedOps;
+    for (const int nodeIndex : interpreter.execution_plan())
+    {
+        const auto* nodeAndRegistration = interpreter.node_and_registration (nodeIndex);
+        const TfLiteNode& node = nodeAndRegistration->first;
+        if (node.delegate == delegate)
+        {
+            const auto* params = static_cast<const TfLiteDelegateParams*> (node.builtin_data);
+            numDelegatedOps += params->nodes_to_replace->size;
+        }
+        else
+        {
+            const auto code = static_cast<tflite::BuiltinOperator> (nodeAndRegistration->second.builtin_code);
+            ++undelegatedOps[tflite::EnumNameBuiltinOperator (code)];
+        }
+    }
+
+    juce::String message;
+    message << "XNNPACK: delegated " << numDelegatedOps << " of " << static_cast<int> (numOps) << " ops on "
+            << options.numThreads << " shared threads";
+    if (! undelegatedOps.empty())
+    {
+        juce::StringArray kept;
+        for (const auto& [name, count] : undelegatedOps)
+        {
+            kept.add (name + " x" + juce::String (count));
+        }
+        message << ", kept on TFLite: " << kept.joinIntoString (", ");
+    }
+    juce::Logger::writeToLog (message);
+    return true;
+}
+
+} // namespace ddsp
+
+#endif
@@ -0,0 +1,76 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "util/Constants.h"
+
+#include "tensorflow/lite/interpreter.h"
+
+#if DDSP_ENABLE_XNNPACK
+
+namespace ddsp
+{
+
+// The XNNPACK delegate shared by every model in the process, held through
+// juce::SharedResourcePointer<XNNPackDelegate>. Sharing the delegate shares its pthreadpool, so
+// loading more models or plugin instances does not start more threads. Concurrent invocations
+// queue on the pool.
+//
+// The options are read from the DDSP_XNNPACK environment variable when the delegate is created,
+// see Options::parse(). Unset, every model is delegated with the defaults.
+class XNNPackDelegate
+{
+public:
+    struct Options
+    {
+        bool enabled = true;
+        // Size of the shared pool, 1 runs delegated ops on the invoking thread without a pool.
+        int numThreads = kNumFeatureExtractionThreads;
+        // Delegate int8 and uint8 ops, otherwise only float ones.
+        bool enableQuantized = true;
+        // Compute float ops in half precision, even on hardware without native support.
+        bool forceFp16 = false;
+
+        // Comma-separated items, each overriding one default: "off", "threads:<n>", "float"
+        // to leave quantized ops on TFLite and "fp16". Unknown items are ignored.
+        static Options parse (const juce::String& text);
+    };
+
+    XNNPackDelegate();
+    ~XNNPackDelegate();
+
+    // False if disabled or the delegate could not be created.
+    bool isEnabled() const { return delegate != nullptr; }
+    const Options& getOptions() const { return options; }
+
+    // Hands the ops XNNPACK supports to the delegate and logs which ones stay on TFLite.
+    // Returns false if the delegate is disabled or could not be applied, in which case
+    // the interpreter must be rebuilt without it. The delegate must outlive the interpreter.
+    bool apply (tflite::Interpreter& interpreter);
+
+private:
+    const Options options;
+    TfLiteDelegate* delegate = nullptr;
+
+    JUCE_DECLARE_NON_COPYABLE (XNNPackDelegate)
+};
+
+} // namespace ddsp
+
+#endif
@@ -36,7 +36,8 @@ ContentComponent::ContentComponent (DDSPAudioProcessor& audioProcessor)
     : audioProcessor (audioProcessor),
       topPanel (audioProcessor),
       modelVisualizer (audioProcessor),
-      bottomPanel (audioProcessor)
+      bottomPanel (audioProcessor),
+      performanceOverlay (audioProcessor)
 {
     pitchLabel.reset (new juce::Label ("new label", TRANS ("Pitch")));
     addAndMakeVisible (pitchLabel.get());
@@ -69,6 +70,7 @@ ContentComponent::ContentComponent (DDSPAudioProcessor& audioProcessor)
     addAndMakeVisible (&topPanel);
     addAndMakeVisible (&bottomPanel);
     addAndMakeVisible (&modelVisualizer);
+    addChildComponent (&performanceOverlay);
 
     topPanel.addChangeListener (&modelVisualizer);
 
@@ -130,4 +132,20 @@ void ContentComponent::resized()
     modelVisualizerArea.removeFromTop (40);
     modelVisualizerArea.removeFromRight (30);
     modelVisualizer.setBounds (modelVisualizerArea);
+
+    performanceOverlay.setBounds (middlePanelArea.reduced (kPadding * 2, kPadding).removeFromTop (160));
+}
+
+void ContentComponent::mouseDoubleClick (const juce::MouseEvent& e)
+{
+    if (e.mods.isAltDown())
+    {
+        setPerformanceOverlayVisible (! performanceOverlay.isVisible());
+    }
+}
+
+void ContentComponent::setPerformanceOverlayVisible (bool shouldBeVisible)
+{
+    performanceOverlay.setVisible (shouldBeVisible);
+    performanceOverlay.toFront (false);
 }
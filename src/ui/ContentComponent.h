@@ -20,6 +20,7 @@ limitations under the License.
 #include "PluginProcessor.h"
 #include "ui/BottomPanelComponent.h"
 #include "ui/ModelRangeVisualizerComponent.h"
+#include "ui/PerformanceOverlayComponent.h"
 #include "ui/TopPanelComponent.h"
 
 class ContentComponent : public juce::Component
@@ -30,6 +31,10 @@ public:
 
     void paint (juce::Graphics& g) override;
     void resized() override;
+    // Alt + double-click on the background toggles the performance overlay.
+    void mouseDoubleClick (const juce::MouseEvent& e) override;
+
+    void setPerformanceOverlayVisible (bool shouldBeVisible);
 
 private:
     void updateModelMetadata();
@@ -38,6 +43,7 @@ private:
     juce::Rectangle<int> middlePanelArea;
     ModelRangeVisualizerComponent modelVisualizer;
     BottomPanelComponent bottomPanel;
+    PerformanceOverlayComponent performanceOverlay;
 
     std::unique_ptr<juce::Label> pitchLabel;
     std::unique_ptr<juce::Label> loudnessLabel;
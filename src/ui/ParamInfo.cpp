@@ -15,6 +15,7 @@ limitations under the License.
 */
 
 #include "ui/ParamInfo.h"
+#include "util/Constants.h"
 
 std::map<juce::String, std::vector<ParamInfo>> getSliderParamsInfo()
 {
@@ -47,6 +48,13 @@ juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout()
 
     layout.add (std::make_unique<juce::AudioParameterFloat> ("InputGain", "Input Gain", -0.5f, 0.5f, 0.0f));
     layout.add (std::make_unique<juce::AudioParameterFloat> ("InputPitch", "Input Pitch", -0.5f, 0.5f, 0.0f));
+    // Index of the active model in the model list, automation switches between pooled models.
+    layout.add (std::make_unique<juce::AudioParameterInt> ("ModelSlot", "Model Slot", 0, ddsp::kNumModelSlots - 1, 0));
+#if ! JucePlugin_IsSynth
+    // Pitch and loudness estimator, in the order of ddsp::FeatureExtractorType.
+    layout.add (std::make_unique<juce::AudioParameterChoice> (
+        "FeatureExtractor", "Feature Extractor", juce::StringArray { "TFLite", "Native" }, 0));
+#endif
 
     // Scene-related params.
     const auto paramInfos = getSliderParamsInfo();
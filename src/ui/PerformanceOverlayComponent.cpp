@@ -0,0 +1,108 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include "ui/PerformanceOverlayComponent.h"
+#include "ui/DDSPLookAndFeel.h"
+
+using namespace ddsp;
+
+constexpr int kOverlayRefreshInterval_ms = 250;
+constexpr int kOverlayLineHeight = 16;
+
+PerformanceOverlayComponent::PerformanceOverlayComponent (DDSPAudioProcessor& p) : audioProcessor (p)
+{
+    // Only informative, clicks go through to the editor.
+    setInterceptsMouseClicks (false, false);
+}
+
+PerformanceOverlayComponent::~PerformanceOverlayComponent()
+{
+    if (isVisible())
+    {
+        audioProcessor.setProfilingEnabled (false);
+    }
+}
+
+void PerformanceOverlayComponent::visibilityChanged()
+{
+    audioProcessor.setProfilingEnabled (isVisible());
+    if (isVisible())
+    {
+        timerCallback();
+        startTimer (kOverlayRefreshInterval_ms);
+    }
+    else
+    {
+        stopTimer();
+    }
+}
+
+void PerformanceOverlayComponent::timerCallback()
+{
+    report = audioProcessor.getRenderTimings();
+    repaint();
+}
+
+void PerformanceOverlayComponent::paint (juce::Graphics& g)
+{
+    g.setColour (juce::Colours::black.withAlpha (0.75f));
+    g.fillRoundedRectangle (getLocalBounds().toFloat(), kCornerSize);
+
+    auto area = getLocalBounds().reduced (kPadding);
+    g.setFont (juce::Font (juce::Font::getDefaultMonospacedFontName(), kTextSize - 2.0f, juce::Font::plain));
+
+    auto drawLine = [&] (const juce::String& text, juce::Colour colour)
+    {
+        g.setColour (colour);
+        g.drawText (text, area.removeFromTop (kOverlayLineHeight), juce::Justification::centredLeft, false);
+    };
+
+    const auto& hops = report[RenderStage::kHop];
+    if (hops.count == 0)
+    {
+        drawLine ("Waiting for audio...", juce::Colours::white);
+        return;
+    }
+
+    drawLine (juce::String::formatted ("Hop budget %.0f us, real-time factor %.3f, %lld hops",
+                                       report.hopBudget_us,
+                                       report.realTimeFactor,
+                                       static_cast<long long> (hops.count)),
+              juce::Colours::white);
+    drawLine (juce::String::formatted ("%-19s %8s %8s %8s %6s", "stage", "p50 us", "p99 us", "max us", "p99 %"),
+              juce::Colours::lightgrey);
+
+    for (int i = 0; i < static_cast<int> (RenderStage::kNumStages); ++i)
+    {
+        const auto stage = static_cast<RenderStage> (i);
+        const auto& timings = report[stage];
+        if (timings.count == 0)
+        {
+            continue;
+        }
+        // Stages using most of the hop are the first to cause underflows.
+        const double p99Fraction = report.getBudgetFraction (timings.p99_us);
+        const auto colour = p99Fraction > 0.5 ? juce::Colours::orangered
+                                              : (p99Fraction > 0.25 ? juce::Colours::orange : juce::Colours::white);
+        drawLine (juce::String::formatted ("%-19s %8.1f %8.1f %8.1f %6.1f",
+                                           getRenderStageName (stage),
+                                           timings.p50_us,
+                                           timings.p99_us,
+                                           timings.max_us,
+                                           100.0 * p99Fraction),
+                  colour);
+    }
+}
@@ -0,0 +1,41 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+#include "PluginProcessor.h"
+
+// Render timings of the processor, drawn over the editor. Profiling is enabled while the overlay
+// is visible, so a hidden overlay costs nothing on the render thread.
+class PerformanceOverlayComponent : public juce::Component, private juce::Timer
+{
+public:
+    PerformanceOverlayComponent (DDSPAudioProcessor& p);
+    ~PerformanceOverlayComponent() override;
+
+    void paint (juce::Graphics& g) override;
+    void visibilityChanged() override;
+
+private:
+    void timerCallback() override;
+
+    DDSPAudioProcessor& audioProcessor;
+    ddsp::StageProfiler::Report report;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PerformanceOverlayComponent)
+};
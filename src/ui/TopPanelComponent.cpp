@@ -19,7 +19,17 @@ limitations under the License.
 
 using namespace ddsp;
 
-TopPanelComponent::TopPanelComponent (DDSPAudioProcessor& p) : audioProcessor (p)
+TopPanelComponent::TopPanelComponent (DDSPAudioProcessor& p)
+    : audioProcessor (p),
+      modelSlotAttach (*p.getValueTree().getParameter ("ModelSlot"),
+                       [this] (float slot)
+                       {
+                           if (modelList != nullptr && modelList->getSelectedId() != static_cast<int> (slot) + 1)
+                           {
+                               modelList->setSelectedId (static_cast<int> (slot) + 1, juce::dontSendNotification);
+                               sendChangeMessage();
+                           }
+                       })
 {
     modelList.reset (new juce::ComboBox ("new combo box"));
     addAndMakeVisible (modelList.get());
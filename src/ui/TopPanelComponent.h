@@ -52,5 +52,8 @@ private:
     std::unique_ptr<juce::TextButton> urlButton;
     std::unique_ptr<juce::TextButton> infoButton;
 
+    // Follows "ModelSlot" automation so the model list shows the active model.
+    juce::ParameterAttachment modelSlotAttach;
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TopPanelComponent)
 };
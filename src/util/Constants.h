@@ -16,6 +16,7 @@ limitations under the License.
 
 #pragma once
 
+#include <cstddef>
 #include <string_view>
 
 namespace ddsp
@@ -38,6 +39,8 @@ inline constexpr std::string_view kOutputTensorName_State = "StatefulPartitioned
 
 constexpr int kNumPredictControlsInputTensors = 3;
 constexpr int kNumPredictControlsOutputTensors = 4;
+// TFLite kernel threads of an interpreter the XNNPACK delegate is not applied to. The feature
+// extraction count is also the default size of the shared XNNPACK pool.
 constexpr int kNumFeatureExtractionThreads = 4;
 constexpr int kNumPredictControlsThreads = 1;
 constexpr int kNoiseAmpsSize = 65;
@@ -48,12 +51,25 @@ constexpr int kF0Size = 1;
 constexpr int kNumEmbeddedPredictControlsModels = 11;
 constexpr int kGruModelStateSize = 512;
 
+// Capacity of the queue passing MIDI events from the audio thread to the render thread.
+constexpr int kMidiEventQueueSize = 1024;
+
+// Memory budget for warm PredictControlsModel interpreters kept for fast model switching.
+constexpr size_t kModelPoolMemoryBudget_bytes = 64 * 1024 * 1024;
+// Number of model indices reachable through the automatable "ModelSlot" parameter.
+constexpr int kNumModelSlots = 32;
+
 // The models were trained at 16 kHz sample rate.
 constexpr float kModelSampleRate_Hz = 16000.0f;
 constexpr float kModelInferenceTimerCallbackInterval_ms = 20.0f;
+// How far the render thread may fall behind the audio thread before the ring buffers fill up.
+constexpr float kRingBufferHeadroom_ms = 500.0f;
 constexpr float kTotalInferenceLatency_ms = 64.0f;
 constexpr int kModelFrameSize = 1024;
+// Default hop, which the models were trained with. Shorter hops down to kMinModelHopSize
+// run the control model more often for lower latency.
 constexpr int kModelHopSize = 320;
+constexpr int kMinModelHopSize = 64;
 
 // URLs.
 inline constexpr std::string_view kModelTrainingColabUrl = "https://g.co/magenta/train-ddsp-vst";
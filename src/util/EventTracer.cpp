@@ -0,0 +1,343 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+A thread finds its buffer through a thread-specific key, and claims a free one
+with its first event. Plugins are loaded with dlopen(), where the first access
+to a thread_local can allocate, while reading a key never does. Setting it
+allocates only for keys past the first 32, once per thread. The key's
+destructor releases the buffer when its thread exits, so host workers and
+timer threads that come and go do not use the buffers up. A released buffer
+keeps its events, which dumps show on the next owner's track until they are
+overwritten.
+
+Each buffer has a single writer and is read while it is written. The writer
+stores the event and then publishes it by incrementing numWritten, which
+overwrites event n - kEventsPerThread while n is being written. A reader
+copies the events, reads numWritten again and keeps only the ones the writer
+cannot have reached since, so it never outputs a torn event.
+*/
+
+#include "util/EventTracer.h"
+
+#if JUCE_WINDOWS
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+namespace ddsp
+{
+
+namespace
+{
+    struct EventCopy
+    {
+        juce::int64 ticks;
+        const char* name;
+        uint32_t instance;
+        char phase;
+    };
+
+    constexpr int kDumpPollInterval_ms = 100;
+    // Underruns tend to come in bursts, one trace shows how the first one started.
+    constexpr juce::uint32 kMinDumpInterval_ms = 5000;
+    constexpr int kProcessId = 1;
+
+    void writeString (juce::OutputStream& stream, const char* text)
+    {
+        juce::JSON::writeToStream (stream, juce::var (juce::String (text)));
+    }
+} // namespace
+
+struct EventTracer::ThreadKey
+{
+    // Called on a thread that exits with a buffer.
+    static void release (void* buffer) noexcept
+    {
+        auto* threadBuffer = static_cast<ThreadBuffer*> (buffer);
+        threadBuffer->threadName.store (nullptr, std::memory_order_relaxed);
+        threadBuffer->claimed.store (false, std::memory_order_release);
+    }
+
+#if JUCE_WINDOWS
+    // Fiber-local storage, unlike TlsAlloc, calls back when a thread exits.
+    static void WINAPI releaseFiberLocal (void* buffer) { release (buffer); }
+
+    ThreadKey() : index (FlsAlloc (releaseFiberLocal)), isValid (index != FLS_OUT_OF_INDEXES) {}
+    // Also releases the buffers of the threads still alive.
+    ~ThreadKey()
+    {
+        if (isValid)
+        {
+            FlsFree (index);
+        }
+    }
+
+    ThreadBuffer* get() const noexcept { return static_cast<ThreadBuffer*> (FlsGetValue (index)); }
+    bool set (ThreadBuffer* buffer) noexcept { return FlsSetValue (index, buffer) != 0; }
+
+    const DWORD index;
+#else
+    ThreadKey() : isValid (pthread_key_create (&key, release) == 0) {}
+    ~ThreadKey()
+    {
+        if (isValid)
+        {
+            pthread_key_delete (key);
+        }
+    }
+
+    ThreadBuffer* get() const noexcept { return static_cast<ThreadBuffer*> (pthread_getspecific (key)); }
+    bool set (ThreadBuffer* buffer) noexcept { return pthread_setspecific (key, buffer) == 0; }
+
+    pthread_key_t key;
+#endif
+    const bool isValid;
+};
+
+EventTracer::EventTracer() : juce::Thread ("DDSP Tracer"), threadKey (std::make_unique<ThreadKey>())
+{
+    jassert (threadKey->isValid);
+    if (const char* directory = std::getenv ("DDSP_TRACE"); directory != nullptr && *directory != '\0')
+    {
+        setEnabled (true);
+        setDumpDirectory (juce::File::getCurrentWorkingDirectory().getChildFile (directory));
+    }
+}
+
+EventTracer::~EventTracer() { stopThread (1000); }
+
+void EventTracer::setEnabled (bool shouldBeEnabled)
+{
+    if (shouldBeEnabled)
+    {
+        const juce::ScopedLock sl (lock);
+        for (auto& buffer : buffers)
+        {
+            // Kept until destruction, a thread may still be writing after tracing is disabled.
+            if (buffer.events == nullptr)
+            {
+                buffer.events = std::make_unique<Event[]> (kEventsPerThread);
+            }
+        }
+    }
+    enabled.store (shouldBeEnabled, std::memory_order_release);
+}
+
+EventTracer::ThreadBuffer* EventTracer::getBufferForCurrentThread() noexcept
+{
+    if (! threadKey->isValid)
+    {
+        return nullptr;
+    }
+    if (ThreadBuffer* buffer = threadKey->get())
+    {
+        return buffer;
+    }
+
+    for (auto& buffer : buffers)
+    {
+        bool expected = false;
+        if (buffer.claimed.load (std::memory_order_relaxed)
+            || ! buffer.claimed.compare_exchange_strong (expected, true, std::memory_order_acq_rel))
+        {
+            continue;
+        }
+        if (threadKey->set (&buffer))
+        {
+            return &buffer;
+        }
+        // Without the key the buffer could not be released again.
+        buffer.claimed.store (false, std::memory_order_release);
+        return nullptr;
+    }
+    return nullptr;
+}
+
+void EventTracer::record (char phase, const char* name, uint32_t instance) noexcept
+{
+    if (! isEnabled())
+    {
+        return;
+    }
+    ThreadBuffer* buffer = getBufferForCurrentThread();
+    if (buffer == nullptr)
+    {
+        numDropped.fetch_add (1, std::memory_order_relaxed);
+        return;
+    }
+
+    const uint64_t position = buffer->numWritten.load (std::memory_order_relaxed);
+    Event& event = buffer->events[position % kEventsPerThread];
+    event.ticks.store (juce::Time::getHighResolutionTicks(), std::memory_order_relaxed);
+    event.name.store (name, std::memory_order_relaxed);
+    event.instance.store (instance, std::memory_order_relaxed);
+    event.phase.store (phase, std::memory_order_relaxed);
+    buffer->numWritten.store (position + 1, std::memory_order_release);
+}
+
+void EventTracer::nameCurrentThread (const char* name) noexcept
+{
+    if (! isEnabled())
+    {
+        return;
+    }
+    if (ThreadBuffer* buffer = getBufferForCurrentThread())
+    {
+        buffer->threadName.store (name, std::memory_order_relaxed);
+    }
+}
+
+void EventTracer::writeChromeTrace (juce::OutputStream& stream) const
+{
+    const juce::ScopedLock sl (lock);
+    const double ticksPerMicrosecond = static_cast<double> (juce::Time::getHighResolutionTicksPerSecond()) / 1.0e6;
+
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << juce::newLine;
+    stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << kProcessId
+           << ",\"tid\":0,\"args\":{\"name\":\"DDSP\"}}";
+
+    std::vector<EventCopy> events;
+    for (int tid = 1; tid <= kMaxThreads; ++tid)
+    {
+        const ThreadBuffer& buffer = buffers[static_cast<size_t> (tid - 1)];
+        const uint64_t numWritten = buffer.numWritten.load (std::memory_order_acquire);
+        if (buffer.events == nullptr || numWritten == 0)
+        {
+            continue;
+        }
+
+        const uint64_t first = numWritten > kEventsPerThread ? numWritten - kEventsPerThread : 0;
+        events.clear();
+        for (uint64_t i = first; i < numWritten; ++i)
+        {
+            const Event& event = buffer.events[i % kEventsPerThread];
+            events.push_back ({ event.ticks.load (std::memory_order_relaxed),
+                                event.name.load (std::memory_order_relaxed),
+                                event.instance.load (std::memory_order_relaxed),
+                                event.phase.load (std::memory_order_relaxed) });
+        }
+        std::atomic_thread_fence (std::memory_order_acquire);
+        // Events the writer may have overwritten while they were copied.
+        const uint64_t numWrittenAfter = buffer.numWritten.load (std::memory_order_relaxed);
+        const uint64_t numTorn =
+            numWrittenAfter + 1 > first + kEventsPerThread ? numWrittenAfter + 1 - first - kEventsPerThread : 0;
+        events.erase (events.begin(),
+                      events.begin() + static_cast<std::ptrdiff_t> (std::min<uint64_t> (numTorn, events.size())));
+
+        if (const char* threadName = buffer.threadName.load (std::memory_order_relaxed))
+        {
+            stream << "," << juce::newLine << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << kProcessId
+                   << ",\"tid\":" << tid << ",\"args\":{\"name\":";
+            writeString (stream, threadName);
+            stream << "}}";
+        }
+
+        // The oldest events may end spans whose beginning was overwritten.
+        int depth = 0;
+        for (const auto& event : events)
+        {
+            if (event.phase == 'E' && depth == 0)
+            {
+                continue;
+            }
+            depth += event.phase == 'B' ? 1 : (event.phase == 'E' ? -1 : 0);
+
+            const double timestamp_us = static_cast<double> (event.ticks - startTicks) / ticksPerMicrosecond;
+            stream << "," << juce::newLine << "{\"name\":";
+            writeString (stream, event.name);
+            stream << ",\"cat\":\"ddsp\",\"ph\":\"" << juce::String::charToString (event.phase) << "\",\"ts\":"
+                   << juce::String (timestamp_us, 3) << ",\"pid\":" << kProcessId << ",\"tid\":" << tid;
+            if (event.phase == 'i')
+            {
+                stream << ",\"s\":\"t\"";
+            }
+            if (event.instance != 0)
+            {
+                stream << ",\"args\":{\"instance\":" << static_cast<int> (event.instance) << "}";
+            }
+            stream << "}";
+        }
+    }
+    stream << juce::newLine << "]}" << juce::newLine;
+}
+
+juce::File EventTracer::dumpToDirectory (const juce::File& directory) const
+{
+    directory.createDirectory();
+    const auto name = "ddsp-trace-" + juce::Time::getCurrentTime().formatted ("%Y%m%d-%H%M%S") + ".json";
+    const auto file = directory.getChildFile (name).getNonexistentSibling();
+    juce::FileOutputStream stream (file);
+    if (! stream.openedOk())
+    {
+        return {};
+    }
+    writeChromeTrace (stream);
+    return file;
+}
+
+void EventTracer::requestDump() noexcept
+{
+    if (isEnabled())
+    {
+        dumpRequested.store (true, std::memory_order_relaxed);
+    }
+}
+
+void EventTracer::setDumpDirectory (const juce::File& directory)
+{
+    {
+        const juce::ScopedLock sl (lock);
+        dumpDirectory = directory;
+    }
+    if (directory != juce::File {} && ! isThreadRunning())
+    {
+        startThread();
+    }
+}
+
+void EventTracer::run()
+{
+    while (! threadShouldExit())
+    {
+        wait (kDumpPollInterval_ms);
+        if (! dumpRequested.exchange (false, std::memory_order_relaxed))
+        {
+            continue;
+        }
+
+        const auto now_ms = juce::Time::getMillisecondCounter();
+        if (lastDump_ms != 0 && now_ms - lastDump_ms < kMinDumpInterval_ms)
+        {
+            continue;
+        }
+        lastDump_ms = now_ms;
+
+        juce::File directory;
+        {
+            const juce::ScopedLock sl (lock);
+            directory = dumpDirectory;
+        }
+        if (directory != juce::File {})
+        {
+            const auto file = dumpToDirectory (directory);
+            juce::Logger::writeToLog ("DDSP trace written to " + file.getFullPathName());
+        }
+    }
+}
+
+} // namespace ddsp
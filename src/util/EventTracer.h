@@ -0,0 +1,129 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace ddsp
+{
+
+// Timeline of the plugin's activity across threads, shared by the process through
+// juce::SharedResourcePointer<EventTracer>. Every thread records into a buffer of its own that
+// keeps the latest events, so a dump shows what led up to it. Dumps are Chrome trace-event JSON,
+// which chrome://tracing and ui.perfetto.dev open.
+//
+// Off by default. Setting the DDSP_TRACE environment variable to a directory enables tracing at
+// startup and dumps a trace there whenever the output ring underflows.
+class EventTracer : private juce::Thread
+{
+public:
+    EventTracer();
+    ~EventTracer() override;
+
+    // Allocates the thread buffers on first use, call it off the audio thread.
+    void setEnabled (bool shouldBeEnabled);
+    bool isEnabled() const noexcept { return enabled.load (std::memory_order_acquire); }
+
+    // Tags events with the plugin instance they belong to, 0 for none.
+    uint32_t getNextInstanceId() { return nextInstanceId.fetch_add (1, std::memory_order_relaxed); }
+
+    // Real-time safe and lock-free. name must be a string literal, or outlive the tracer.
+    void begin (const char* name, uint32_t instance = 0) noexcept { record ('B', name, instance); }
+    void end (const char* name, uint32_t instance = 0) noexcept { record ('E', name, instance); }
+    void instant (const char* name, uint32_t instance = 0) noexcept { record ('i', name, instance); }
+    // Labels the calling thread in dumps, name must outlive the tracer.
+    void nameCurrentThread (const char* name) noexcept;
+
+    // Records a begin and end event around its scope.
+    class ScopedTrace
+    {
+    public:
+        ScopedTrace (EventTracer& t, const char* n, uint32_t i = 0) noexcept : tracer (t), name (n), instance (i)
+        {
+            tracer.begin (name, instance);
+        }
+        ~ScopedTrace() { tracer.end (name, instance); }
+
+    private:
+        EventTracer& tracer;
+        const char* const name;
+        const uint32_t instance;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedTrace)
+    };
+
+    // Writes the recorded events of every thread as Chrome trace-event JSON.
+    void writeChromeTrace (juce::OutputStream& stream) const;
+    // Writes a trace to a new, timestamped file in directory and returns it.
+    juce::File dumpToDirectory (const juce::File& directory) const;
+
+    // Real-time safe. Asks the tracer's thread to dump to the dump directory, at most once
+    // every few seconds.
+    void requestDump() noexcept;
+    // Where requested dumps go, nothing is dumped if it is empty.
+    void setDumpDirectory (const juce::File& directory);
+
+    // Events lost because more threads traced at once than there are buffers.
+    int64_t getNumDropped() const { return numDropped.load (std::memory_order_relaxed); }
+
+private:
+    struct Event
+    {
+        std::atomic<juce::int64> ticks { 0 };
+        std::atomic<const char*> name { nullptr };
+        std::atomic<uint32_t> instance { 0 };
+        std::atomic<char> phase { 0 };
+    };
+
+    // Written by its owner thread only. Overwrites its oldest events when full. Released for
+    // another thread when its owner exits.
+    struct ThreadBuffer
+    {
+        std::atomic<bool> claimed { false };
+        std::atomic<const char*> threadName { nullptr };
+        std::atomic<uint64_t> numWritten { 0 };
+        std::unique_ptr<Event[]> events;
+    };
+
+    // Points each thread to its buffer, see EventTracer.cpp.
+    struct ThreadKey;
+
+    void record (char phase, const char* name, uint32_t instance) noexcept;
+    ThreadBuffer* getBufferForCurrentThread() noexcept;
+    void run() override;
+
+    static constexpr int kMaxThreads = 16;
+    static constexpr uint64_t kEventsPerThread = 8192;
+
+    std::atomic<bool> enabled { false };
+    std::atomic<uint32_t> nextInstanceId { 1 };
+    std::array<ThreadBuffer, kMaxThreads> buffers;
+    // Declared after the buffers, so no thread can release one after it is gone.
+    const std::unique_ptr<ThreadKey> threadKey;
+    std::atomic<int64_t> numDropped { 0 };
+    const juce::int64 startTicks = juce::Time::getHighResolutionTicks();
+
+    std::atomic<bool> dumpRequested { false };
+    // Guards dumpDirectory and the buffer allocation.
+    juce::CriticalSection lock;
+    juce::File dumpDirectory;
+    juce::uint32 lastDump_ms = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (EventTracer)
+};
+
+} // namespace ddsp
@@ -0,0 +1,142 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+On Linux the arena is an anonymous mapping. Transparent huge pages need a
+2 MB aligned range, so large arenas over-reserve by one huge page, advise
+the aligned part with MADV_HUGEPAGE and trim the rest. Writing zeros to
+every byte afterwards faults all pages in, at 4 kB or 2 MB granularity,
+before the audio thread touches them.
+
+Elsewhere the arena is a heap block, aligned by hand and zeroed the same way.
+*/
+
+#include "util/MemoryArena.h"
+
+#if JUCE_LINUX
+    #include <sys/mman.h>
+#endif
+
+namespace ddsp
+{
+
+namespace
+{
+    constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+    size_t alignUp (size_t value, size_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+} // namespace
+
+MemoryArena::~MemoryArena() { release(); }
+
+void MemoryArena::beginLayout()
+{
+    release();
+    used = 0;
+}
+
+void MemoryArena::commit (const Options& options)
+{
+    jassert (isMeasuring());
+    const size_t numBytes = std::max (used, kAlignment);
+    used = 0;
+
+#if JUCE_LINUX
+    const auto pageSize = static_cast<size_t> (juce::SystemStats::getPageSize());
+    const bool wantsHugePages = options.useHugePages && numBytes >= kHugePageSize;
+    capacity = alignUp (numBytes, wantsHugePages ? kHugePageSize : pageSize);
+    mappedBytes = capacity + (wantsHugePages ? kHugePageSize : 0);
+
+    void* mapping = mmap (nullptr, mappedBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping != MAP_FAILED)
+    {
+        auto* start = static_cast<char*> (mapping);
+        if (wantsHugePages)
+        {
+            // Unmap the slack on both sides of the aligned range.
+            auto* aligned = reinterpret_cast<char*> (alignUp (reinterpret_cast<uintptr_t> (start), kHugePageSize));
+            const auto head = static_cast<size_t> (aligned - start);
+            if (head > 0)
+            {
+                munmap (start, head);
+            }
+            if (kHugePageSize - head > 0)
+            {
+                munmap (aligned + capacity, kHugePageSize - head);
+            }
+            start = aligned;
+            mappedBytes = capacity;
+            hugePages = madvise (start, capacity, MADV_HUGEPAGE) == 0;
+        }
+        base = start;
+    }
+    else
+    {
+        mappedBytes = 0;
+    }
+#endif
+
+    if (base == nullptr)
+    {
+        capacity = alignUp (numBytes, kAlignment);
+        fallbackStorage.allocate (capacity + kAlignment, false);
+        base = reinterpret_cast<char*> (alignUp (reinterpret_cast<uintptr_t> (fallbackStorage.get()), kAlignment));
+    }
+
+    // Pre-fault.
+    std::memset (base, 0, capacity);
+
+#if JUCE_LINUX
+    locked = options.lockPages && mlock (base, capacity) == 0;
+#else
+    juce::ignoreUnused (options);
+#endif
+}
+
+void MemoryArena::release()
+{
+#if JUCE_LINUX
+    if (locked)
+    {
+        munlock (base, capacity);
+    }
+    if (mappedBytes > 0)
+    {
+        munmap (base, mappedBytes);
+    }
+#endif
+    fallbackStorage.free();
+    base = nullptr;
+    capacity = 0;
+    mappedBytes = 0;
+    locked = false;
+    hugePages = false;
+}
+
+void* MemoryArena::allocate (size_t numBytes)
+{
+    const size_t offset = alignUp (used, kAlignment);
+    used = offset + numBytes;
+    if (isMeasuring())
+    {
+        return nullptr;
+    }
+    // The second layout pass must not ask for more than the first one measured.
+    jassert (used <= capacity);
+    return used <= capacity ? base + offset : nullptr;
+}
+
+} // namespace ddsp
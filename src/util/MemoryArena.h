@@ -0,0 +1,79 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace ddsp
+{
+
+// One contiguous allocation that a set of buffers is carved from, so they share pages and
+// stay close in cache. The owner lays its buffers out twice with the same code: once to
+// measure, with allocate() returning nullptr, and once more after commit() maps the memory.
+// The memory is written once when committed, so no page faults on first use by the audio thread.
+class MemoryArena
+{
+public:
+    // Every allocation starts on a cache line, which also satisfies TFLite custom allocations.
+    static constexpr size_t kAlignment = 64;
+
+    struct Options
+    {
+        // Keep the arena resident with mlock(). Fails quietly beyond RLIMIT_MEMLOCK.
+        bool lockPages = false;
+        // Ask for transparent huge pages, which only applies to arenas of 2 MB or more.
+        bool useHugePages = true;
+    };
+
+    MemoryArena() = default;
+    ~MemoryArena();
+
+    // Releases the memory and starts measuring. Pointers from earlier allocations become invalid.
+    void beginLayout();
+    // Maps, pre-faults and zeroes the size measured since beginLayout(), then restarts the layout
+    // for the real allocations. Not real-time safe.
+    void commit (const Options& options);
+    void release();
+
+    // Returns numBytes at the next cache line, or nullptr while measuring.
+    void* allocate (size_t numBytes);
+    template <typename T>
+    T* allocate (int count)
+    {
+        return static_cast<T*> (allocate (sizeof (T) * static_cast<size_t> (count)));
+    }
+
+    bool isMeasuring() const { return base == nullptr; }
+    size_t getCapacity() const { return capacity; }
+    size_t getNumBytesUsed() const { return used; }
+    bool isLocked() const { return locked; }
+    bool hasHugePages() const { return hugePages; }
+
+private:
+    char* base = nullptr;
+    size_t capacity = 0;
+    size_t mappedBytes = 0;
+    size_t used = 0;
+    bool locked = false;
+    bool hugePages = false;
+    // Storage where the arena is not mmapped.
+    juce::HeapBlock<char> fallbackStorage;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MemoryArena)
+};
+
+} // namespace ddsp
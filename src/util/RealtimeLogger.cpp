@@ -0,0 +1,233 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+The ring is a bounded multi-producer queue with one sequence number per
+record. A record is free for the producer claiming position p when its
+sequence is p, and holds data for the consumer reading position p when it
+is p + 1. Producers claim positions with a compare-and-swap on head and
+publish by storing the sequence, so a producer never waits on another one
+and no producer ever waits on the consumer: a full ring drops the event.
+
+The consumer is the drain thread, or flush() on any thread, serialized by
+drainLock which only non-real-time threads take.
+*/
+
+#include "util/RealtimeLogger.h"
+
+namespace ddsp
+{
+
+namespace
+{
+    struct EventInfo
+    {
+        const char* message;
+        // Labels of the values, nullptr if unused.
+        const char* value0;
+        const char* value1;
+    };
+
+    constexpr EventInfo kEventInfo[] = {
+        { "Control model invocation failed", "status", nullptr },
+        { "Feature extraction invocation failed", "status", nullptr },
+        { "Control model predicted NaN harmonics", "count", nullptr },
+        { "Input ring overflow", "block size", "free space" },
+        { "Output ring underflow", "block size", "ready" },
+    };
+    static_assert (std::size (kEventInfo) == static_cast<size_t> (LogEvent::kNumEvents));
+
+    constexpr int kDrainInterval_ms = 100;
+} // namespace
+
+RealtimeLogger::RealtimeLogger() : juce::Thread ("DDSP Logger")
+{
+    for (size_t i = 0; i < kCapacity; ++i)
+    {
+        records[i].sequence.store (i, std::memory_order_relaxed);
+    }
+    startThread();
+}
+
+RealtimeLogger::~RealtimeLogger()
+{
+    stopThread (1000);
+    flush();
+}
+
+void RealtimeLogger::log (LogEvent event, int64_t value0, int64_t value1) noexcept
+{
+    counts[static_cast<size_t> (event)].fetch_add (1, std::memory_order_relaxed);
+
+    uint64_t position = head.load (std::memory_order_relaxed);
+    for (;;)
+    {
+        Record& record = records[position % kCapacity];
+        const uint64_t sequence = record.sequence.load (std::memory_order_acquire);
+        const auto difference = static_cast<int64_t> (sequence - position);
+        if (difference == 0)
+        {
+            if (head.compare_exchange_weak (position, position + 1, std::memory_order_relaxed))
+            {
+                record.event = event;
+                record.values[0] = value0;
+                record.values[1] = value1;
+                record.time_ms = static_cast<int64_t> (juce::Time::getMillisecondCounter());
+                record.sequence.store (position + 1, std::memory_order_release);
+                return;
+            }
+        }
+        else if (difference < 0)
+        {
+            // Full, the consumer has not freed this record yet.
+            numDropped.fetch_add (1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            // Another producer claimed the position.
+            position = head.load (std::memory_order_relaxed);
+        }
+    }
+}
+
+bool RealtimeLogger::pop (LogEvent& event, int64_t (&values)[2], int64_t& time_ms)
+{
+    Record& record = records[tail % kCapacity];
+    if (record.sequence.load (std::memory_order_acquire) != tail + 1)
+    {
+        return false;
+    }
+    event = record.event;
+    values[0] = record.values[0];
+    values[1] = record.values[1];
+    time_ms = record.time_ms;
+    record.sequence.store (tail + kCapacity, std::memory_order_release);
+    ++tail;
+    return true;
+}
+
+int64_t RealtimeLogger::getCount (LogEvent event) const
+{
+    return counts[static_cast<size_t> (event)].load (std::memory_order_relaxed);
+}
+
+void RealtimeLogger::setLogFile (const juce::File& file, int64_t maxBytes)
+{
+    const juce::ScopedLock lock (drainLock);
+    logStream.reset();
+    logFile = file;
+    maxLogBytes = maxBytes;
+    if (file != juce::File {})
+    {
+        logStream = std::make_unique<juce::FileOutputStream> (file);
+        if (! logStream->openedOk())
+        {
+            logStream.reset();
+        }
+    }
+}
+
+void RealtimeLogger::flush()
+{
+    const juce::ScopedLock lock (drainLock);
+    drain();
+}
+
+void RealtimeLogger::run()
+{
+    while (! threadShouldExit())
+    {
+        flush();
+        wait (kDrainInterval_ms);
+    }
+}
+
+void RealtimeLogger::drain()
+{
+    LogEvent event;
+    int64_t values[2];
+    int64_t time_ms;
+    while (pop (event, values, time_ms))
+    {
+        if (event == lastEvent)
+        {
+            ++numRepeats;
+            continue;
+        }
+        writeRepeats();
+        lastEvent = event;
+
+        const auto& info = kEventInfo[static_cast<size_t> (event)];
+        juce::String line;
+        line << "[DDSP " << time_ms << " ms] " << info.message;
+        if (info.value0 != nullptr)
+        {
+            line << " (" << info.value0 << " " << values[0];
+            if (info.value1 != nullptr)
+            {
+                line << ", " << info.value1 << " " << values[1];
+            }
+            line << ")";
+        }
+        writeLine (line);
+    }
+    // Repeats are summarized once per drain, so a persistent problem stays visible.
+    writeRepeats();
+    lastEvent = LogEvent::kNumEvents;
+
+    if (const int64_t dropped = getNumDropped(); dropped != lastDropped)
+    {
+        writeLine ("[DDSP] " + juce::String (dropped - lastDropped) + " events dropped, the log ring was full");
+        lastDropped = dropped;
+    }
+}
+
+void RealtimeLogger::writeRepeats()
+{
+    if (numRepeats > 0)
+    {
+        writeLine ("[DDSP] ... repeated " + juce::String (numRepeats) + " more times");
+        numRepeats = 0;
+    }
+}
+
+void RealtimeLogger::writeLine (const juce::String& line)
+{
+    if (logStream == nullptr)
+    {
+        std::cerr << line << std::endl;
+        return;
+    }
+
+    logStream->writeText (line + "\n", false, false, nullptr);
+    logStream->flush();
+    if (maxLogBytes > 0 && logStream->getPosition() > maxLogBytes)
+    {
+        // Keep one backup.
+        logStream.reset();
+        const juce::File backup = logFile.getSiblingFile (logFile.getFileName() + ".1");
+        backup.deleteFile();
+        logFile.moveFileTo (backup);
+        logStream = std::make_unique<juce::FileOutputStream> (logFile);
+        if (! logStream->openedOk())
+        {
+            logStream.reset();
+        }
+    }
+}
+
+} // namespace ddsp
@@ -0,0 +1,97 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace ddsp
+{
+
+// Events the real-time threads can log. The message of each is in RealtimeLogger.cpp.
+enum class LogEvent : uint16_t
+{
+    kPredictControlsInvokeFailed = 0,
+    kFeatureExtractionInvokeFailed,
+    kControlsNaN,
+    kInputOverflow,
+    kOutputUnderflow,
+    kNumEvents
+};
+
+// Logger for the audio and inference threads, shared by the process through
+// juce::SharedResourcePointer<RealtimeLogger>. log() only stores an event code and two
+// numbers in a lock-free ring. A background thread formats them and writes them to stderr,
+// or to a log file that is rotated when it grows too large. Consecutive repeats of an event
+// are written once with their count.
+class RealtimeLogger : private juce::Thread
+{
+public:
+    RealtimeLogger();
+    ~RealtimeLogger() override;
+
+    // Real-time safe and lock-free, callable from any thread. If the ring is full the event is
+    // dropped, it is still counted.
+    void log (LogEvent event, int64_t value0 = 0, int64_t value1 = 0) noexcept;
+
+    // Times event was logged since the process started, including dropped records.
+    int64_t getCount (LogEvent event) const;
+    int64_t getNumDropped() const { return numDropped.load (std::memory_order_relaxed); }
+
+    // Writes to file instead of stderr, which is moved to a ".1" backup once it exceeds
+    // maxBytes. An empty file goes back to stderr.
+    void setLogFile (const juce::File& file, int64_t maxBytes = 1024 * 1024);
+
+    // Formats and writes everything logged so far on the calling thread.
+    void flush();
+
+private:
+    struct Record
+    {
+        std::atomic<uint64_t> sequence { 0 };
+        LogEvent event = LogEvent::kNumEvents;
+        int64_t values[2] = {};
+        int64_t time_ms = 0;
+    };
+
+    void run() override;
+    bool pop (LogEvent& event, int64_t (&values)[2], int64_t& time_ms);
+    void drain();
+    void writeLine (const juce::String& line);
+    void writeRepeats();
+
+    static constexpr size_t kCapacity = 1024;
+    std::array<Record, kCapacity> records;
+    alignas (64) std::atomic<uint64_t> head { 0 };
+    alignas (64) uint64_t tail = 0;
+
+    std::array<std::atomic<int64_t>, static_cast<size_t> (LogEvent::kNumEvents)> counts {};
+    std::atomic<int64_t> numDropped { 0 };
+
+    // Consumer side, guarded by drainLock.
+    juce::CriticalSection drainLock;
+    std::unique_ptr<juce::FileOutputStream> logStream;
+    juce::File logFile;
+    int64_t maxLogBytes = 0;
+    // Last event written and how often it repeated since.
+    LogEvent lastEvent = LogEvent::kNumEvents;
+    int64_t numRepeats = 0;
+    int64_t lastDropped = 0;
+
+    JUCE_DECLARE_NON_COPYABLE (RealtimeLogger)
+};
+
+} // namespace ddsp
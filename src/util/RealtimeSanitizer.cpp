@@ -0,0 +1,467 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+The checks work by symbol interposition: this file defines malloc, free and
+the other intercepted functions, so every call in the process lands here
+first. Allocations forward to glibc's __libc_* entry points, the rest to the
+next definition found with dlsym (RTLD_NEXT). operator new and delete go
+through malloc and free, so they are covered too.
+
+Only calls between libraries can be interposed. stdio writes through glibc's
+internal __write and takes its own locks, neither of which reaches the write
+and pthread_mutex_lock hooks, so the stdio functions are hooked themselves.
+That covers std::cout and std::cerr, which libstdc++ writes with fwrite and
+putc. The printf family is hooked with its _FORTIFY_SOURCE variants.
+
+The hooks run inside the allocator, so they must not allocate themselves.
+The per-thread state is plain initial-exec TLS, which needs no allocation
+to access even from a shared library. A reentrancy flag turns the checks off
+while a report is written, since backtrace() may allocate on first use.
+
+Interposition needs a glibc-based Linux. Elsewhere the scopes do nothing.
+*/
+
+#include "util/RealtimeSanitizer.h"
+
+#if DDSP_ENABLE_RT_SANITIZER && defined(__linux__)
+
+    #include <algorithm>
+    #include <atomic>
+    #include <cerrno>
+    #include <cstdarg>
+    #include <cstdio>
+    #include <cstdlib>
+    #include <cstring>
+    #include <dlfcn.h>
+    #include <execinfo.h>
+    #include <pthread.h>
+    #include <time.h>
+    #include <unistd.h>
+
+extern "C"
+{
+    void* __libc_malloc (size_t size);
+    void* __libc_calloc (size_t count, size_t size);
+    void* __libc_realloc (void* memory, size_t size);
+    void* __libc_memalign (size_t alignment, size_t size);
+    void __libc_free (void* memory);
+    int __vfprintf_chk (FILE* stream, int flag, const char* format, va_list args);
+}
+
+namespace ddsp
+{
+
+namespace
+{
+    enum class Mode
+    {
+        kUnknown,
+        kOff,
+        kReport,
+        kAbort
+    };
+
+    std::atomic<Mode> mode { Mode::kUnknown };
+    std::atomic<int> numViolations { 0 };
+
+    [[gnu::tls_model ("initial-exec")]] thread_local int scopeDepth = 0;
+    [[gnu::tls_model ("initial-exec")]] thread_local const char* threadName = nullptr;
+    [[gnu::tls_model ("initial-exec")]] thread_local int allowedViolations = 0;
+    [[gnu::tls_model ("initial-exec")]] thread_local bool reporting = false;
+
+    Mode getMode()
+    {
+        Mode current = mode.load (std::memory_order_relaxed);
+        if (current == Mode::kUnknown)
+        {
+            // getenv does not allocate.
+            const char* setting = std::getenv ("DDSP_RT_SANITIZER");
+            if (setting != nullptr && std::strcmp (setting, "abort") == 0)
+            {
+                current = Mode::kAbort;
+            }
+            else if (setting != nullptr && std::strcmp (setting, "off") == 0)
+            {
+                current = Mode::kOff;
+            }
+            else
+            {
+                current = Mode::kReport;
+            }
+            mode.store (current, std::memory_order_relaxed);
+        }
+        return current;
+    }
+
+    template <typename Function>
+    Function getNextFunction (std::atomic<void*>& cache, const char* name)
+    {
+        void* function = cache.load (std::memory_order_acquire);
+        if (function == nullptr)
+        {
+            function = dlsym (RTLD_NEXT, name);
+            cache.store (function, std::memory_order_release);
+        }
+        return reinterpret_cast<Function> (function);
+    }
+
+    ssize_t writeUnchecked (int fd, const void* data, size_t numBytes);
+
+    // True if the calling thread is in a real-time scope that does not allow violation.
+    bool isViolation (RealtimeViolation violation)
+    {
+        return scopeDepth > 0 && ! reporting && (allowedViolations & violation) == 0 && getMode() != Mode::kOff;
+    }
+
+    void report (const char* function)
+    {
+        reporting = true;
+        const int count = numViolations.fetch_add (1, std::memory_order_relaxed) + 1;
+
+        char message[256];
+        const int length = std::snprintf (message,
+                                          sizeof (message),
+                                          "==RT== Real-time violation #%d: %s() on the %s thread\n",
+                                          count,
+                                          function,
+                                          threadName != nullptr ? threadName : "real-time");
+        writeUnchecked (STDERR_FILENO, message, static_cast<size_t> (std::max (0, length)));
+
+        void* frames[64];
+        const int numFrames = backtrace (frames, 64);
+        // Skip report() and the hook.
+        backtrace_symbols_fd (frames + 2, std::max (0, numFrames - 2), STDERR_FILENO);
+
+        if (getMode() == Mode::kAbort)
+        {
+            std::abort();
+        }
+        reporting = false;
+    }
+
+    std::atomic<void*> nextWrite { nullptr };
+    std::atomic<void*> nextFwrite { nullptr };
+    std::atomic<void*> nextFputs { nullptr };
+    std::atomic<void*> nextPuts { nullptr };
+    std::atomic<void*> nextFputc { nullptr };
+    std::atomic<void*> nextPutc { nullptr };
+    std::atomic<void*> nextFflush { nullptr };
+    std::atomic<void*> nextVfprintf { nullptr };
+    std::atomic<void*> nextVfprintfChk { nullptr };
+    std::atomic<void*> nextMutexLock { nullptr };
+    std::atomic<void*> nextNanosleep { nullptr };
+    std::atomic<void*> nextUsleep { nullptr };
+
+    ssize_t writeUnchecked (int fd, const void* data, size_t numBytes)
+    {
+        using Write = ssize_t (*) (int, const void*, size_t);
+        return getNextFunction<Write> (nextWrite, "write") (fd, data, numBytes);
+    }
+
+    int formatUnchecked (FILE* stream, const char* format, va_list args)
+    {
+        using Vfprintf = int (*) (FILE*, const char*, va_list);
+        return getNextFunction<Vfprintf> (nextVfprintf, "vfprintf") (stream, format, args);
+    }
+
+    int formatCheckedUnchecked (FILE* stream, int flag, const char* format, va_list args)
+    {
+        using VfprintfChk = int (*) (FILE*, int, const char*, va_list);
+        return getNextFunction<VfprintfChk> (nextVfprintfChk, "__vfprintf_chk") (stream, flag, format, args);
+    }
+} // namespace
+
+RealtimeScope::RealtimeScope (const char* name) : previousThreadName (threadName)
+{
+    threadName = name;
+    ++scopeDepth;
+}
+
+RealtimeScope::~RealtimeScope()
+{
+    --scopeDepth;
+    threadName = previousThreadName;
+}
+
+RealtimeExemption::RealtimeExemption (int allowed) : previousAllowedViolations (allowedViolations)
+{
+    allowedViolations |= allowed;
+}
+
+RealtimeExemption::~RealtimeExemption() { allowedViolations = previousAllowedViolations; }
+
+int getNumRealtimeViolations() { return numViolations.load (std::memory_order_relaxed); }
+
+} // namespace ddsp
+
+using ddsp::isViolation;
+using ddsp::report;
+
+extern "C"
+{
+    void* malloc (size_t size) noexcept
+    {
+        if (isViolation (ddsp::kRealtimeAllocation))
+        {
+            report ("malloc");
+        }
+        return __libc_malloc (size);
+    }
+
+    void* calloc (size_t count, size_t size) noexcept
+    {
+        if (isViolation (ddsp::kRealtimeAllocation))
+        {
+            report ("calloc");
+        }
+        return __libc_calloc (count, size);
+    }
+
+    void* realloc (void* memory, size_t size) noexcept
+    {
+        if (isViolation (ddsp::kRealtimeAllocation))
+        {
+            report ("realloc");
+        }
+        return __libc_realloc (memory, size);
+    }
+
+    void* aligned_alloc (size_t alignment, size_t size) noexcept
+    {
+        if (isViolation (ddsp::kRealtimeAllocation))
+        {
+            report ("aligned_alloc");
+        }
+        return __libc_memalign (alignment, size);
+    }
+
+    int posix_memalign (void** memory, size_t alignment, size_t size) noexcept
+    {
+        if (isViolation (ddsp::kRealtimeAllocation))
+        {
+            report ("posix_memalign");
+        }
+        *memory = __libc_memalign (alignment, size);
+        return *memory != nullptr || size == 0 ? 0 : ENOMEM;
+    }
+
+    void free (void* memory) noexcept
+    {
+        if (memory != nullptr && isViolation (ddsp::kRealtimeAllocation))
+        {
+            report ("free");
+        }
+        __libc_free (memory);
+    }
+
+    int pthread_mutex_lock (pthread_mutex_t* mutex) noexcept
+    {
+        if (isViolation (ddsp::kRealtimeLock))
+        {
+            report ("pthread_mutex_lock");
+        }
+        using MutexLock = int (*) (pthread_mutex_t*);
+        return ddsp::getNextFunction<MutexLock> (ddsp::nextMutexLock, "pthread_mutex_lock") (mutex);
+    }
+
+    ssize_t write (int fd, const void* data, size_t numBytes)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("write");
+        }
+        return ddsp::writeUnchecked (fd, data, numBytes);
+    }
+
+    size_t fwrite (const void* data, size_t size, size_t count, FILE* stream)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("fwrite");
+        }
+        using Fwrite = size_t (*) (const void*, size_t, size_t, FILE*);
+        return ddsp::getNextFunction<Fwrite> (ddsp::nextFwrite, "fwrite") (data, size, count, stream);
+    }
+
+    int fputs (const char* text, FILE* stream)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("fputs");
+        }
+        using Fputs = int (*) (const char*, FILE*);
+        return ddsp::getNextFunction<Fputs> (ddsp::nextFputs, "fputs") (text, stream);
+    }
+
+    int puts (const char* text)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("puts");
+        }
+        using Puts = int (*) (const char*);
+        return ddsp::getNextFunction<Puts> (ddsp::nextPuts, "puts") (text);
+    }
+
+    int fputc (int character, FILE* stream)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("fputc");
+        }
+        using Fputc = int (*) (int, FILE*);
+        return ddsp::getNextFunction<Fputc> (ddsp::nextFputc, "fputc") (character, stream);
+    }
+
+    int putc (int character, FILE* stream)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("putc");
+        }
+        using Putc = int (*) (int, FILE*);
+        return ddsp::getNextFunction<Putc> (ddsp::nextPutc, "putc") (character, stream);
+    }
+
+    int fflush (FILE* stream)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("fflush");
+        }
+        using Fflush = int (*) (FILE*);
+        return ddsp::getNextFunction<Fflush> (ddsp::nextFflush, "fflush") (stream);
+    }
+
+    int vfprintf (FILE* stream, const char* format, va_list args)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("vfprintf");
+        }
+        return ddsp::formatUnchecked (stream, format, args);
+    }
+
+    int vprintf (const char* format, va_list args)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("vprintf");
+        }
+        return ddsp::formatUnchecked (stdout, format, args);
+    }
+
+    int fprintf (FILE* stream, const char* format, ...)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("fprintf");
+        }
+        va_list args;
+        va_start (args, format);
+        const int result = ddsp::formatUnchecked (stream, format, args);
+        va_end (args);
+        return result;
+    }
+
+    int printf (const char* format, ...)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("printf");
+        }
+        va_list args;
+        va_start (args, format);
+        const int result = ddsp::formatUnchecked (stdout, format, args);
+        va_end (args);
+        return result;
+    }
+
+    int __vfprintf_chk (FILE* stream, int flag, const char* format, va_list args)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("__vfprintf_chk");
+        }
+        return ddsp::formatCheckedUnchecked (stream, flag, format, args);
+    }
+
+    int __fprintf_chk (FILE* stream, int flag, const char* format, ...)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("__fprintf_chk");
+        }
+        va_list args;
+        va_start (args, format);
+        const int result = ddsp::formatCheckedUnchecked (stream, flag, format, args);
+        va_end (args);
+        return result;
+    }
+
+    int __printf_chk (int flag, const char* format, ...)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("__printf_chk");
+        }
+        va_list args;
+        va_start (args, format);
+        const int result = ddsp::formatCheckedUnchecked (stdout, flag, format, args);
+        va_end (args);
+        return result;
+    }
+
+    int nanosleep (const struct timespec* duration, struct timespec* remaining)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("nanosleep");
+        }
+        using Nanosleep = int (*) (const struct timespec*, struct timespec*);
+        return ddsp::getNextFunction<Nanosleep> (ddsp::nextNanosleep, "nanosleep") (duration, remaining);
+    }
+
+    int usleep (useconds_t duration)
+    {
+        if (isViolation (ddsp::kRealtimeBlockingCall))
+        {
+            report ("usleep");
+        }
+        using Usleep = int (*) (useconds_t);
+        return ddsp::getNextFunction<Usleep> (ddsp::nextUsleep, "usleep") (duration);
+    }
+}
+
+#elif DDSP_ENABLE_RT_SANITIZER
+
+namespace ddsp
+{
+
+RealtimeScope::RealtimeScope (const char*) : previousThreadName (nullptr) {}
+
+RealtimeScope::~RealtimeScope() = default;
+
+RealtimeExemption::RealtimeExemption (int) : previousAllowedViolations (0) {}
+
+RealtimeExemption::~RealtimeExemption() = default;
+
+int getNumRealtimeViolations() { return 0; }
+
+} // namespace ddsp
+
+#endif
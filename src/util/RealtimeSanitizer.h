@@ -0,0 +1,84 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+namespace ddsp
+{
+
+// Calls that can block a real-time thread, as reported by the sanitizer.
+enum RealtimeViolation
+{
+    kRealtimeAllocation = 1 << 0,
+    kRealtimeLock = 1 << 1,
+    kRealtimeBlockingCall = 1 << 2
+};
+
+#if DDSP_ENABLE_RT_SANITIZER
+
+// Real-time sanitizer, see DDSP_ENABLE_RT_SANITIZER. While a RealtimeScope is alive on a
+// thread, heap allocations, mutex locks and blocking calls (sleeps and writes, stdio included)
+// made by that thread are reported on stderr with a stack trace. The DDSP_RT_SANITIZER
+// environment variable selects what happens next: "report" (the default) continues, "abort"
+// aborts and "off" disables the checks.
+//
+// Nothing on the render path is exempt. A model that runs on worker threads wakes them through
+// a mutex on every invocation, and that is reported like any other lock.
+class RealtimeScope
+{
+public:
+    // threadName labels the reports and must outlive the scope. Scopes nest.
+    explicit RealtimeScope (const char* threadName);
+    ~RealtimeScope();
+
+private:
+    const char* previousThreadName;
+};
+
+// Allows the given RealtimeViolation flags on this thread for the lifetime of the scope.
+// Meant for third-party code with a known, accepted cost.
+class RealtimeExemption
+{
+public:
+    explicit RealtimeExemption (int allowedViolations);
+    ~RealtimeExemption();
+
+private:
+    int previousAllowedViolations;
+};
+
+// Violations reported since the process started.
+int getNumRealtimeViolations();
+
+#else
+
+class RealtimeScope
+{
+public:
+    explicit RealtimeScope (const char*) {}
+};
+
+class RealtimeExemption
+{
+public:
+    explicit RealtimeExemption (int) {}
+};
+
+inline int getNumRealtimeViolations() { return 0; }
+
+#endif
+
+} // namespace ddsp
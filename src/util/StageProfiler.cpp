@@ -0,0 +1,159 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/*
+Bucket 0 holds durations below 1 us and bucket i > 0 those in
+[2^((i - 1) / 8), 2^(i / 8)) us, the last one everything longer. A percentile
+is read as the geometric centre of the bucket the cumulative count crosses
+it in, capped at the exact maximum.
+
+Each histogram has a single writer, the render thread, so totals and the
+maximum are updated with plain loads and stores instead of read-modify-write
+operations. Readers only ever see a slightly stale snapshot.
+*/
+
+#include "util/StageProfiler.h"
+
+namespace ddsp
+{
+
+namespace
+{
+    constexpr const char* kStageNames[] = {
+        "input resample",     "feature extraction", "MIDI controls", "control prediction",
+        "harmonic synthesis", "noise synthesis",    "output resample", "hop",
+    };
+    static_assert (std::size (kStageNames) == static_cast<size_t> (RenderStage::kNumStages));
+} // namespace
+
+const char* getRenderStageName (RenderStage stage) { return kStageNames[static_cast<size_t> (stage)]; }
+
+void LatencyHistogram::record (double duration_us) noexcept
+{
+    int bucket = 0;
+    if (duration_us >= 1.0)
+    {
+        bucket = std::min (kNumBuckets - 1, 1 + static_cast<int> (std::log2 (duration_us) * kBucketsPerOctave));
+    }
+    buckets[static_cast<size_t> (bucket)].fetch_add (1, std::memory_order_relaxed);
+
+    total_us.store (total_us.load (std::memory_order_relaxed) + duration_us, std::memory_order_relaxed);
+    if (duration_us > max_us.load (std::memory_order_relaxed))
+    {
+        max_us.store (duration_us, std::memory_order_relaxed);
+    }
+}
+
+LatencyHistogram::Summary LatencyHistogram::getSummary() const
+{
+    std::array<uint32_t, kNumBuckets> snapshot;
+    int64_t numRecorded = 0;
+    for (size_t i = 0; i < snapshot.size(); ++i)
+    {
+        snapshot[i] = buckets[i].load (std::memory_order_relaxed);
+        numRecorded += snapshot[i];
+    }
+
+    Summary summary;
+    if (numRecorded == 0)
+    {
+        return summary;
+    }
+    summary.count = numRecorded;
+    summary.max_us = max_us.load (std::memory_order_relaxed);
+    summary.mean_us = total_us.load (std::memory_order_relaxed) / static_cast<double> (numRecorded);
+
+    auto getPercentile = [&] (double fraction)
+    {
+        const auto rank = std::max<int64_t> (1, static_cast<int64_t> (std::ceil (fraction * numRecorded)));
+        int64_t cumulative = 0;
+        for (int i = 0; i < kNumBuckets; ++i)
+        {
+            cumulative += snapshot[static_cast<size_t> (i)];
+            if (cumulative >= rank)
+            {
+                const double centre_us = i == 0 ? 0.5 : std::exp2 ((i - 0.5) / kBucketsPerOctave);
+                return std::min (centre_us, summary.max_us);
+            }
+        }
+        return summary.max_us;
+    };
+    summary.p50_us = getPercentile (0.5);
+    summary.p99_us = getPercentile (0.99);
+    return summary;
+}
+
+void LatencyHistogram::reset()
+{
+    for (auto& bucket : buckets)
+    {
+        bucket.store (0, std::memory_order_relaxed);
+    }
+    total_us.store (0.0, std::memory_order_relaxed);
+    max_us.store (0.0, std::memory_order_relaxed);
+}
+
+void StageProfiler::record (RenderStage stage, juce::int64 ticks) noexcept
+{
+    histograms[static_cast<size_t> (stage)].record (static_cast<double> (ticks) / ticksPerMicrosecond);
+}
+
+StageProfiler::Report StageProfiler::getReport() const
+{
+    Report report;
+    for (size_t i = 0; i < histograms.size(); ++i)
+    {
+        report.stages[i] = histograms[i].getSummary();
+    }
+    report.hopBudget_us = hopBudget_us.load (std::memory_order_relaxed);
+
+    const auto& hops = report[RenderStage::kHop];
+    if (hops.count > 0)
+    {
+        report.realTimeFactor = report.getBudgetFraction (hops.mean_us);
+    }
+    return report;
+}
+
+void StageProfiler::reset()
+{
+    for (auto& histogram : histograms)
+    {
+        histogram.reset();
+    }
+}
+
+juce::String StageProfiler::Report::toString() const
+{
+    juce::String text;
+    text << "Render timings, hop budget " << juce::String (hopBudget_us, 0) << " us, real-time factor "
+         << juce::String (realTimeFactor, 3) << juce::newLine;
+    for (size_t i = 0; i < stages.size(); ++i)
+    {
+        const auto& stage = stages[i];
+        if (stage.count == 0)
+        {
+            continue;
+        }
+        const double p99_percent = 100.0 * getBudgetFraction (stage.p99_us);
+        text << "  " << getRenderStageName (static_cast<RenderStage> (i)) << ": p50 " << juce::String (stage.p50_us, 1)
+             << " us, p99 " << juce::String (stage.p99_us, 1) << " us (" << juce::String (p99_percent, 1)
+             << "% of the hop), max " << juce::String (stage.max_us, 1) << " us" << juce::newLine;
+    }
+    return text.trimEnd();
+}
+
+} // namespace ddsp
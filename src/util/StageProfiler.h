@@ -0,0 +1,135 @@
+/*
+Copyright 2022 The DDSP-VST Authors.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+namespace ddsp
+{
+
+// Stages of one hop of InferencePipeline::render(). kHop times the whole hop. The effect extracts
+// features from its input, the synth takes its controls from MIDI instead.
+enum class RenderStage
+{
+    kInputResample = 0,
+    kFeatureExtraction,
+    kMidiControls,
+    kControlPrediction,
+    kHarmonicSynthesis,
+    kNoiseSynthesis,
+    kOutputResample,
+    kHop,
+    kNumStages
+};
+
+const char* getRenderStageName (RenderStage stage);
+
+// Histogram of durations with logarithmic buckets, 8 per octave from 1 us to 1 s, so
+// percentiles are accurate to about 9%. Lock-free: one thread records, any thread reads.
+class LatencyHistogram
+{
+public:
+    struct Summary
+    {
+        int64_t count = 0;
+        double p50_us = 0.0;
+        double p99_us = 0.0;
+        double max_us = 0.0;
+        double mean_us = 0.0;
+    };
+
+    void record (double duration_us) noexcept;
+    Summary getSummary() const;
+    // Racy with record(), a record in flight may survive the reset.
+    void reset();
+
+private:
+    static constexpr int kBucketsPerOctave = 8;
+    static constexpr int kNumOctaves = 20;
+    static constexpr int kNumBuckets = kBucketsPerOctave * kNumOctaves + 1;
+
+    std::array<std::atomic<uint32_t>, kNumBuckets> buckets {};
+    std::atomic<double> total_us { 0.0 };
+    std::atomic<double> max_us { 0.0 };
+};
+
+// Per-stage timings of the render loop. Disabled by default, when a ScopedStage costs a single
+// relaxed load. Enabled, each stage takes two high-resolution timestamps and a few relaxed
+// atomic updates, and never locks or allocates.
+class StageProfiler
+{
+public:
+    // Times the enclosing scope as stage, if the profiler is enabled.
+    class ScopedStage
+    {
+    public:
+        ScopedStage (StageProfiler& p, RenderStage s) noexcept
+            : profiler (p), stage (s), start (p.isEnabled() ? juce::Time::getHighResolutionTicks() : 0)
+        {
+        }
+
+        ~ScopedStage()
+        {
+            if (start != 0)
+            {
+                profiler.record (stage, juce::Time::getHighResolutionTicks() - start);
+            }
+        }
+
+    private:
+        StageProfiler& profiler;
+        const RenderStage stage;
+        const juce::int64 start;
+
+        JUCE_DECLARE_NON_COPYABLE (ScopedStage)
+    };
+
+    struct Report
+    {
+        std::array<LatencyHistogram::Summary, static_cast<size_t> (RenderStage::kNumStages)> stages;
+        // Audio time rendered by one hop, which every hop has to stay under.
+        double hopBudget_us = 0.0;
+        // Processing time over the audio time rendered, below 1 keeps up with real time.
+        double realTimeFactor = 0.0;
+
+        const LatencyHistogram::Summary& operator[] (RenderStage stage) const
+        {
+            return stages[static_cast<size_t> (stage)];
+        }
+        double getBudgetFraction (double duration_us) const
+        {
+            return hopBudget_us > 0.0 ? duration_us / hopBudget_us : 0.0;
+        }
+        juce::String toString() const;
+    };
+
+    void setEnabled (bool shouldBeEnabled) { enabled.store (shouldBeEnabled, std::memory_order_relaxed); }
+    bool isEnabled() const noexcept { return enabled.load (std::memory_order_relaxed); }
+    void setHopBudget_us (double budget) { hopBudget_us.store (budget, std::memory_order_relaxed); }
+
+    void record (RenderStage stage, juce::int64 ticks) noexcept;
+    Report getReport() const;
+    void reset();
+
+private:
+    std::atomic<bool> enabled { false };
+    std::atomic<double> hopBudget_us { 0.0 };
+    const double ticksPerMicrosecond = static_cast<double> (juce::Time::getHighResolutionTicksPerSecond()) / 1.0e6;
+    std::array<LatencyHistogram, static_cast<size_t> (RenderStage::kNumStages)> histograms;
+};
+
+} // namespace ddsp
@@ -1,9 +1,44 @@
+#include <cstdlib>
+#include <limits>
 #include <memory>
+#include <thread>
 
 #include "PluginProcessor.h"
+#include "audio/ADSREnvelope.h"
+#include "audio/AudioRingBuffer.h"
+#include "audio/FractionalHopScheduler.h"
+#include "audio/HarmonicSynthesizer.h"
+#include "audio/MidiInputProcessor.h"
+#include "audio/NativeFeatureExtractor.h"
+#include "audio/PolyphaseResampler.h"
+#include "audio/tflite/FeatureExtractionModel.h"
+#include "audio/tflite/InferencePipeline.h"
+#include "audio/tflite/ModelLibrary.h"
+#include "audio/tflite/PredictControlsModel.h"
+#include "audio/tflite/TypedTensor.h"
+#include "audio/tflite/XNNPackDelegate.h"
+#include "util/EventTracer.h"
+#include "util/MemoryArena.h"
+#include "util/RealtimeLogger.h"
+#include "util/RealtimeSanitizer.h"
+#include "util/StageProfiler.h"
 
 #include <gtest/gtest.h>
 
+// Number of heap allocations the current thread makes while running function, counted at the
+// malloc level by the real-time sanitizer as violations of a RealtimeScope, so frees, locks and
+// blocking calls count too. Always 0 without the sanitizer.
+template <typename Function>
+int countAllocations (Function&& function)
+{
+    const int numBefore = ddsp::getNumRealtimeViolations();
+    {
+        const ddsp::RealtimeScope scope ("test");
+        function();
+    }
+    return ddsp::getNumRealtimeViolations() - numBefore;
+}
+
 constexpr char ASSETS_DIR[] = "assets";
 
 juce::File locateAsset (const std::string& name)
@@ -21,6 +56,27 @@ juce::File locateAsset (const std::string& name)
     return juce::File {};
 }
 
+// First channel of the asset resampled to the model rate, empty if it cannot be read.
+juce::AudioBuffer<float> readAtModelRate (const std::string& name)
+{
+    juce::AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader (formatManager.createReaderFor (locateAsset (name)));
+    if (reader == nullptr)
+    {
+        return {};
+    }
+
+    juce::AudioBuffer<float> input (1, static_cast<int> (reader->lengthInSamples));
+    reader->read (&input, 0, input.getNumSamples(), 0, true, false);
+
+    const double ratio = reader->sampleRate / ddsp::kModelSampleRate_Hz;
+    juce::AudioBuffer<float> resampled (1, static_cast<int> (input.getNumSamples() / ratio));
+    juce::WindowedSincInterpolator interpolator;
+    interpolator.process (ratio, input.getReadPointer (0), resampled.getWritePointer (0), resampled.getNumSamples());
+    return resampled;
+}
+
 std::unique_ptr<juce::FileOutputStream> openForOverwriting (const juce::File& file)
 {
     auto stream = std::make_unique<juce::FileOutputStream> (file);
@@ -83,3 +139,944 @@ TEST (EndToEndTest, Render)
 
     transportSource.releaseResources();
 }
+
+TEST (RenderAllocationTest, ProcessBlockDoesNotAllocate)
+{
+#if ! (DDSP_ENABLE_RT_SANITIZER && JUCE_LINUX)
+    // Counting operator new alone would miss what TFLite and the C library take with malloc.
+    GTEST_SKIP() << "Needs DDSP_ENABLE_RT_SANITIZER on Linux.";
+#endif
+    const char* setting = std::getenv ("DDSP_RT_SANITIZER");
+    if (setting != nullptr && std::string (setting) == "off")
+    {
+        GTEST_SKIP() << "Needs the sanitizer checks on.";
+    }
+
+    constexpr double sampleRate = 48000.0;
+    constexpr int frameSize = 512;
+
+    juce::ScopedJuceInitialiser_GUI juce_framework;
+
+    DDSPAudioProcessor processor (/*singleThreaded=*/true);
+    processor.prepareToPlay (sampleRate, frameSize);
+    // Profiling must not allocate either.
+    processor.setProfilingEnabled (true);
+
+    juce::AudioBuffer<float> buffer (2, frameSize);
+    juce::MidiBuffer midiBuffer;
+    juce::Random random (1);
+
+    // A few seconds of noise, so every hop runs the models and synthesizers.
+    int numAllocations = 0;
+    for (int block = 0; block < 300; ++block)
+    {
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        {
+            for (int s = 0; s < frameSize; ++s)
+            {
+                buffer.setSample (ch, s, 0.5f * (random.nextFloat() - 0.5f));
+            }
+        }
+
+        numAllocations += countAllocations ([&] { processor.processBlock (buffer, midiBuffer); });
+    }
+    EXPECT_EQ (numAllocations, 0);
+}
+
+TEST (RenderTimingTest, TimesEveryStageWithinTheHop)
+{
+    constexpr double sampleRate = 48000.0;
+    constexpr int frameSize = 512;
+
+    juce::ScopedJuceInitialiser_GUI juce_framework;
+
+    DDSPAudioProcessor processor (/*singleThreaded=*/true);
+    processor.prepareToPlay (sampleRate, frameSize);
+    processor.setProfilingEnabled (true);
+
+    juce::AudioBuffer<float> buffer (2, frameSize);
+    juce::MidiBuffer midiBuffer;
+    juce::Random random (1);
+    for (int block = 0; block < 100; ++block)
+    {
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+        {
+            for (int s = 0; s < frameSize; ++s)
+            {
+                buffer.setSample (ch, s, 0.5f * (random.nextFloat() - 0.5f));
+            }
+        }
+        processor.processBlock (buffer, midiBuffer);
+    }
+
+    // Every hop was timed, and the stages fit in the hop.
+    const auto timings = processor.getRenderTimings();
+    const auto& hops = timings[ddsp::RenderStage::kHop];
+    EXPECT_GT (hops.count, 0);
+    for (const auto stage : { ddsp::RenderStage::kInputResample,
+                              ddsp::RenderStage::kFeatureExtraction,
+                              ddsp::RenderStage::kControlPrediction,
+                              ddsp::RenderStage::kHarmonicSynthesis,
+                              ddsp::RenderStage::kNoiseSynthesis,
+                              ddsp::RenderStage::kOutputResample })
+    {
+        EXPECT_EQ (timings[stage].count, hops.count) << ddsp::getRenderStageName (stage);
+        EXPECT_LE (timings[stage].max_us, hops.max_us) << ddsp::getRenderStageName (stage);
+    }
+    // Only the synth takes its controls from MIDI.
+    EXPECT_EQ (timings[ddsp::RenderStage::kMidiControls].count, 0);
+    EXPECT_GT (timings.realTimeFactor, 0.0);
+}
+
+TEST (FeatureExtractorTest, NativeMatchesTFLite)
+{
+    constexpr char inputFilename[] = "ddsp_input_48k.wav";
+    // Frames quieter than this carry no reliable pitch for either extractor.
+    constexpr float minLoudness_dB = -50.0f;
+    constexpr float maxMedianPitchError_cents = 50.0f;
+
+    const juce::AudioBuffer<float> resampled = readAtModelRate (inputFilename);
+    ASSERT_GT (resampled.getNumSamples(), 0) << "Could not read " << inputFilename;
+
+    ddsp::FeatureExtractionModel tfliteExtractor;
+    ddsp::NativeFeatureExtractor nativeExtractor;
+    // Fed only the new hop each frame, must agree with the extractor given whole frames.
+    ddsp::NativeFeatureExtractor streamingExtractor;
+
+    std::vector<float> pitchErrors_cents;
+    int numFrames = 0;
+
+    for (int start = 0; start + ddsp::kModelFrameSize <= resampled.getNumSamples(); start += ddsp::kModelHopSize)
+    {
+        const float* frame = resampled.getReadPointer (0, start);
+        ddsp::AudioFeatures tfliteFeatures, nativeFeatures;
+
+        std::copy (frame, frame + ddsp::kModelFrameSize, tfliteExtractor.getInputBuffer());
+        tfliteExtractor.process (tfliteFeatures);
+        std::copy (frame, frame + ddsp::kModelFrameSize, nativeExtractor.getInputBuffer());
+        nativeExtractor.process (nativeFeatures);
+
+        const int numNewSamples = start == 0 ? ddsp::kModelFrameSize : ddsp::kModelHopSize;
+        const float* newSamples = frame + ddsp::kModelFrameSize - numNewSamples;
+        std::copy (newSamples, newSamples + numNewSamples, streamingExtractor.shiftInputBuffer (numNewSamples));
+        ddsp::AudioFeatures streamingFeatures;
+        streamingExtractor.process (streamingFeatures);
+        EXPECT_NEAR (streamingFeatures.f0_hz, nativeFeatures.f0_hz, 0.01f * nativeFeatures.f0_hz);
+        EXPECT_NEAR (streamingFeatures.loudness_db, nativeFeatures.loudness_db, 0.1f);
+
+        ++numFrames;
+
+        if (tfliteFeatures.loudness_db > minLoudness_dB)
+        {
+            pitchErrors_cents.push_back (1200.0f * std::abs (std::log2 (nativeFeatures.f0_hz / tfliteFeatures.f0_hz)));
+        }
+    }
+
+    ASSERT_GT (numFrames, 0);
+    ASSERT_FALSE (pitchErrors_cents.empty()) << "No voiced frames in " << inputFilename;
+
+    auto median = pitchErrors_cents.begin() + pitchErrors_cents.size() / 2;
+    std::nth_element (pitchErrors_cents.begin(), median, pitchErrors_cents.end());
+    EXPECT_LT (*median, maxMedianPitchError_cents);
+}
+
+TEST (FeatureExtractorTest, StreamsQuietFramesAfterLoudPassage)
+{
+    constexpr int numLoudHops = 2000;
+    constexpr int numQuietHops = 10;
+    constexpr float quietFrequency_Hz = 220.0f;
+
+    ddsp::NativeFeatureExtractor extractor;
+    juce::Random random (1);
+    ddsp::AudioFeatures features;
+    double phase = 0.0;
+
+    for (int hop = 0; hop < numLoudHops + numQuietHops; ++hop)
+    {
+        float* newSamples = extractor.shiftInputBuffer (ddsp::kModelHopSize);
+        for (int i = 0; i < ddsp::kModelHopSize; ++i)
+        {
+            if (hop < numLoudHops)
+            {
+                newSamples[i] = 2.0f * random.nextFloat() - 1.0f;
+            }
+            else
+            {
+                // About -53 dB.
+                newSamples[i] = 0.003f * static_cast<float> (std::sin (phase));
+                phase += juce::MathConstants<double>::twoPi * quietFrequency_Hz / ddsp::kModelSampleRate_Hz;
+            }
+        }
+        extractor.process (features);
+    }
+
+    // The quiet tone fills the frame by now and is neither silent nor mistaken for another pitch.
+    EXPECT_GT (features.loudness_db, -60.0f);
+    EXPECT_LT (features.loudness_db, -45.0f);
+    EXPECT_NEAR (features.f0_hz, quietFrequency_Hz, 0.01f * quietFrequency_Hz);
+}
+
+TEST (HarmonicSynthesizerTest, ReachesTargetAmplitudeWithinShortHop)
+{
+    constexpr int hopSize = 64;
+    // A quarter of the model rate, so every fourth sample is a peak of the fundamental.
+    constexpr float f0_Hz = ddsp::kModelSampleRate_Hz / 4.0f;
+    constexpr float amplitude = 0.5f;
+
+    ddsp::MemoryArena arena;
+    ddsp::HarmonicSynthesizer synthesizer (ddsp::kHarmonicsSize, ddsp::kModelSampleRate_Hz);
+    arena.beginLayout();
+    synthesizer.prepare (hopSize, arena);
+    arena.commit ({});
+    synthesizer.prepare (hopSize, arena);
+
+    // From silence to the fundamental alone, the higher harmonics are above Nyquist anyway.
+    std::array<float, ddsp::kHarmonicsSize> harmonics {};
+    harmonics[0] = 1.0f;
+    const float* hop = synthesizer.render (harmonics.data(), amplitude, f0_Hz);
+
+    // The ramp spans the first half of the hop and holds the target over the second.
+    float peak = 0.0f;
+    for (int i = hopSize / 2; i < hopSize; ++i)
+    {
+        peak = std::max (peak, std::abs (hop[i]));
+    }
+    EXPECT_NEAR (peak, amplitude, 1.0e-3f);
+    EXPECT_LE (std::abs (hop[0]), amplitude / (hopSize / 2));
+}
+
+TEST (PolyphaseResamplerTest, ConvertsHostRatesToModelRate)
+{
+    constexpr float testFrequency_Hz = 440.0f;
+    constexpr int numHops = 20;
+
+    // Standard rates with a whole-sample hop, and rates that need fractional hop scheduling.
+    for (double hostRate : { 16000.0, 22050.0, 32000.0, 44100.0, 47999.0, 48000.0, 96000.0 })
+    {
+        ddsp::FractionalHopScheduler scheduler;
+        scheduler.prepare (hostRate, ddsp::kModelSampleRate_Hz, ddsp::kModelHopSize);
+        const int maxHopSize = scheduler.getMaxHopSize();
+
+        ddsp::PolyphaseResampler down, up;
+        down.prepare (hostRate, ddsp::kModelSampleRate_Hz, maxHopSize);
+        up.prepare (ddsp::kModelSampleRate_Hz, hostRate, ddsp::kModelHopSize);
+        EXPECT_EQ (down.isBypassed(), hostRate == ddsp::kModelSampleRate_Hz);
+
+        std::vector<float> hostHop (maxHopSize), modelHop (ddsp::kModelHopSize);
+        std::vector<float> roundTrip (up.getMaxOutputSamples (ddsp::kModelHopSize));
+        int64_t numInputSamples = 0, numOutputSamples = 0;
+        float peak = 0.0f;
+
+        for (int hop = 0; hop < numHops; ++hop)
+        {
+            const int hopSize = scheduler.getNextHopSize();
+            for (int i = 0; i < hopSize; ++i)
+            {
+                const double t = (numInputSamples + i) / hostRate;
+                hostHop[i] = static_cast<float> (std::sin (juce::MathConstants<double>::twoPi * testFrequency_Hz * t));
+            }
+
+            // Every hop yields exactly one model hop.
+            ASSERT_EQ (down.process (hostHop.data(), hopSize, modelHop.data(), ddsp::kModelHopSize),
+                       ddsp::kModelHopSize)
+                << "Host rate " << hostRate;
+            const int numUpsampled = up.process (
+                modelHop.data(), ddsp::kModelHopSize, roundTrip.data(), static_cast<int> (roundTrip.size()));
+
+            numInputSamples += hopSize;
+            numOutputSamples += numUpsampled;
+            scheduler.advance();
+
+            // Skip the filters' startup transient.
+            if (hop >= numHops / 2)
+            {
+                peak = std::max (peak, juce::FloatVectorOperations::findMaximum (roundTrip.data(), numUpsampled));
+            }
+        }
+
+        // Output keeps pace with the input and a tone well inside the passband survives at unity gain.
+        EXPECT_LE (std::abs (numOutputSamples - numInputSamples), 1) << "Host rate " << hostRate;
+        EXPECT_NEAR (peak, 1.0f, 0.01f) << "Host rate " << hostRate;
+    }
+}
+
+TEST (AudioRingBufferTest, ReadsAcrossTheWrapContiguously)
+{
+    ddsp::AudioRingBuffer ring;
+    ring.prepare (/*numChannels=*/2, /*minCapacity=*/1000);
+    const int capacity = ring.getTotalSize();
+    ASSERT_GE (capacity, 1000);
+
+    juce::AudioBuffer<float> block (2, capacity / 3);
+    float next = 0.0f;
+    float expected = 0.0f;
+
+    // Cycle through the ring several times so reads straddle its end.
+    for (int i = 0; i < 10; ++i)
+    {
+        for (int s = 0; s < block.getNumSamples(); ++s, next += 1.0f)
+        {
+            block.setSample (0, s, next);
+            block.setSample (1, s, -next);
+        }
+        ring.push (block);
+        ASSERT_EQ (ring.getNumReady(), block.getNumSamples());
+
+        const float* left = ring.getReadPointer (0, block.getNumSamples());
+        const float* right = ring.getReadPointer (1, block.getNumSamples());
+        for (int s = 0; s < block.getNumSamples(); ++s, expected += 1.0f)
+        {
+            ASSERT_EQ (left[s], expected);
+            ASSERT_EQ (right[s], -expected);
+        }
+        ring.pop (block.getNumSamples());
+    }
+}
+
+TEST (MemoryArenaTest, PlacesTheMeasuredLayout)
+{
+    ddsp::MemoryArena arena;
+    auto layout = [&arena]
+    {
+        return std::array<float*, 3> { arena.allocate<float> (1),
+                                        arena.allocate<float> (100),
+                                        arena.allocate<float> (3 * 1024 * 1024) };
+    };
+
+    arena.beginLayout();
+    for (float* buffer : layout())
+    {
+        EXPECT_EQ (buffer, nullptr);
+    }
+    const size_t measured = arena.getNumBytesUsed();
+
+    arena.commit ({ /*lockPages=*/false, /*useHugePages=*/true });
+    const auto buffers = layout();
+    EXPECT_EQ (arena.getNumBytesUsed(), measured);
+    EXPECT_GE (arena.getCapacity(), measured);
+
+    for (size_t i = 0; i < buffers.size(); ++i)
+    {
+        ASSERT_NE (buffers[i], nullptr);
+        EXPECT_EQ (reinterpret_cast<uintptr_t> (buffers[i]) % ddsp::MemoryArena::kAlignment, 0u);
+        if (i > 0)
+        {
+            EXPECT_GE (buffers[i], buffers[i - 1] + (i == 1 ? 1 : 100));
+        }
+    }
+    // Committed memory is zeroed.
+    EXPECT_EQ (buffers[2][3 * 1024 * 1024 - 1], 0.0f);
+}
+
+TEST (RealtimeLoggerTest, CountsAndCollapsesRepeatedEvents)
+{
+    ddsp::RealtimeLogger logger;
+    const juce::File logFile = juce::File::createTempFile (".log");
+    logger.setLogFile (logFile);
+
+    constexpr int numProducers = 4;
+    constexpr int numEventsPerProducer = 100;
+    std::vector<std::thread> producers;
+    for (int p = 0; p < numProducers; ++p)
+    {
+        producers.emplace_back (
+            [&logger]
+            {
+                for (int i = 0; i < numEventsPerProducer; ++i)
+                {
+                    logger.log (ddsp::LogEvent::kOutputUnderflow, 512, 0);
+                }
+            });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    logger.log (ddsp::LogEvent::kInputOverflow, 256, 10);
+    logger.flush();
+    logger.setLogFile ({});
+
+    EXPECT_EQ (logger.getCount (ddsp::LogEvent::kOutputUnderflow), numProducers * numEventsPerProducer);
+    EXPECT_EQ (logger.getCount (ddsp::LogEvent::kInputOverflow), 1);
+    EXPECT_EQ (logger.getNumDropped(), 0);
+
+    juce::StringArray lines;
+    logFile.readLines (lines);
+    int numWritten = 0;
+    for (const auto& line : lines)
+    {
+        numWritten += line.contains ("Output ring underflow (block size 512, ready 0)") ? 1 : 0;
+    }
+    EXPECT_GE (numWritten, 1);
+    EXPECT_LT (numWritten, numProducers * numEventsPerProducer);
+    const juce::String log = lines.joinIntoString ("\n");
+    EXPECT_TRUE (log.contains ("repeated"));
+    EXPECT_TRUE (log.contains ("Input ring overflow (block size 256, free space 10)"));
+    logFile.deleteFile();
+}
+
+TEST (RealtimeSanitizerTest, CountsViolationsInsideScopes)
+{
+#if ! (DDSP_ENABLE_RT_SANITIZER && JUCE_LINUX)
+    GTEST_SKIP() << "Needs DDSP_ENABLE_RT_SANITIZER on Linux.";
+#endif
+    const char* setting = std::getenv ("DDSP_RT_SANITIZER");
+    if (setting != nullptr && std::string (setting) != "report")
+    {
+        GTEST_SKIP() << "Needs the sanitizer in report mode.";
+    }
+
+    // Counts are read inside the scopes and compared outside, where the checks are off.
+    const int numBefore = ddsp::getNumRealtimeViolations();
+    int numAfterMalloc = 0, numAfterFree = 0, numAfterStderr = 0, numAfterExemption = 0;
+    {
+        const ddsp::RealtimeScope scope ("test");
+        void* volatile memory = std::malloc (16);
+        numAfterMalloc = ddsp::getNumRealtimeViolations();
+        std::free (memory);
+        numAfterFree = ddsp::getNumRealtimeViolations();
+        std::cerr << ' ';
+        numAfterStderr = ddsp::getNumRealtimeViolations();
+        {
+            const ddsp::RealtimeExemption exemption (ddsp::kRealtimeAllocation);
+            memory = std::malloc (16);
+            std::free (memory);
+        }
+        numAfterExemption = ddsp::getNumRealtimeViolations();
+    }
+    void* volatile memory = std::malloc (16);
+    std::free (memory);
+
+    EXPECT_EQ (numAfterMalloc, numBefore + 1);
+    EXPECT_EQ (numAfterFree, numBefore + 2);
+    EXPECT_GT (numAfterStderr, numAfterFree);
+    EXPECT_EQ (numAfterExemption, numAfterStderr);
+    EXPECT_EQ (ddsp::getNumRealtimeViolations(), numAfterExemption);
+}
+
+TEST (MidiInputProcessorTest, AppliesEventsAtTheirSampleOffsets)
+{
+    constexpr int hopSize = ddsp::kModelHopSize;
+
+    ddsp::MidiInputProcessor midiInputProcessor;
+    midiInputProcessor.prepareToPlay (ddsp::kModelSampleRate_Hz, hopSize);
+    midiInputProcessor.reset (0);
+    midiInputProcessor.setAttack (0.0f);
+    midiInputProcessor.setDecay (0.0f);
+    midiInputProcessor.setSustain (1.0f);
+    midiInputProcessor.setRelease (0.0f);
+
+    // A note and a legato change to another note within the first hop, released mid second hop,
+    // and a note that starts and ends within the third hop.
+    juce::MidiBuffer midi;
+    midi.addEvent (juce::MidiMessage::noteOn (1, 60, 1.0f), 0);
+    midi.addEvent (juce::MidiMessage::noteOn (1, 64, 0.8f), hopSize / 4);
+    midi.addEvent (juce::MidiMessage::noteOff (1, 64), hopSize + hopSize / 2);
+    midi.addEvent (juce::MidiMessage::noteOn (1, 67, 1.0f), 2 * hopSize + hopSize / 4);
+    midi.addEvent (juce::MidiMessage::noteOff (1, 67), 2 * hopSize + hopSize / 2);
+    midiInputProcessor.processMidiMessages (midi, 3 * hopSize);
+
+    // The controls are those at the end of each hop.
+    const auto firstHop = midiInputProcessor.getCurrentPredictControlsInput (hopSize);
+    EXPECT_NEAR (firstHop.f0_hz, ddsp::getFreqFromNoteAndBend (64, static_cast<int> (ddsp::kPitchBendBase)), 0.01f);
+    EXPECT_NEAR (firstHop.loudness_norm, 0.8f, 1.0e-3f);
+
+    const auto secondHop = midiInputProcessor.getCurrentPredictControlsInput (hopSize);
+    EXPECT_NEAR (secondHop.loudness_norm, 0.0f, 1.0e-3f);
+
+    const auto thirdHop = midiInputProcessor.getCurrentPredictControlsInput (hopSize);
+    EXPECT_NEAR (thirdHop.f0_hz, ddsp::getFreqFromNoteAndBend (67, static_cast<int> (ddsp::kPitchBendBase)), 0.01f);
+    EXPECT_NEAR (thirdHop.loudness_norm, 0.0f, 1.0e-3f);
+}
+
+TEST (ADSREnvelopeTest, MatchesJuceADSR)
+{
+    constexpr double sampleRate = 16000.0;
+    // One step of the fastest ramp, the largest difference a transition landing one sample apart can make.
+    constexpr float tolerance = 2.0e-3f;
+    const juce::ADSR::Parameters parameters { /*attack=*/0.05f, /*decay=*/0.1f, /*sustain=*/0.6f, /*release=*/0.2f };
+
+    juce::ADSR reference;
+    ddsp::ADSREnvelope rendered, advanced;
+    reference.setSampleRate (sampleRate);
+    reference.setParameters (parameters);
+    for (auto* envelope : { &rendered, &advanced })
+    {
+        envelope->setSampleRate (sampleRate);
+        envelope->setParameters (parameters);
+    }
+
+    enum class Event
+    {
+        kNoteOn,
+        kNoteOff
+    };
+    // Attack, decay and sustain, released mid-sustain, retriggered mid-release and released to silence.
+    const std::vector<std::pair<Event, int>> blocks = {
+        { Event::kNoteOn, 4000 }, { Event::kNoteOff, 1000 }, { Event::kNoteOn, 300 }, { Event::kNoteOff, 6000 }
+    };
+
+    for (const auto& [event, numSamples] : blocks)
+    {
+        if (event == Event::kNoteOn)
+        {
+            reference.noteOn();
+            rendered.noteOn();
+            advanced.noteOn();
+        }
+        else
+        {
+            reference.noteOff();
+            rendered.noteOff();
+            advanced.noteOff();
+        }
+
+        std::vector<float> block (numSamples);
+        rendered.render (block.data(), numSamples);
+        const float advancedSum = advanced.advance (numSamples);
+
+        double referenceSum = 0.0;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const float expected = reference.getNextSample();
+            referenceSum += expected;
+            ASSERT_NEAR (block[i], expected, tolerance) << "Sample " << i;
+        }
+        EXPECT_NEAR (advancedSum, referenceSum, tolerance * numSamples);
+        EXPECT_NEAR (advanced.getValue(), rendered.getValue(), tolerance);
+    }
+
+    EXPECT_FALSE (rendered.isActive());
+    EXPECT_FALSE (advanced.isActive());
+}
+
+TEST (NativeControlEngineTest, MatchesTFLiteOnEveryEmbeddedModel)
+{
+    constexpr char inputFilename[] = "ddsp_input_48k.wav";
+    // Summation order differs from TFLite's kernels, so the outputs agree only up to rounding.
+    constexpr float tolerance = 1.0e-3f;
+
+    const ddsp::ModelInfo models[] = {
+        { "Bassoon", "", BinaryData::Bassoon_tflite, BinaryData::Bassoon_tfliteSize },
+        { "Clarinet", "", BinaryData::Clarinet_tflite, BinaryData::Clarinet_tfliteSize },
+        { "Flute", "", BinaryData::Flute_tflite, BinaryData::Flute_tfliteSize },
+        { "Melodica", "", BinaryData::Melodica_tflite, BinaryData::Melodica_tfliteSize },
+        { "Saxophone", "", BinaryData::Saxophone_tflite, BinaryData::Saxophone_tfliteSize },
+        { "Sitar", "", BinaryData::Sitar_tflite, BinaryData::Sitar_tfliteSize },
+        { "Trombone", "", BinaryData::Trombone_tflite, BinaryData::Trombone_tfliteSize },
+        { "Trumpet", "", BinaryData::Trumpet_tflite, BinaryData::Trumpet_tfliteSize },
+        { "Tuba", "", BinaryData::Tuba_tflite, BinaryData::Tuba_tfliteSize },
+        { "Violin", "", BinaryData::Violin_tflite, BinaryData::Violin_tfliteSize },
+        { "Vowels", "", BinaryData::Vowels_tflite, BinaryData::Vowels_tfliteSize },
+    };
+    static_assert (std::size (models) == ddsp::kNumEmbeddedPredictControlsModels);
+
+    // Controls as the plugin feeds them, recorded from a real phrase with its notes, slides and rests.
+    const juce::AudioBuffer<float> resampled = readAtModelRate (inputFilename);
+    ASSERT_GT (resampled.getNumSamples(), 0) << "Could not read " << inputFilename;
+
+    ddsp::FeatureExtractionModel extractor;
+    std::vector<ddsp::AudioFeatures> inputs;
+    for (int start = 0; start + ddsp::kModelFrameSize <= resampled.getNumSamples(); start += ddsp::kModelHopSize)
+    {
+        const float* frame = resampled.getReadPointer (0, start);
+        std::copy (frame, frame + ddsp::kModelFrameSize, extractor.getInputBuffer());
+        extractor.process (inputs.emplace_back());
+    }
+    ASSERT_FALSE (inputs.empty());
+
+    for (const auto& mi : models)
+    {
+        ddsp::PredictControlsModel tflite (mi, ddsp::PredictControlsModel::Engine::kTFLite);
+        ddsp::PredictControlsModel native (mi, ddsp::PredictControlsModel::Engine::kNative);
+        ASSERT_EQ (native.getEngine(), ddsp::PredictControlsModel::Engine::kNative)
+            << mi.name << " falls back to TFLite";
+
+        ddsp::SynthesisControls expected, actual;
+        for (size_t hop = 0; hop < inputs.size(); ++hop)
+        {
+            tflite.call (inputs[hop], expected);
+            native.call (inputs[hop], actual);
+
+            ASSERT_NEAR (actual.amplitude, expected.amplitude, tolerance) << mi.name << ", hop " << hop;
+            for (int i = 0; i < ddsp::kHarmonicsSize; ++i)
+            {
+                ASSERT_NEAR (actual.harmonics[i], expected.harmonics[i], tolerance)
+                    << mi.name << ", hop " << hop << ", harmonic " << i;
+            }
+            for (int i = 0; i < ddsp::kNoiseAmpsSize; ++i)
+            {
+                ASSERT_NEAR (actual.noiseAmps[i], expected.noiseAmps[i], tolerance)
+                    << mi.name << ", hop " << hop << ", noise band " << i;
+            }
+        }
+    }
+}
+
+TEST (PredictControlsModelTest, CarriesAndResetsGruState)
+{
+    constexpr int numHops = 8;
+
+    const ddsp::ModelInfo mi ("Violin", "", BinaryData::Violin_tflite, BinaryData::Violin_tfliteSize);
+    ddsp::PredictControlsModel model (mi, ddsp::PredictControlsModel::Engine::kTFLite);
+
+    // The same input every hop, the outputs only change through the state.
+    ddsp::AudioFeatures input;
+    input.f0_norm = 0.5f;
+    input.loudness_norm = 0.7f;
+
+    std::vector<ddsp::SynthesisControls> first (numHops), second (numHops);
+    for (auto* outputs : { &first, &second })
+    {
+        for (auto& output : *outputs)
+        {
+            model.call (input, output);
+        }
+        model.reset();
+    }
+
+    EXPECT_NE (first[0].harmonics, first[1].harmonics);
+    for (int hop = 0; hop < numHops; ++hop)
+    {
+        EXPECT_EQ (first[hop].amplitude, second[hop].amplitude) << "hop " << hop;
+        EXPECT_EQ (first[hop].harmonics, second[hop].harmonics) << "hop " << hop;
+        EXPECT_EQ (first[hop].noiseAmps, second[hop].noiseAmps) << "hop " << hop;
+    }
+}
+
+TEST (StageProfilerTest, SummarizesDurationsPerStage)
+{
+    ddsp::LatencyHistogram histogram;
+    EXPECT_EQ (histogram.getSummary().count, 0);
+
+    // 1 to 100 us, one each, and a single outlier.
+    for (int i = 1; i <= 100; ++i)
+    {
+        histogram.record (static_cast<double> (i));
+    }
+    histogram.record (5000.0);
+
+    const auto summary = histogram.getSummary();
+    EXPECT_EQ (summary.count, 101);
+    EXPECT_DOUBLE_EQ (summary.max_us, 5000.0);
+    EXPECT_NEAR (summary.mean_us, (5050.0 + 5000.0) / 101.0, 1.0e-9);
+    // Buckets are 2^(1/8) wide, about 9%.
+    EXPECT_NEAR (summary.p50_us, 51.0, 51.0 * 0.09);
+    EXPECT_NEAR (summary.p99_us, 100.0, 100.0 * 0.09);
+
+    histogram.reset();
+    EXPECT_EQ (histogram.getSummary().count, 0);
+
+    // Disabled, nothing is recorded.
+    ddsp::StageProfiler profiler;
+    profiler.setHopBudget_us (20000.0);
+    {
+        const ddsp::StageProfiler::ScopedStage stage (profiler, ddsp::RenderStage::kHop);
+    }
+    EXPECT_EQ (profiler.getReport()[ddsp::RenderStage::kHop].count, 0);
+
+    profiler.setEnabled (true);
+    {
+        const ddsp::StageProfiler::ScopedStage stage (profiler, ddsp::RenderStage::kHop);
+        juce::Thread::sleep (2);
+    }
+    const auto report = profiler.getReport();
+    EXPECT_EQ (report[ddsp::RenderStage::kHop].count, 1);
+    EXPECT_GE (report[ddsp::RenderStage::kHop].max_us, 1000.0);
+    EXPECT_NEAR (report.realTimeFactor, report[ddsp::RenderStage::kHop].mean_us / 20000.0, 1.0e-9);
+}
+
+TEST (EventTracerTest, WritesChromeTraceOfEveryThread)
+{
+    ddsp::EventTracer tracer;
+    tracer.begin ("disabled");
+    tracer.setEnabled (true);
+
+    // More spans than a thread buffer holds, so the oldest are overwritten.
+    auto traceSpans = [&tracer] (const char* threadName, uint32_t instance)
+    {
+        tracer.nameCurrentThread (threadName);
+        for (int i = 0; i < 5000; ++i)
+        {
+            const ddsp::EventTracer::ScopedTrace outer (tracer, "outer", instance);
+            const ddsp::EventTracer::ScopedTrace inner (tracer, "inner", instance);
+        }
+        tracer.instant ("done", instance);
+    };
+    std::thread worker (traceSpans, "worker", 2u);
+    traceSpans ("main", 1u);
+    worker.join();
+
+    juce::MemoryOutputStream stream;
+    tracer.writeChromeTrace (stream);
+    const juce::var trace = juce::JSON::parse (stream.toString());
+    const auto* events = trace["traceEvents"].getArray();
+    ASSERT_NE (events, nullptr);
+
+    std::map<int, int> depths;
+    std::map<int, double> lastTimestamps;
+    juce::StringArray threadNames;
+    int numInstants = 0;
+    for (const auto& event : *events)
+    {
+        const juce::String phase = event["ph"];
+        const int tid = event["tid"];
+        if (phase == "M")
+        {
+            if (event["name"].toString() == "thread_name")
+            {
+                threadNames.add (event["args"]["name"]);
+            }
+            continue;
+        }
+
+        EXPECT_NE (event["name"].toString(), "disabled");
+        const double timestamp = event["ts"];
+        EXPECT_GE (timestamp, lastTimestamps[tid]);
+        lastTimestamps[tid] = timestamp;
+
+        // Every span that ends was begun.
+        depths[tid] += phase == "B" ? 1 : (phase == "E" ? -1 : 0);
+        EXPECT_GE (depths[tid], 0);
+        numInstants += phase == "i" ? 1 : 0;
+        EXPECT_TRUE (static_cast<int> (event["args"]["instance"]) == 1
+                     || static_cast<int> (event["args"]["instance"]) == 2);
+    }
+    EXPECT_EQ (depths.size(), 2u);
+    EXPECT_EQ (numInstants, 2);
+    threadNames.sort (false);
+    EXPECT_EQ (threadNames, juce::StringArray ({ "main", "worker" }));
+    EXPECT_EQ (tracer.getNumDropped(), 0);
+}
+
+TEST (EventTracerTest, ReusesBuffersOfExitedThreads)
+{
+    ddsp::EventTracer tracer;
+    tracer.setEnabled (true);
+
+    // More threads than there are buffers, one after another, like host workers that come and go.
+    for (int i = 0; i < 40; ++i)
+    {
+        std::thread ([&tracer] { tracer.instant ("event"); }).join();
+    }
+    EXPECT_EQ (tracer.getNumDropped(), 0);
+}
+
+TEST (XNNPackDelegateTest, ParsesEnvironmentOptions)
+{
+#if DDSP_ENABLE_XNNPACK
+    using Options = ddsp::XNNPackDelegate::Options;
+    const Options defaults = Options::parse ({});
+    EXPECT_TRUE (defaults.enabled);
+    EXPECT_EQ (defaults.numThreads, ddsp::kNumFeatureExtractionThreads);
+    EXPECT_TRUE (defaults.enableQuantized);
+    EXPECT_FALSE (defaults.forceFp16);
+
+    const Options custom = Options::parse ("threads:2, float,fp16,unknown");
+    EXPECT_TRUE (custom.enabled);
+    EXPECT_EQ (custom.numThreads, 2);
+    EXPECT_FALSE (custom.enableQuantized);
+    EXPECT_TRUE (custom.forceFp16);
+
+    EXPECT_FALSE (Options::parse ("off").enabled);
+    EXPECT_EQ (Options::parse ("threads:0").numThreads, 1);
+#else
+    GTEST_SKIP() << "Needs DDSP_ENABLE_XNNPACK.";
+#endif
+}
+
+TEST (TypedTensorTest, ConvertsQuantizedAndHalfValues)
+{
+    const std::vector<float> values = { 0.0f, 1.0f, -1.0f, 0.333f, -2.5f, 1000.0f, 6.1e-5f, 1.0e-7f };
+
+    // Float16 keeps 11 significant bits, with subnormals below 2^-14 in steps of 2^-24.
+    std::vector<uint16_t> halves (values.size());
+    ddsp::TypedTensor half { halves.data(), kTfLiteFloat16, static_cast<int> (halves.size()) };
+    std::vector<float> roundTrip (values.size());
+    half.write (values.data(), static_cast<int> (values.size()));
+    half.read (roundTrip.data(), static_cast<int> (roundTrip.size()));
+    for (size_t i = 0; i < values.size(); ++i)
+    {
+        EXPECT_NEAR (roundTrip[i], values[i], std::max (std::abs (values[i]) / 2048.0f, 6.0e-8f)) << "value " << i;
+    }
+    EXPECT_EQ (halves[1], 0x3c00);
+    EXPECT_EQ (halves[2], 0xbc00);
+
+    // int8 rounds to the nearest step of scale and saturates.
+    std::vector<int8_t> bytes (values.size());
+    ddsp::TypedTensor quantized { bytes.data(), kTfLiteInt8, static_cast<int> (bytes.size()), 0.02f, -10 };
+    quantized.write (values.data(), static_cast<int> (values.size()));
+    quantized.read (roundTrip.data(), static_cast<int> (roundTrip.size()));
+    EXPECT_EQ (bytes[0], -10);
+    EXPECT_NEAR (roundTrip[3], 0.333f, 0.01f);
+    EXPECT_NEAR (roundTrip[4], -2.36f, 1.0e-5f);
+    EXPECT_NEAR (roundTrip[5], 2.74f, 1.0e-5f);
+
+    quantized.clear();
+    EXPECT_TRUE (std::all_of (bytes.begin(), bytes.end(), [] (int8_t b) { return b == -10; }));
+}
+
+TEST (ModelDescriptionTest, DescribesAndProfilesControlModel)
+{
+    constexpr int numInvocations = 20;
+    const ddsp::ModelInfo mi ("Violin", "", BinaryData::Violin_tflite, BinaryData::Violin_tfliteSize);
+    ddsp::PredictControlsModel model (mi, ddsp::PredictControlsModel::Engine::kTFLite);
+
+    const auto unprofiled = model.describe();
+    EXPECT_EQ (unprofiled.numProfiledInvocations, 0);
+    ASSERT_FALSE (unprofiled.ops.empty());
+
+    const auto description = model.describe (numInvocations);
+    EXPECT_EQ (description.engine, "TFLite");
+    EXPECT_EQ (description.inputs.size(), 3u);
+    EXPECT_EQ (description.outputs.size(), 4u);
+    EXPECT_GT (description.arenaBytes, 0u);
+    EXPECT_GT (description.weightBytes, 0u);
+    EXPECT_GE (description.numOriginalOps, static_cast<int> (description.ops.size()));
+    EXPECT_GE (description.getDelegateCoverage(), 0.0);
+    EXPECT_LE (description.getDelegateCoverage(), 1.0);
+
+    // Every node ran once per invocation, within the time of the invocations.
+    double totalOpTime_us = 0.0;
+    for (const auto& op : description.ops)
+    {
+        EXPECT_EQ (op.numInvocations, numInvocations) << op.name;
+        totalOpTime_us += op.totalTime_us;
+    }
+    EXPECT_EQ (description.numProfiledInvocations, numInvocations);
+    EXPECT_GT (description.invokeMean_us, 0.0);
+    EXPECT_LE (description.invokeP50_us, description.invokeP99_us);
+    EXPECT_LE (description.invokeP99_us, description.invokeMax_us);
+    EXPECT_LE (totalOpTime_us, description.invokeMean_us * numInvocations * 1.1 + numInvocations);
+
+    const juce::var json = juce::JSON::parse (ddsp::toJson ({ description }));
+    ASSERT_TRUE (json.isArray());
+    EXPECT_EQ (json[0]["name"].toString(), description.name);
+    EXPECT_EQ (json[0]["ops"].size(), static_cast<int> (description.ops.size()));
+    EXPECT_EQ (static_cast<int> (json[0]["invoke"]["invocations"]), numInvocations);
+}
+
+// Fixture written by scripts/make-test-models.py, empty if it cannot be found.
+ddsp::ModelInfo loadTestModel (const std::string& name)
+{
+    juce::MemoryBlock data;
+    locateAsset ("test_models/" + name + ".tflite").loadFileAsData (data);
+    return ddsp::ModelInfo (name, "", static_cast<const char*> (data.getData()), data.getSize());
+}
+
+TEST (QuantizedModelTest, ValidatesAndMatchesFloat32)
+{
+    constexpr int numHops = 200;
+
+    struct Fixture
+    {
+        const char* name;
+        float tolerance;
+    };
+    // A few steps of the int8 output encoding, float16 weights are off by rounding only.
+    const Fixture fixtures[] = {
+        { "control_float16", 1.0e-3f },
+        { "control_dynamic_int8", 0.02f },
+        { "control_int8", 0.02f },
+    };
+
+    const ddsp::ModelInfo reference = loadTestModel ("control_float32");
+    ASSERT_GT (reference.data.getSize(), 0u) << "Could not load " << reference.name;
+    ddsp::PredictControlsModel referenceModel (reference, ddsp::PredictControlsModel::Engine::kTFLite);
+
+    for (const auto& fixture : fixtures)
+    {
+        const ddsp::ModelInfo mi = loadTestModel (fixture.name);
+        ASSERT_GT (mi.data.getSize(), 0u) << "Could not load " << fixture.name;
+
+        juce::StringArray errors;
+        ASSERT_TRUE (ddsp::ModelLibrary::validateModel (mi, errors))
+            << fixture.name << ": " << errors.joinIntoString ("");
+
+        ddsp::PredictControlsModel model (mi, ddsp::PredictControlsModel::Engine::kTFLite);
+        referenceModel.reset();
+
+        // The amplitude is computed from the new state, so it also checks that the state is carried.
+        ddsp::AudioFeatures input;
+        ddsp::SynthesisControls expected, actual;
+        for (int hop = 0; hop < numHops; ++hop)
+        {
+            input.f0_norm = 0.3f + 0.3f * std::sin (0.05f * hop);
+            input.loudness_norm = 0.5f + 0.4f * std::sin (0.031f * hop);
+            referenceModel.call (input, expected);
+            model.call (input, actual);
+
+            ASSERT_NEAR (actual.amplitude, expected.amplitude, fixture.tolerance) << fixture.name << ", hop " << hop;
+            for (int i = 0; i < ddsp::kHarmonicsSize; ++i)
+            {
+                ASSERT_NEAR (actual.harmonics[i], expected.harmonics[i], fixture.tolerance)
+                    << fixture.name << ", hop " << hop << ", harmonic " << i;
+            }
+            for (int i = 0; i < ddsp::kNoiseAmpsSize; ++i)
+            {
+                ASSERT_NEAR (actual.noiseAmps[i], expected.noiseAmps[i], fixture.tolerance)
+                    << fixture.name << ", hop " << hop << ", noise band " << i;
+            }
+        }
+    }
+}
+
+TEST (InferencePipelineTest, LatencyShrinksWithHopSize)
+{
+    juce::ScopedJuceInitialiser_GUI juce_framework;
+
+    // Rendering cost per hop size is measured by InferencePipeline/render/hop:N in DDSPBenchmarks.
+    int previousLatency = std::numeric_limits<int>::max();
+    for (const int hopSize : { 320, 160, 128, 64 })
+    {
+        DDSPAudioProcessor processor (/*singleThreaded=*/true);
+        processor.setModelHopSize (hopSize);
+        processor.prepareToPlay (48000.0, 512);
+
+        const int latency = processor.getLatencySamples();
+        EXPECT_LT (latency, previousLatency) << "hop size " << hopSize;
+        previousLatency = latency;
+    }
+}
+
+TEST (InferencePipelineTest, PreloadsModelsIntoThePool)
+{
+    juce::ScopedJuceInitialiser_GUI juce_framework;
+
+    DDSPAudioProcessor processor (/*singleThreaded=*/true);
+    const auto& models = processor.getModelLibrary().getModelList();
+    ASSERT_GE (models.size(), 2u);
+
+    ddsp::InferencePipeline pipeline (processor.getValueTree());
+    pipeline.loadModel (models[0]);
+    EXPECT_TRUE (pipeline.isModelPooled (models[0]));
+    EXPECT_FALSE (pipeline.isModelPooled (models[1]));
+
+    pipeline.preloadModel (models[1]);
+    EXPECT_TRUE (pipeline.isModelPooled (models[1]));
+
+    // The model being switched to is pinned, the preloaded one is not.
+    pipeline.setModelPoolMemoryBudget (0);
+    EXPECT_TRUE (pipeline.isModelPooled (models[0]));
+    EXPECT_FALSE (pipeline.isModelPooled (models[1]));
+}
+
+TEST (PluginStateTest, RestoresTheModelAndItsSlot)
+{
+    constexpr int modelIdx = 2;
+
+    juce::ScopedJuceInitialiser_GUI juce_framework;
+
+    juce::MemoryBlock state;
+    {
+        DDSPAudioProcessor processor (/*singleThreaded=*/true);
+        ASSERT_GT (processor.getModelLibrary().getModelList().size(), static_cast<size_t> (modelIdx));
+        processor.loadModel (modelIdx);
+        processor.getStateInformation (state);
+    }
+
+    DDSPAudioProcessor processor (/*singleThreaded=*/true);
+    processor.setStateInformation (state.getData(), static_cast<int> (state.getSize()));
+    EXPECT_EQ (processor.getCurrentModel(), modelIdx);
+    EXPECT_EQ (static_cast<int> (*processor.getValueTree().getRawParameterValue ("ModelSlot")), modelIdx);
+}